@@ -0,0 +1,547 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Micro-benchmarks of the perception stages run by Cw3Solution::cloudCallBackOne.
+   Every case renders a synthetic organized cloud of the mat, so the suite runs
+   without a ROS master and different pipeline modes see the same inputs. */
+
+#include <cw3_team_2/occupancy_map.h>
+#include <cw3_team_2/perception_pipeline.h>
+#include <cw3_team_2/synthetic_scene.h>
+
+#include <benchmark/benchmark.h>
+#include <pcl/common/transforms.h>
+#include <pcl/conversions.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/* Counts heap allocations so the cases can report allocations per frame */
+static std::atomic<size_t> g_allocations(0);
+
+/* Set by a case whose output differs from the implementation it replaces */
+static bool g_output_mismatch = false;
+
+void *
+operator new(size_t size)
+{
+  g_allocations++;
+  if (void *ptr = std::malloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+namespace
+{
+  /** \brief Render a scene with the R200 aspect ratio at the given width */
+  SyntheticScene
+  makeScene(int width, int num_cubes, int stack_height, int num_obstacles)
+  {
+    SyntheticSceneConfig config;
+    config.width = width;
+    config.height = width * 3 / 4;
+    config.num_cubes = num_cubes;
+    config.stack_height = stack_height;
+    config.num_obstacles = num_obstacles;
+    config.dropout = 0.01;
+    return generateScene(config);
+  }
+
+  /** \brief Depth of the floor cut-off, as found by Cw3Solution::findFloorDepth */
+  double
+  floorDepth(const SyntheticScene &scene)
+  {
+    return (scene.camera_to_world.inverse() * Eigen::Vector3f(0.0f, 0.0f, 0.03f)).z();
+  }
+
+  /** \brief Per-cluster work of the point cloud callback, with TF replaced by
+    * the known camera pose of the scene */
+  template <typename PointType> int
+  processClusters(PerceptionPipeline<PointType> &pipeline, const SyntheticScene &scene)
+  {
+    Eigen::Vector4f centroid;
+
+    for (size_t i = 0; i < pipeline.g_arena.clusterCount(); i++)
+    {
+      ClusterBuffers<PointType> &cluster = pipeline.g_arena.cluster(i);
+      pipeline.extractCluster(cluster.indices, *cluster.camera, cluster.rgba);
+      pcl::compute3DCentroid(*cluster.camera, centroid);
+      pcl::transformPointCloud(*cluster.camera, *cluster.world, scene.camera_to_world);
+      pipeline.computeClusterStats(*cluster.world, cluster.rgba, 0, true, cluster.stats);
+      benchmark::DoNotOptimize(cluster.stats.color_count);
+    }
+    return pipeline.g_arena.clusterCount();
+  }
+
+  /** \brief Cloud widths, 640 is the R200 resolution */
+  void
+  CloudSizes(benchmark::internal::Benchmark *b)
+  {
+    for (int width : {160, 320, 640})
+      b->Args({width});
+  }
+
+  /** \brief Cloud widths crossed with voxel leaf sizes in millimetres */
+  void
+  CloudAndLeafSizes(benchmark::internal::Benchmark *b)
+  {
+    for (int width : {160, 320, 640})
+      for (int leaf_mm : {5, 10, 20})
+        b->Args({width, leaf_mm});
+  }
+
+  /** \brief Cloud widths crossed with voxel leaf sizes and thread counts */
+  void
+  CloudLeafSizesAndThreads(benchmark::internal::Benchmark *b)
+  {
+    for (int width : {160, 320, 640})
+      for (int leaf_mm : {5, 10, 20})
+        for (int threads : {1, 2, 4})
+          b->Args({width, leaf_mm, threads});
+  }
+
+  /** \brief Cloud widths crossed with the number of cubes on the mat */
+  void
+  CloudAndClusterCounts(benchmark::internal::Benchmark *b)
+  {
+    for (int width : {320, 640})
+      for (int num_cubes : {1, 4, 8, 16})
+        b->Args({width, num_cubes});
+  }
+
+  /** \brief Cloud widths, cube counts and stack heights of the full pipeline */
+  void
+  PipelineCases(benchmark::internal::Benchmark *b)
+  {
+    for (int width : {320, 640})
+      for (int num_cubes : {1, 4, 8})
+        for (int stack_height : {0, 3})
+          b->Args({width, num_cubes, stack_height});
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_Conversion(benchmark::State &state)
+{
+  /* ROS message to PCL cloud, as done at the start of the callback */
+
+  SyntheticScene scene = makeScene(state.range(0), 4, 0, 0);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+
+  pcl::PCLPointCloud2 pcl_pc;
+  PointC cloud;
+  for (auto _ : state)
+  {
+    pcl_conversions::toPCL(msg, pcl_pc);
+    pcl::fromPCLPointCloud2(pcl_pc, cloud);
+    benchmark::DoNotOptimize(cloud.points.data());
+  }
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+  state.SetBytesProcessed(state.iterations() * msg.data.size());
+}
+BENCHMARK(BM_Conversion)->Apply(CloudSizes)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_Ingest(benchmark::State &state)
+{
+  /* Reading the message in place, replacing BM_Conversion + BM_FloorFilter */
+
+  SyntheticScene scene = makeScene(state.range(0), 4, 0, 0);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+  double floor_z = floorDepth(scene);
+
+  PerceptionPipeline<PointT> pipeline;
+  for (auto _ : state)
+  {
+    pipeline.ingest(msg, floor_z);
+    benchmark::DoNotOptimize(pipeline.g_cloud_filtered->points.data());
+  }
+  state.counters["points_out"] = pipeline.g_cloud_filtered->size();
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+  state.SetBytesProcessed(state.iterations() * msg.data.size());
+}
+BENCHMARK(BM_Ingest)->Apply(CloudSizes)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_VoxelGrid(benchmark::State &state)
+{
+  /* Fails unless the output matches pcl::VoxelGrid, both order the voxels
+     the same way so the points are compared in turn */
+
+  SyntheticScene scene = makeScene(state.range(0), 4, 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.g_vg_leaf_sz = state.range(1) / 1000.0;
+  pipeline.g_vx.setThreads(state.range(2));
+
+  PointC reference;
+  pcl::VoxelGrid<PointT> grid;
+  grid.setInputCloud(scene.cloud);
+  grid.setLeafSize(pipeline.g_vg_leaf_sz, pipeline.g_vg_leaf_sz, pipeline.g_vg_leaf_sz);
+  grid.filter(reference);
+
+  PointCPtr out(new PointC);
+  pipeline.applyVX(scene.cloud, out);
+
+  double max_error = 0.0;
+  int max_colour_error = 0;
+  for (size_t i = 0; i < out->size() && i < reference.size(); i++)
+  {
+    const PointT &a = (*out)[i];
+    const PointT &b = reference[i];
+    max_error = std::max(max_error, (double)(a.getVector3fMap() - b.getVector3fMap()).norm());
+    max_colour_error = std::max(max_colour_error, std::abs(a.r - b.r) + std::abs(a.g - b.g) + std::abs(a.b - b.b));
+  }
+  state.counters["pcl_points_out"] = reference.size();
+  state.counters["max_error_mm"] = max_error * 1000.0;
+  state.counters["max_colour_error"] = max_colour_error;
+
+  // Float rounding of the centroids, and one level per channel of the colours
+  if (out->size() != reference.size())
+  {
+    state.SkipWithError("voxel count differs from pcl::VoxelGrid");
+    g_output_mismatch = true;
+    return;
+  }
+  if (max_error > 1e-5 || max_colour_error > 3)
+  {
+    state.SkipWithError("voxels differ from pcl::VoxelGrid");
+    g_output_mismatch = true;
+    return;
+  }
+
+  for (auto _ : state)
+  {
+    pipeline.applyVX(scene.cloud, out);
+    benchmark::DoNotOptimize(out->points.data());
+  }
+  state.counters["points_out"] = out->size();
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_VoxelGrid)->Apply(CloudLeafSizesAndThreads)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_VoxelGridPcl(benchmark::State &state)
+{
+  /* The single threaded pcl::VoxelGrid applyVX used before, for comparison */
+
+  SyntheticScene scene = makeScene(state.range(0), 4, 0, 0);
+  pcl::VoxelGrid<PointT> grid;
+  float leaf_size = state.range(1) / 1000.0;
+  grid.setLeafSize(leaf_size, leaf_size, leaf_size);
+
+  PointCPtr out(new PointC);
+  for (auto _ : state)
+  {
+    grid.setInputCloud(scene.cloud);
+    grid.filter(*out);
+    benchmark::DoNotOptimize(out->points.data());
+  }
+  state.counters["points_out"] = out->size();
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_VoxelGridPcl)->Apply(CloudAndLeafSizes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_FloorFilter(benchmark::State &state)
+{
+  SyntheticScene scene = makeScene(state.range(0), 4, 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  double floor_z = floorDepth(scene);
+
+  PointCPtr out(new PointC);
+  for (auto _ : state)
+  {
+    pipeline.applyFF(scene.cloud, out, floor_z);
+    benchmark::DoNotOptimize(out->points.data());
+  }
+  state.counters["points_out"] = out->size();
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_FloorFilter)->Apply(CloudSizes)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_Normals(benchmark::State &state)
+{
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.applyFF(scene.cloud, pipeline.g_cloud_filtered, floorDepth(scene));
+
+  for (auto _ : state)
+  {
+    pipeline.findNormals(pipeline.g_cloud_filtered);
+    benchmark::DoNotOptimize(pipeline.g_cloud_normals->points.data());
+  }
+  state.SetItemsProcessed(state.iterations() * pipeline.g_cloud_filtered->size());
+}
+BENCHMARK(BM_Normals)->Apply(CloudAndClusterCounts)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_PlaneSegmentation(benchmark::State &state)
+{
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.applyFF(scene.cloud, pipeline.g_cloud_filtered, floorDepth(scene));
+  pipeline.findNormals(pipeline.g_cloud_filtered);
+
+  for (auto _ : state)
+  {
+    pipeline.segPlane(pipeline.g_cloud_filtered);
+    benchmark::DoNotOptimize(pipeline.g_cloud_filtered2->points.data());
+  }
+  state.SetItemsProcessed(state.iterations() * pipeline.g_cloud_filtered->size());
+}
+BENCHMARK(BM_PlaneSegmentation)->Apply(CloudAndClusterCounts)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_Clustering(benchmark::State &state)
+{
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.applyFF(scene.cloud, pipeline.g_cloud_filtered, floorDepth(scene));
+
+  for (auto _ : state)
+  {
+    pipeline.segClusters(pipeline.g_cloud_filtered);
+    benchmark::ClobberMemory();
+  }
+  state.counters["clusters"] = pipeline.g_arena.clusterCount();
+  state.SetItemsProcessed(state.iterations() * pipeline.g_cloud_filtered->size());
+}
+BENCHMARK(BM_Clustering)->Apply(CloudAndClusterCounts)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_ClusterStats(benchmark::State &state)
+{
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), 0, 0);
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.applyFF(scene.cloud, pipeline.g_cloud_filtered, floorDepth(scene));
+  pipeline.segClusters(pipeline.g_cloud_filtered);
+
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(processClusters(pipeline, scene));
+  }
+  state.counters["clusters"] = pipeline.g_arena.clusterCount();
+}
+BENCHMARK(BM_ClusterStats)->Apply(CloudAndClusterCounts)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_OccupancyIntegrate(benchmark::State &state)
+{
+  /* One cloud of a cluttered mat into an occupancy map already holding it,
+     the steady state of the task 3 scans, followed by the export of the
+     changed tiles */
+
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), 0, state.range(1));
+  PerceptionPipeline<PointT> pipeline;
+  pipeline.applyFF(scene.cloud, pipeline.g_cloud_filtered, floorDepth(scene));
+  Eigen::Isometry3f camera_to_world(scene.camera_to_world.matrix());
+
+  OccupancyMap map;
+  std::vector<moveit_msgs::CollisionObject> objects;
+  map.integrate(*pipeline.g_cloud_filtered, camera_to_world);
+  map.exportDirty("panda_link0", objects);
+
+  for (auto _ : state)
+  {
+    map.integrate(*pipeline.g_cloud_filtered, camera_to_world);
+    map.exportDirty("panda_link0", objects);
+  }
+  state.counters["occupied"] = map.occupiedCount();
+  state.SetItemsProcessed(state.iterations() * pipeline.g_cloud_filtered->size());
+}
+BENCHMARK(BM_OccupancyIntegrate)->Apply(CloudAndClusterCounts)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_FullPipelineConvert(benchmark::State &state)
+{
+  /* Everything the callback did for one frame before ingestion, converting
+     the whole message to PCL and filtering the floor afterwards */
+
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), state.range(2), 2);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+  double floor_z = floorDepth(scene);
+
+  PerceptionPipeline<PointT> pipeline;
+  pcl::PCLPointCloud2 pcl_pc;
+  PointCPtr cloud(new PointC);
+  int clusters = 0;
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    pcl_conversions::toPCL(msg, pcl_pc);
+    pcl::fromPCLPointCloud2(pcl_pc, *cloud);
+    pipeline.filterAndSegment(cloud, floor_z);
+    clusters = processClusters(pipeline, scene);
+  }
+  state.counters["clusters"] = clusters;
+  state.counters["allocs_per_frame"] = benchmark::Counter(g_allocations - allocations,
+                                                          benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_FullPipelineConvert)->Apply(PipelineCases)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_FullPipeline(benchmark::State &state)
+{
+  /* Everything the callback does for one frame, from the ROS message to the
+     per-cluster statistics */
+
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), state.range(2), 2);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+  double floor_z = floorDepth(scene);
+
+  PerceptionPipeline<PointT> pipeline;
+  int clusters = 0;
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    pipeline.ingest(msg, floor_z);
+    pipeline.segment();
+    clusters = processClusters(pipeline, scene);
+  }
+  state.counters["clusters"] = clusters;
+  state.counters["allocs_per_frame"] = benchmark::Counter(g_allocations - allocations,
+                                                          benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_FullPipeline)->Apply(PipelineCases)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_FullPipelineCompact(benchmark::State &state)
+{
+  /* As BM_FullPipeline on the 16 byte points, colours only read back for the
+     points of the clusters */
+
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), state.range(2), 2);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+  double floor_z = floorDepth(scene);
+
+  PerceptionPipeline<CompactPointT> pipeline;
+  int clusters = 0;
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    pipeline.ingest(msg, floor_z);
+    pipeline.segment();
+    clusters = processClusters(pipeline, scene);
+  }
+  state.counters["clusters"] = clusters;
+  state.counters["allocs_per_frame"] = benchmark::Counter(g_allocations - allocations,
+                                                          benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_FullPipelineCompact)->Apply(PipelineCases)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+static void
+BM_StackInspection(benchmark::State &state)
+{
+  /* What the callback does for one frame while a stack is inspected, the
+     cloud cropped to a box around the stack and no plane or clustering, to
+     compare with BM_FullPipeline on the same scene */
+
+  SyntheticScene scene = makeScene(state.range(0), state.range(1), state.range(2), 2);
+  sensor_msgs::PointCloud2 msg;
+  pcl::toROSMsg(*scene.cloud, msg);
+  double floor_z = floorDepth(scene);
+
+  const Eigen::Vector3f &base = scene.cubes[0].centre;
+  Eigen::AlignedBox3f world_roi(Eigen::Vector3f(base.x() - 0.06f, base.y() - 0.06f, 0.005f),
+                                Eigen::Vector3f(base.x() + 0.06f, base.y() + 0.06f, 0.04f * state.range(2) + 0.06f));
+  Eigen::Isometry3f camera_to_world(scene.camera_to_world.matrix());
+  Eigen::AlignedBox3f roi;
+  for (int corner = 0; corner < 8; corner++)
+    roi.extend(camera_to_world.inverse() * world_roi.corner(static_cast<Eigen::AlignedBox3f::CornerType>(corner)));
+
+  PerceptionPipeline<CompactPointT> pipeline;
+  pipeline.setRoi(roi);
+  int clusters = 0;
+  size_t allocations = g_allocations;
+  for (auto _ : state)
+  {
+    pipeline.ingest(msg, floor_z);
+    pipeline.segmentRoi(camera_to_world, world_roi);
+    clusters = processClusters(pipeline, scene);
+  }
+  state.counters["clusters"] = clusters;
+  state.counters["points_in_roi"] = pipeline.g_cloud_filtered->size();
+  state.counters["allocs_per_frame"] = benchmark::Counter(g_allocations - allocations,
+                                                          benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations() * scene.cloud->size());
+}
+BENCHMARK(BM_StackInspection)->Apply(PipelineCases)->Unit(benchmark::kMillisecond);
+
+////////////////////////////////////////////////////////////////////////////////
+int
+main(int argc, char **argv)
+{
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+
+  // A case reports a wrong output as an error, the run fails with it
+  return g_output_mismatch ? 1 : 0;
+}
@@ -0,0 +1,357 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* End-to-end throughput of task 2 and task 3 against the simulated robot.
+   Every trial spawns a random layout on the 5cm grid used by the world
+   spawner, runs the task service callback and checks the resulting stack.
+   Needs a ROS master for the node handle, but no Gazebo or move_group. */
+
+#include <cw3_team_2/cw3_team_2.h>
+#include <cw3_team_2/fake_robot.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+  /** \brief A randomised task and the stack it should produce */
+  struct TaskLayout
+  {
+    std::vector<SyntheticCube> cubes;
+    geometry_msgs::Point stack_point;
+    std::vector<int> expected_colours;
+  };
+
+  /** \brief Totals of all the trials of one task */
+  struct TaskResults
+  {
+    TaskResults() : trials(0), successes(0), cubes_expected(0), cubes_stacked(0),
+                    robot_time(0.0), perception_time(0.0) {}
+
+    int trials, successes;
+    int cubes_expected, cubes_stacked;
+    double robot_time, perception_time;
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////
+  SyntheticCube
+  makeCube(float x, float y, int layer, int colour, float yaw)
+  {
+    SyntheticCube cube;
+    cube.size = 0.04f;
+    cube.centre = Eigen::Vector3f(x, y, cube.size * (layer + 0.5f));
+    cube.yaw = yaw;
+    const uint8_t *rgb = (colour < 0) ? kObstacleColour : kCubeColours[colour];
+    cube.r = rgb[0];
+    cube.g = rgb[1];
+    cube.b = rgb[2];
+    return cube;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool
+  inScanArea(float x, float y, int task)
+  {
+    /* Task 2 only scans the front of the mat, task 3 the whole mat except
+       the area around the base of the robot */
+    if (task == 2)
+      return x >= 0.25f && x <= 0.75f && std::fabs(y) <= 0.4f;
+    bool base = std::fabs(y) < 0.2f && x >= -0.15f && x < 0.25f;
+    return x >= -0.65f && x <= 0.75f && std::fabs(y) <= 0.4f && not base;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  std::vector<Eigen::Vector2f>
+  pickGridSpots(std::mt19937 &rng, int task, int count)
+  {
+    /* Free spots on the 5cm grid, at least 10cm apart */
+    std::vector<Eigen::Vector2f> grid;
+    for (int i = -14; i <= 16; i++)
+      for (int j = -8; j <= 8; j++)
+        if (inScanArea(i * 0.05f, j * 0.05f, task))
+          grid.push_back(Eigen::Vector2f(i * 0.05f, j * 0.05f));
+    std::shuffle(grid.begin(), grid.end(), rng);
+
+    std::vector<Eigen::Vector2f> spots;
+    for (size_t i = 0; i < grid.size() && spots.size() < count; i++)
+    {
+      bool free = true;
+      for (size_t j = 0; j < spots.size() && free; j++)
+        free = (grid[i] - spots[j]).norm() > 0.099f;
+      if (free)
+        spots.push_back(grid[i]);
+    }
+    return spots;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  TaskLayout
+  randomLayout(std::mt19937 &rng, int task)
+  {
+    std::uniform_int_distribution<int> dist_colour(0, kNumCubeColours - 1);
+    std::uniform_int_distribution<int> dist_extra(0, 3);
+    std::uniform_int_distribution<int> dist_stack(2, 3);
+    std::uniform_real_distribution<float> dist_yaw(0.0f, M_PI / 2.0);
+
+    TaskLayout layout;
+    std::vector<int> colours;
+
+    if (task == 2)
+    {
+      // three cubes to stack, taken from the random cubes spawned
+      int num_cubes = 3 + dist_extra(rng);
+      for (int i = 0; i < num_cubes; i++)
+        colours.push_back(dist_colour(rng));
+      std::vector<int> order(num_cubes);
+      for (int i = 0; i < num_cubes; i++)
+        order[i] = i;
+      std::shuffle(order.begin(), order.end(), rng);
+      for (int i = 0; i < 3; i++)
+        layout.expected_colours.push_back(colours[order[i]]);
+    }
+    else
+    {
+      // a stack to copy, a matching cube for each layer, extra cubes and obstacles
+      int stack_height = dist_stack(rng);
+      for (int i = 0; i < stack_height; i++)
+        layout.expected_colours.push_back(dist_colour(rng));
+      colours = layout.expected_colours;
+      int extra = dist_extra(rng);
+      for (int i = 0; i < extra; i++)
+        colours.push_back(dist_colour(rng));
+      int obstacles = dist_extra(rng);
+      for (int i = 0; i < obstacles; i++)
+        colours.push_back(-1);
+    }
+
+    int num_spots = colours.size() + ((task == 3) ? 2 : 1);
+    std::vector<Eigen::Vector2f> spots = pickGridSpots(rng, task, num_spots);
+    if (spots.size() < num_spots)
+      return randomLayout(rng, task);
+
+    size_t spot = 0;
+    layout.stack_point.x = spots[spot].x();
+    layout.stack_point.y = spots[spot].y();
+    layout.stack_point.z = 0.0;
+    spot++;
+
+    if (task == 3)
+    {
+      for (size_t i = 0; i < layout.expected_colours.size(); i++)
+        layout.cubes.push_back(makeCube(spots[spot].x(), spots[spot].y(), i, layout.expected_colours[i], 0.0f));
+      spot++;
+    }
+
+    for (size_t i = 0; i < colours.size(); i++, spot++)
+      layout.cubes.push_back(makeCube(spots[spot].x(), spots[spot].y(), 0, colours[i], dist_yaw(rng)));
+
+    return layout;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  int
+  countStackedCubes(const FakeRobot &robot, const TaskLayout &layout)
+  {
+    /* Number of layers at the stack point holding a cube of the expected colour */
+    int stacked = 0;
+    for (size_t layer = 0; layer < layout.expected_colours.size(); layer++)
+    {
+      Eigen::Vector3f expected(layout.stack_point.x, layout.stack_point.y, 0.04f * (layer + 0.5f));
+      const uint8_t *rgb = kCubeColours[layout.expected_colours[layer]];
+      bool found = false;
+      for (size_t i = 0; i < robot.cubes().size() && not found; i++)
+      {
+        const SyntheticCube &cube = robot.cubes()[i];
+        found = (cube.centre - expected).norm() < 0.02f &&
+                cube.r == rgb[0] && cube.g == rgb[1] && cube.b == rgb[2];
+      }
+      if (not found)
+        break;
+      stacked++;
+    }
+    return stacked;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  double
+  percentile(std::vector<double> values, double p)
+  {
+    if (values.empty())
+      return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+    return values[index];
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  void
+  printResults(int task, const TaskResults &results)
+  {
+    double minutes = (results.robot_time + results.perception_time) / 60.0;
+    printf("Task %d: %d trials\n", task, results.trials);
+    printf("  task success rate:   %.1f %%\n", 100.0 * results.successes / std::max(1, results.trials));
+    printf("  task failure rate:   %.1f %%\n", 100.0 * (results.trials - results.successes) / std::max(1, results.trials));
+    printf("  cubes stacked:       %d / %d\n", results.cubes_stacked, results.cubes_expected);
+    printf("  robot time:          %.1f s (simulated)\n", results.robot_time);
+    printf("  perception time:     %.1f s (wall clock)\n", results.perception_time);
+    printf("  cubes per minute:    %.2f\n", (minutes > 0.0) ? results.cubes_stacked / minutes : 0.0);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int
+main(int argc, char **argv)
+{
+  ros::init(argc, argv, "cw3_team_2_task_throughput");
+  ros::NodeHandle nh("~");
+
+  ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn);
+  ros::console::notifyLoggerLevelsChanged();
+
+  // benchmark parameters
+  int trials, task, seed;
+  nh.param("trials", trials, 1000);
+  nh.param("task", task, 0); // 2 or 3, 0 runs both
+  nh.param("seed", seed, 1);
+
+  FakeRobotConfig config;
+  nh.param("linear_speed", config.linear_speed, config.linear_speed);
+  nh.param("angular_speed", config.angular_speed, config.angular_speed);
+  nh.param("settle_time", config.settle_time, config.settle_time);
+  nh.param("planning_time_median", config.planning_time_median, config.planning_time_median);
+  nh.param("planning_time_sigma", config.planning_time_sigma, config.planning_time_sigma);
+  nh.param("planning_failure_rate", config.planning_failure_rate, config.planning_failure_rate);
+  nh.param("camera_width", config.camera.width, config.camera.width);
+  nh.param("camera_height", config.camera.height, config.camera.height);
+  nh.param("noise_stddev", config.camera.noise_stddev, config.camera.noise_stddev);
+  config.seed = seed;
+
+  // Leave the port, the world snapshot and the log of a running node alone
+  nh.setParam("warm_up", false);
+  nh.setParam("metrics_port", 0);
+  nh.setParam("world_snapshot", std::string(""));
+  nh.setParam("record_log", std::string(""));
+
+  boost::shared_ptr<FakeRobot> robot(new FakeRobot(config));
+  Cw3Solution solution(nh, robot);
+  robot->setTransformer(&solution.g_listener_);
+  robot->setCloudCallback(boost::bind(&Cw3Solution::cloudCallBackOne, &solution, _1));
+
+  std::mt19937 rng(seed);
+  std::vector<int> tasks;
+  if (task == 0 || task == 2)
+    tasks.push_back(2);
+  if (task == 0 || task == 3)
+    tasks.push_back(3);
+
+  for (size_t t = 0; t < tasks.size() && ros::ok(); t++)
+  {
+    TaskResults results;
+    size_t first_plan = robot->planningTimes().size();
+    int first_failures = robot->planningFailures();
+    int first_requested = robot->requestedFrames();
+    uint64_t first_confirmed = solution.g_stacks_confirmed_metric->value();
+    uint64_t first_mismatched = solution.g_stacks_mismatched_metric->value();
+    uint64_t first_unseen = solution.g_stacks_unseen_metric->value();
+    uint64_t first_timeouts = solution.g_frame_timeouts_metric->value();
+
+    for (int trial = 0; trial < trials && ros::ok(); trial++)
+    {
+      TaskLayout layout = randomLayout(rng, tasks[t]);
+      robot->resetWorld(layout.cubes);
+
+      double robot_start = robot->elapsedTime();
+      double perception_start = robot->perceptionTime();
+      bool success = false;
+
+      if (tasks[t] == 2)
+      {
+        cw3_world_spawner::Task2Service::Request request;
+        cw3_world_spawner::Task2Service::Response response;
+        request.stack_point = layout.stack_point;
+        request.stack_rotation = 0.0;
+        for (size_t i = 0; i < layout.expected_colours.size(); i++)
+        {
+          std_msgs::ColorRGBA colour;
+          colour.r = kCubeColours[layout.expected_colours[i]][0] / 255.0;
+          colour.g = kCubeColours[layout.expected_colours[i]][1] / 255.0;
+          colour.b = kCubeColours[layout.expected_colours[i]][2] / 255.0;
+          colour.a = 1.0;
+          request.stack_colours.push_back(colour);
+        }
+        success = solution.task2Callback(request, response);
+      }
+      else
+      {
+        cw3_world_spawner::Task3Service::Request request;
+        cw3_world_spawner::Task3Service::Response response;
+        request.stack_point = layout.stack_point;
+        success = solution.task3Callback(request, response);
+      }
+
+      int stacked = countStackedCubes(*robot, layout);
+      results.trials++;
+      results.successes += (success && stacked == layout.expected_colours.size()) ? 1 : 0;
+      results.cubes_expected += layout.expected_colours.size();
+      results.cubes_stacked += stacked;
+      results.robot_time += robot->elapsedTime() - robot_start;
+      results.perception_time += robot->perceptionTime() - perception_start;
+    }
+
+    std::vector<double> planning_times(robot->planningTimes().begin() + first_plan,
+                                       robot->planningTimes().end());
+    int plans = planning_times.size();
+    int failures = robot->planningFailures() - first_failures;
+
+    printResults(tasks[t], results);
+    printf("  plans:               %d, %.2f %% failed\n", plans, 100.0 * failures / std::max(1, plans));
+    printf("  planning time p50:   %.3f s\n", percentile(planning_times, 0.50));
+    printf("  planning time p90:   %.3f s\n", percentile(planning_times, 0.90));
+    printf("  planning time p99:   %.3f s\n", percentile(planning_times, 0.99));
+    printf("  planning time max:   %.3f s\n", percentile(planning_times, 1.0));
+
+    // Stack checks see the stack without moving, from a cloud on request
+    printf("  stack checks:        %d confirmed, %d mismatched, %d not seen\n",
+           (int)(solution.g_stacks_confirmed_metric->value() - first_confirmed),
+           (int)(solution.g_stacks_mismatched_metric->value() - first_mismatched),
+           (int)(solution.g_stacks_unseen_metric->value() - first_unseen));
+    printf("  clouds on request:   %d, %d waits timed out\n",
+           robot->requestedFrames() - first_requested,
+           (int)(solution.g_frame_timeouts_metric->value() - first_timeouts));
+  }
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_CLOUD_INGEST_H_
+#define CW3_TEAM_2_CLOUD_INGEST_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/** \brief Point gathered straight from a PointCloud2 message, xyz and packed
+  * rgba in 16 bytes instead the 32 bytes of pcl::PointXYZRGBA. */
+struct CompactPoint
+{
+  float x, y, z;
+  uint32_t rgba;
+};
+
+/** \brief Byte offsets of the fields read from a PointCloud2 message. */
+struct CloudFieldOffsets
+{
+  /** \brief Find the offsets of x, y, z and rgb (or rgba) in a message.
+    *
+    * \input[in] msg the cloud message
+    *
+    * \return true if all the fields exist as 4 byte fields
+    */
+  bool
+  find (const sensor_msgs::PointCloud2 &msg);
+
+  uint32_t x, y, z, rgb;
+};
+
+/** \brief Gather the finite points of a cloud closer than a depth limit,
+  * reading the message buffer in place.
+  *
+  * Replaces the PointCloud2 -> PCLPointCloud2 -> PointCloud conversion, which
+  * copies every point of the frame twice before the floor is thrown away.
+  *
+  * \input[in] msg the cloud message, in the camera frame
+  * \input[in] max_depth points at or beyond this depth are dropped
+  * \input[out] out the gathered points, cleared first
+  * \input[in] roi if not NULL, points outside this camera frame box are dropped
+  *
+  * \return false if the message has no usable xyz and rgb fields, or its
+  * buffer is shorter than its fields, width and height say
+  */
+bool
+ingestCloud (const sensor_msgs::PointCloud2 &msg,
+             float max_depth,
+             std::vector<CompactPoint> &out,
+             const Eigen::AlignedBox3f *roi = NULL);
+
+/** \brief Expand compact points into a PCL cloud for the PCL stages.
+  *
+  * \input[in] in the compact points
+  * \input[out] out the PCL cloud, resized to match
+  */
+void
+compactToCloud (const std::vector<CompactPoint> &in,
+                pcl::PointCloud<pcl::PointXYZRGBA> &out);
+
+/** \brief Copy the xyz of compact points into a PCL cloud, the colours are
+  * read from the compact points when needed.
+  *
+  * \input[in] in the compact points
+  * \input[out] out the PCL cloud, resized to match
+  */
+void
+compactToCloud (const std::vector<CompactPoint> &in,
+                pcl::PointCloud<pcl::PointXYZ> &out);
+#endif
@@ -0,0 +1,170 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_COLOUR_TABLE_H_
+#define CW3_TEAM_2_COLOUR_TABLE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** \brief Colours told apart by the table: the cube colours of the world
+  * spawner and the black obstacles. */
+enum ColourClass
+{
+  COLOUR_UNKNOWN = 0,
+  COLOUR_RED,
+  COLOUR_BLUE,
+  COLOUR_PURPLE,
+  COLOUR_BLACK,
+  NUM_COLOUR_CLASSES
+};
+
+/** \brief Number of points of each colour class in a cluster. */
+struct ColourHistogram
+{
+  ColourHistogram() { clear(); }
+
+  void
+  clear ();
+
+  void
+  add (const ColourHistogram &other);
+
+  /** \brief Points of any class, unknown ones included */
+  int
+  total () const;
+
+  /** \brief Class holding most of the points, unknown ones not counted.
+    *
+    * \input[in] min_share share of the classified points the class must hold
+    *
+    * \return the class, COLOUR_UNKNOWN if no class holds min_share
+    */
+  int
+  majority (double min_share = 0.5) const;
+
+  int counts[NUM_COLOUR_CLASSES];
+};
+
+/** \brief A point of known colour class, used to calibrate the table. */
+struct ColourSample
+{
+  uint8_t r, g, b;
+  int colour_class;
+};
+
+/** \brief Quantised rgb to colour class lookup table.
+  *
+  * The rgb cube is cut into kBins^3 cells, each holding a class, so
+  * classifying a point is one load. Cells holding labelled samples take
+  * their class, the others that of the nearest labelled cell in CIE Lab,
+  * and cells far from all of them are left unknown. Until a calibration is
+  * loaded the samples are the spawner colours under a range of shading.
+  */
+class ColourTable
+{
+  public:
+
+    /** \brief Bits kept of each channel, and cells along each axis. */
+    static const int kBits = 5;
+    static const int kBins = 1 << kBits;
+
+    /** \brief  Class constructor, filled from the spawner colours. */
+    ColourTable();
+
+    /** \brief Fill the table from the spawner colours. */
+    void
+    useDefaults ();
+
+    /** \brief Fill the table from the means of labelled samples.
+      *
+      * \input[in] samples points of known class, unknown ones are ignored
+      * \input[in] max_distance Lab distance past which a cell is unknown
+      *
+      * \return false if some class has no sample, the table is unchanged then
+      */
+    bool
+    calibrate (const std::vector<ColourSample> &samples, double max_distance = 40.0);
+
+    /** \brief Read a table written by save.
+      *
+      * \input[in] path the binary table file
+      *
+      * \return false if the file is missing or not a table of this size
+      */
+    bool
+    load (const std::string &path);
+
+    /** \brief Write the table to a binary file. */
+    bool
+    save (const std::string &path) const;
+
+    /** \brief Class of a 0-255 colour. */
+    int
+    lookup (uint8_t r, uint8_t g, uint8_t b) const
+    {
+      return table_[cellOf(r, g, b)];
+    }
+
+    /** \brief Cell of a 0-255 colour. */
+    static int
+    cellOf (uint8_t r, uint8_t g, uint8_t b)
+    {
+      return ((r >> (8 - kBits)) << (2 * kBits)) | ((g >> (8 - kBits)) << kBits) | (b >> (8 - kBits));
+    }
+
+    /** \brief Class of a 0-1 colour, as in the task requests. */
+    int
+    classify (double r, double g, double b) const;
+
+    /** \brief Spawner colour of a class, 0-1 channels, black for unknown. */
+    static void
+    prototype (int colour_class, double &r, double &g, double &b);
+
+    /** \brief Name of a class, for the logs. */
+    static const char *
+    name (int colour_class);
+
+  private:
+
+    /** \brief Class of every cell, kBins^3 entries. */
+    std::vector<uint8_t> table_;
+};
+
+/** \brief Convert a 0-255 colour to CIE Lab, D65 white. */
+void
+rgbToLab (double r, double g, double b, double lab[3]);
+#endif
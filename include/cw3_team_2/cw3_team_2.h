@@ -40,8 +40,10 @@
 #include <ros/ros.h>
 #include <ros/time.h>
 #include <stdlib.h>
+#include <atomic>
 #include <cmath>
 #include <iostream>
+#include <limits>
 
 // ROS includes
 #include <std_msgs/String.h>
@@ -59,25 +61,13 @@
 
 // PCL specific includes
 #include <pcl_conversions/pcl_conversions.h>
-#include <pcl/common/centroid.h>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/filters/conditional_removal.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/features/normal_3d.h>
-#include <pcl/ModelCoefficients.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/search/kdtree.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_clusters.h>
 #include <pcl/conversions.h>
 #include <pcl_ros/point_cloud.h>
 #include <pcl/kdtree/kdtree.h>
 #include <pcl/visualization/cloud_viewer.h>
 #include <pcl/common/common.h>
+#include <pcl/common/transforms.h>
+#include <sensor_msgs/JointState.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/point_cloud_conversion.h>
 
@@ -87,21 +77,64 @@
 // TF specific includes
 #include <tf/transform_broadcaster.h>
 #include <tf/transform_listener.h>
+#include <tf_conversions/tf_eigen.h>
 
 // standard c++ library includes (std::string, std::vector)
 #include <string>
 #include <vector>
 
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
 // headers generated by catkin for the custom services we have made
 #include <cw3_world_spawner/Task1Service.h>
 #include <cw3_world_spawner/Task2Service.h>
 #include <cw3_world_spawner/Task3Service.h>
 #include <cw3_world_spawner/TaskSetup.h>
 
+// perception stages shared with the offline benchmarks
+#include <cw3_team_2/perception_pipeline.h>
+
+// drops clouds captured while the arm moves
+#include <cw3_team_2/frame_gate.h>
+
+// rviz topics, only filled while somebody subscribes
+#include <cw3_team_2/debug_output.h>
+
+// every cluster of a processed cloud, for nodes watching the cell
+#include <cw3_team_2/CubeDetectionArray.h>
+
+// averages the clusters of several clouds at one scan pose
+#include <cw3_team_2/scan_integrator.h>
+
+// obstacles seen by the camera, for the planning scene
+#include <cw3_team_2/occupancy_map.h>
+
+// cubes kept between stacking jobs
+#include <cw3_team_2/world_model.h>
+
+// arm, hand and planning scene operations, MoveIt or a simulated stand-in
+#include <cw3_team_2/robot_interface.h>
 
-typedef pcl::PointXYZRGBA PointT;
-typedef pcl::PointCloud<PointT> PointC;
-typedef PointC::Ptr PointCPtr;
+// throughput and latency counters, scraped over http
+#include <cw3_team_2/metrics.h>
+
+// inputs of the task runs, for record and replay
+#include <cw3_team_2/task_log.h>
+
+/** \brief What the finger joints tell of a closed grasp. */
+enum GraspState
+{
+  /** \brief The fingers closed on nothing */
+  GRASP_EMPTY,
+
+  /** \brief The fingers stopped on a cube */
+  GRASP_HOLDING,
+
+  /** \brief The finger state is not available */
+  GRASP_UNKNOWN
+};
 
 /** \brief Cw3 Solution.
   *
@@ -111,12 +144,21 @@ class Cw3Solution
 {
   public:
 
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
     /** \brief  Class constructor. 
       *
       * \input[in] nh ROS node handle
       */
     Cw3Solution(ros::NodeHandle& nh);
 
+    /** \brief  Class constructor using a given robot instead of MoveIt.
+      *
+      * \input[in] nh ROS node handle
+      * \input[in] robot arm, hand and planning scene to drive
+      */
+    Cw3Solution(ros::NodeHandle& nh, boost::shared_ptr<RobotInterface> robot);
+
 
     /** \brief Point Cloud CallBack function.
       * 
@@ -125,6 +167,124 @@ class Cw3Solution
     void
     cloudCallBackOne (const sensor_msgs::PointCloud2ConstPtr& cloud_input_msg);
 
+    /** \brief Perception of a cloud whose camera pose is in g_camera_to_world,
+      * shared by the callback and the replay.
+      *
+      * \input[in] cloud_input_msg the cloud
+      */
+    void
+    processCloud (const sensor_msgs::PointCloud2ConstPtr& cloud_input_msg);
+
+    /** \brief Cluster work of the point cloud callback, after segmentation.
+      *
+      * \input[in] pipeline the pipeline that segmented the frame
+      * \input[in] cloud_input_msg the cloud of the frame, kept for the task log
+      */
+    template <typename PointType> void
+    processFrame (PerceptionPipeline<PointType> &pipeline,
+                  const sensor_msgs::PointCloud2ConstPtr &cloud_input_msg);
+
+    /** \brief Joint state callback, feeds the arm motion to the frame gate.
+      *
+      * \input[in] msg a JointState sensor_msgs const pointer
+      */
+    void
+    jointStateCallback (const sensor_msgs::JointStateConstPtr& msg);
+
+    /** \brief Wait until a cloud captured after the last arm motion settled
+      * has been processed, asking the robot for one if none is pending.
+      *
+      * \input[in] timeout how long to wait, in seconds
+      * \input[in] record_frame log the last processed cloud when it arrives,
+      * false when the caller logs it through collectDetections
+      *
+      * \return false if no such cloud arrived in time
+      */
+    bool
+    waitForSettledFrame (double timeout, bool record_frame = true);
+
+    /** \brief Process the next cloud of g_task_replay in place of a wait.
+      *
+      * \return false if the recorded wait timed out or the replay diverged
+      */
+    bool
+    replayFrame ();
+
+    /** \brief Colour classes of the cubes a stacking request asks for.
+      *
+      * \input[in] request stack colours, as for task 2
+      * \input[out] classes colour class of each cube, bottom first
+      */
+    void
+    stackColourClasses (const cw3_world_spawner::Task2Service::Request &request,
+                        std::vector<int> &classes);
+
+    /** \brief Claim the cubes of a stacking job as it is queued.
+      *
+      * \input[in] job_id id of the job
+      * \input[in] request stack position, rotation and colours, as for task 2
+      *
+      * \return false if the world model holds a scan without enough free
+      * cubes of the colours asked for
+      */
+    bool
+    claimStackJob (int job_id, const cw3_world_spawner::Task2Service::Request &request);
+
+    /** \brief Stack cubes like task 2, reusing the cubes of the world model
+      * when the front mat has not changed since the last scan. Run with the
+      * task lock held, see beginTask.
+      *
+      * \input[in] job_id id of the job, holds the reserved cubes
+      * \input[in] request stack position, rotation and colours, as for task 2
+      *
+      * \return true if every cube was stacked
+      */
+    bool
+    runStackJob (int job_id, const cw3_world_spawner::Task2Service::Request &request);
+
+    /** \brief Compare one cloud of the front mat with the world model.
+      *
+      * \return true if the cubes the camera sees are where the model has them
+      */
+    bool
+    sceneUnchanged ();
+
+    /** \brief Write the world model to the snapshot file, if there is one,
+      * after every change so a restarted node can reuse it. */
+    void
+    saveWorldSnapshot ();
+
+    /** \brief Scan the front mat and find the cubes, their orientation and colour.
+      *
+      * \return false if the task was cancelled during the scan
+      */
+    bool
+    scanFrontMatCubes ();
+
+    /** \brief Check if a task is running, started by a service or an action. */
+    bool
+    taskRunning ();
+
+    /** \brief Stop the running task before its next arm or gripper motion. */
+    void
+    cancelTask ();
+
+    /** \brief Take the task lock for a new task and reset its progress.
+      *
+      * \input[out] task_lock lock held for the duration of the task
+      *
+      * \return false if another task is running
+      */
+    bool
+    beginTask (boost::unique_lock<boost::mutex> &task_lock);
+
+    /** \brief Report the phase of the running task to g_progress_callback.
+      *
+      * \input[in] phase short name of the current phase
+      */
+    void
+    reportProgress (const std::string &phase);
+
     /** \brief Service callback function for entire task 1 
       *
       * used for picking and placing at given position 
@@ -165,34 +325,147 @@ class Cw3Solution
       cw3_world_spawner::Task3Service::Response &response);
 
 
+    /** \brief Run task 1 with the task lock held, see task1Callback. */
+    bool
+    runTask1(cw3_world_spawner::Task1Service::Request &request,
+             cw3_world_spawner::Task1Service::Response &response);
+
+    /** \brief Run task 2 with the task lock held, see task2Callback. */
+    bool
+    runTask2(cw3_world_spawner::Task2Service::Request &request,
+             cw3_world_spawner::Task2Service::Response &response);
+
+    /** \brief Run task 3 with the task lock held, see task3Callback. */
+    bool
+    runTask3(cw3_world_spawner::Task3Service::Request &request,
+             cw3_world_spawner::Task3Service::Response &response);
+
     /** \brief Clearing the lists that store centroids and other information of any previous detected clusters from global variables.
       *
       * ...
       */
     void
     clearPreviousScanData();
+
+    /** \brief Zero the colour sums and histograms of the cubes of the recorded stack. */
+    void
+    resetStackColours();
+
+    /** \brief Average the stack colours and find the colour class of each cube.
+      *
+      * \input[out] stack_classes colour class of each cube, bottom first
+      */
+    void
+    finishStackColours(std::vector<int> &stack_classes);
     
     /** \brief function to scan the entire mat. Used in Task 3
       *
       * ...
+      *
+      * \return false if a scan pose gave no settled cloud or the task was cancelled
       */
-    void
+    bool
     scanEntireMat();
 
     /** \brief function to scan the front of the mat. Used in Task 1 and 2
       *
       * ...
+      *
+      * \return false if a scan pose gave no settled cloud or the task was cancelled
       */
-    void
+    bool
     scanFrontMat();
 
     /** \brief function to find and store centroid found during scanning
       *
       * ...
+      *
+      * \return false if a scan pose gave no settled cloud or the task was cancelled
       */
-    void
+    bool
     findCentroidsAtScanLocation();
 
+    /** \brief Send the tiles of the occupancy map changed since the last
+      * call to the planning scene. */
+    void
+    updateOccupancyScene();
+
+    /** \brief Plan in the background to the scan poses of the front mat and
+      * to a pick above it, so the first task does not wait for the planners
+      * to load. */
+    void
+    warmUpPlanners();
+
+    /** \brief Integrate the next settled cloud into the occupancy map and
+      * update the planning scene, used after the arm moves to a new view. */
+    void
+    observeOccupancy();
+
+    /** \brief Check the stack from the current view with one cloud cropped
+      * around it, instead of trusting the count of cubes placed.
+      *
+      * \input[in] base the stack position, z is ignored
+      * \input[in] expected_cubes number of cubes that should be on the stack
+      * \input[in] expected_class colour class of the top cube
+      * \input[out] observed_cubes number of cubes seen, -1 if the stack was not seen
+      *
+      * \return true if the height and the top colour match
+      */
+    bool
+    verifyStack(const geometry_msgs::Point &base,
+                int expected_cubes,
+                int expected_class,
+                int &observed_cubes);
+
+    /** \brief Process one cloud cropped around a point and keep the cluster
+      * found at it, shared by the stack check and the re-grasp.
+      *
+      * \input[in] base the point to look at, z is ignored
+      * \input[in] layers number of cube layers expected at the point
+      * \input[out] got_frame if not NULL, whether a settled cloud was processed
+      *
+      * \return true if a cluster was seen at the point, its statistics are
+      * left in g_verify_stats and its centroid in g_verify_centroid
+      */
+    bool
+    observeAt(const geometry_msgs::Point &base, int layers, bool *got_frame = NULL);
+
+    /** \brief Crop the processed clouds to a box around a stack and take
+      * what is left as its cluster, skipping the plane segmentation and the
+      * clustering of the whole frame, until endInspection is called.
+      *
+      * \input[in] base the stack position, z is ignored
+      * \input[in] layers number of cube layers expected on the stack
+      */
+    void
+    beginInspection(const geometry_msgs::Point &base, int layers);
+
+    /** \brief Process whole clouds again. */
+    void
+    endInspection();
+
+    /** \brief Check from the finger joints that the closed gripper holds a cube.
+      *
+      * \return GRASP_UNKNOWN if the finger state is not available
+      */
+    GraspState
+    graspState();
+
+    /** \brief Copy the clusters of the last processed cloud, and log that
+      * cloud when recording.
+      *
+      * \input[out] detections one entry per cluster
+      * \input[out] world_to_camera if not NULL, the camera pose of that cloud
+      */
+    void
+    collectDetections(std::vector<ScanDetection> &detections,
+                      Eigen::Isometry3f *world_to_camera = NULL);
+
+    /** \brief Log the last processed cloud when recording, g_frame_mutex
+      * must be held. */
+    void
+    recordFrameLocked();
+
       
       /** \brief function to pick and place cube at particular centroid location
       *
@@ -253,11 +526,12 @@ class Cw3Solution
     /** \brief MoveIt function for moving the move_group to the target position.
       *
       * \input[in] target_pose pose to move the arm to
+      * \input[in] type kind of the motion, picks the planners used
       *
       * \return true if moved to target position 
       */
     bool 
-    moveArm(geometry_msgs::Pose target_pose);
+    moveArm(geometry_msgs::Pose target_pose, MotionType type = MOTION_TRANSFER);
 
     /** \brief MoveIt function for moving the gripper fingers to a new position. 
       *
@@ -299,19 +573,70 @@ class Cw3Solution
     void 
     removeCollisionObject(std::string object_name);
 
+    /** \brief End effector pose grasping from above.
+      *
+      * \input[in] position the xyz coordinates where the gripper converges
+      * \input[in] offset yaw of the cube, or of the stack to place on
+      *
+      * \return the pose, z raised by z_offset_
+      */
+    geometry_msgs::Pose
+    topDownPose(const geometry_msgs::Point &position, double offset);
+
+    /** \brief Choose among the four symmetric yaws of a cube the grasp and
+      * place yaws needing the least arm motion, within the joint limits.
+      *
+      * \input[in] pick_position where the gripper converges to pick
+      * \input[in] place_position where the gripper converges to place
+      * \input[in,out] pick_offset measured cube yaw, replaced by the chosen one
+      * \input[in,out] place_offset stack yaw, replaced by the chosen one
+      *
+      * \return false if no pair is reachable, the offsets are left unchanged
+      */
+    bool
+    chooseGraspYaws(const geometry_msgs::Point &pick_position,
+                    const geometry_msgs::Point &place_position,
+                    double &pick_offset,
+                    double &place_offset);
+
+    /** \brief Joint space distance between two arm states, the wrist
+      * weighted by an extra g_wrist_weight.
+      *
+      * \input[in] from joint positions at the start
+      * \input[in] to joint positions at the end
+      */
+    double
+    jointTravel(const std::vector<double> &from, const std::vector<double> &to);
+
     /** \brief Pick an object up with a given position.
       * 
       * \input[in] position the xyz coordinates where the gripper converges
+      * \input[in] retreat false to stay at the grasp, the retreat pose is then
+      * left in g_pick_retreat_pose for the next motion to pass through
       */
     bool
-    pick(geometry_msgs::Point position);
+    pick(geometry_msgs::Point position, bool retreat = true);
 
     /** \brief Place an object up with a given position.
       * 
       * \input[in] position the xyz coordinates where the gripper converges
+      * \input[in] lead_in poses passed on the way to the place approach pose
+      */
+    bool
+    place(geometry_msgs::Point position,
+          const std::vector<geometry_msgs::Pose> &lead_in = std::vector<geometry_msgs::Pose>());
+
+    /** \brief Move the arm through several poses without stopping at the
+      * intermediate ones, or one pose at a time if blending is off.
+      *
+      * \input[in] waypoints poses to pass, the arm stops at the last one
+      * \input[in] types kind of the motion to each pose
+      *
+      * \return true if moved to the last pose
       */
     bool
-    place(geometry_msgs::Point position);
+    moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                   const std::vector<MotionType> &types);
 
     /** \brief Function to pick and place all the cubes to create a stack.
       * 
@@ -320,87 +645,31 @@ class Cw3Solution
     bool
     pickAndPlaceIndexedCubes();
     
-    /** \brief Apply Voxel Grid filtering.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      * \input[out] out_cloud_ptr the output PointCloud2 pointer
-      */
-    void
-    applyVX (PointCPtr &in_cloud_ptr,
-             PointCPtr &out_cloud_ptr);
-
-    /** \brief Apply Pass Through filtering.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      * \input[out] out_cloud_ptr the output PointCloud2 pointer
-      */
-    void
-    applyPT (PointCPtr &in_cloud_ptr,
-             PointCPtr &out_cloud_ptr);
-
-
-    /** \brief Apply Floor filtering.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      * \input[out] out_cloud_ptr the output PointCloud2 pointer
-      */
-    void
-    applyFF (PointCPtr &in_cloud_ptr,
-             PointCPtr &out_cloud_ptr);
-    
-    
-    /** \brief Normal estimation.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      */
-    void
-    findNormals (PointCPtr &in_cloud_ptr);
-    
-    /** \brief Segment Plane from point cloud.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      */
-    void
-    segPlane (PointCPtr &in_cloud_ptr);
-
-    
-    /** \brief Extract inliers from input point cloud.
-      * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+    /** \brief Look up the camera pose at the stamp of a cloud, once per frame.
+      *
+      * Every stage of the frame uses this snapshot instead of asking TF again,
+      * so a cloud taken while the arm moves is placed where it was captured.
+      *
+      * \input[in] header header of the input cloud
+      *
+      * \return false if the cloud is stale or its transform did not arrive in time
       */
-    void
-    extractInlier (PointCPtr &in_cloud_ptr);
+    bool
+    snapshotCameraTransform (const std_msgs::Header &header);
 
-    /** \brief Segment clusters from point cloud.
+    /** \brief Find the depth of the floor cut-off used by the floor filter.
       * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      * \return z of a point 3cm above the world origin in the camera frame
       */
-    void
-    segClusters (PointCPtr &in_cloud_ptr);
+    double
+    findFloorDepth ();
 
     /** \brief Find the Pose of Cube.
       * 
-      * \input[in] in_cloud_ptr the input PointCloud2 pointer
-      */
-    geometry_msgs::PointStamped
-    findCubePose (PointCPtr &in_cloud_ptr); //set return here
-    
-    /** \brief Point Cloud publisher.
-      * 
-      *  \input pc_pub ROS publisher
-      *  \input pc point cloud to be published
-      */
-    void
-    pubFilteredPCMsg (ros::Publisher &pc_pub, PointC &pc);
-    
-    /** \brief Publish the cube point.
-      * 
-      *  \input[in] cube_pt_msg Cube's geometry point
-      *  
-      *  \output true if three numbers are added
+      * \input[in] in_cloud the input point cloud, of either point layout
       */
-    void
-    publishPose (geometry_msgs::PointStamped &cube_pt_msg);
+    template <typename PointType> geometry_msgs::PointStamped
+    findCubePose (const pcl::PointCloud<PointType> &in_cloud); //set return here
 
 
 
@@ -429,28 +698,168 @@ class Cw3Solution
     ros::ServiceServer task3_srv_;
 
 
-    /** \brief MoveIt interface to move groups to seperate the arm and the gripper,
-      * these are defined in urdf. */
-    moveit::planning_interface::MoveGroupInterface arm_group_{"panda_arm"};
-    moveit::planning_interface::MoveGroupInterface hand_group_{"hand"};
-
-    /** \brief MoveIt interface to interact with the moveit planning scene 
-      * (eg collision objects). */
-    moveit::planning_interface::PlanningSceneInterface planning_scene_interface_;
+    /** \brief Arm, hand and planning scene used to execute the tasks, MoveIt
+      * unless a stand-in is given to the constructor. */
+    boost::shared_ptr<RobotInterface> robot_;
 
 
     /** \brief The input point cloud frame id. */
     std::string g_input_pc_frame_id_;
 
-    /** \brief ROS publishers. */
-    ros::Publisher g_pub_cloud;
+    /** \brief Camera pose in the world frame when the current cloud was taken,
+      * and its inverse, see snapshotCameraTransform. */
+    Eigen::Isometry3f g_camera_to_world, g_world_to_camera;
+
+    /** \brief Stamp of the current cloud. */
+    ros::Time g_camera_stamp;
+
+    /** \brief How long to wait for the transform of a cloud, in seconds. */
+    double g_tf_timeout;
+
+    /** \brief Clouds older than this are dropped, in seconds. */
+    double g_max_cloud_age;
+
+    /** \brief Filtered cloud and cube centroids for rviz. */
+    DebugOutput g_debug;
+
+    /** \brief Log of the inputs of the tasks, ~record_log, NULL when not recording. */
+    boost::shared_ptr<TaskLogWriter> g_task_recorder;
+
+    /** \brief Recorded run the tasks take their clouds from instead of the
+      * camera, NULL outside cw3_team_2_task_replay. */
+    boost::shared_ptr<TaskLogReader> g_task_replay;
+
+    /** \brief Serves the metrics on ~metrics_port, NULL when it is 0. */
+    boost::scoped_ptr<MetricsServer> g_metrics_server;
+
+    /** \brief Clouds processed, and clouds dropped before the arm settled,
+      * too old or without a camera transform, and without xyz and rgb. */
+    MetricCounter *g_frames_processed_metric;
+    MetricCounter *g_frames_unsettled_metric, *g_frames_stale_metric;
+    MetricCounter *g_frames_transform_metric, *g_frames_format_metric;
+
+    /** \brief Time of each perception stage of a cloud, and of a planning
+      * scene update. */
+    MetricHistogram *g_ingest_metric, *g_segment_metric, *g_clusters_metric;
+    MetricHistogram *g_scene_update_metric;
+
+    /** \brief Picks started, picks holding a cube and cubes stacked. */
+    MetricCounter *g_picks_attempted_metric, *g_picks_succeeded_metric;
+    MetricCounter *g_cubes_placed_metric;
+
+    /** \brief Stacks the camera confirmed, found different and did not see,
+      * and waits for a settled cloud that timed out. */
+    MetricCounter *g_stacks_confirmed_metric, *g_stacks_mismatched_metric;
+    MetricCounter *g_stacks_unseen_metric, *g_frame_timeouts_metric;
+
+    /** \brief Cubes stacked per minute by the current or last stacking run. */
+    MetricGauge *g_cubes_per_minute_metric;
+
+    /** \brief Publisher of the clusters of each processed cloud, as one message. */
+    ros::Publisher g_pub_detections;
 
     /** \brief ROS subscribers. */
-    ros::Subscriber g_sub_cloud;
-    
-    /** \brief ROS geometry message point. */
-    geometry_msgs::PointStamped g_cube_pt_msg;
+    ros::Subscriber g_sub_cloud, g_sub_joint_states;
+
+    /** \brief Rejects clouds captured before or during an arm motion. */
+    FrameGate g_frame_gate;
+
+    /** \brief Number of clouds processed, and the count when the arm last
+      * started moving or a scan last used a cloud. */
+    std::atomic<unsigned long> g_processed_frames, g_consumed_frames;
+
+    /** \brief How long a scan waits for a settled cloud, in seconds. */
+    double g_settled_frame_timeout;
+
+    /** \brief Most clouds averaged at each scan pose, ~scan_frames parameter. */
+    int g_scan_frames;
+
+    /** \brief Merges the clusters of the clouds taken at one scan pose. */
+    ScanIntegrator g_scan_integrator;
+
+    /** \brief Clusters of one cloud, then the merged clusters of a scan pose. */
+    std::vector<ScanDetection> g_frame_detections;
+
+    /** \brief Held while the clusters of a cloud are written or copied, with
+      * g_frame_world_to_camera, the camera pose they were seen from, and the
+      * cloud itself and its camera pose when recording. */
+    boost::mutex g_frame_mutex;
+    Eigen::Isometry3f g_frame_world_to_camera;
+    sensor_msgs::PointCloud2ConstPtr g_frame_cloud;
+    Eigen::Isometry3f g_frame_camera_to_world;
+
+    /** \brief Obstacles seen during task 3, replaces the hand-built boxes. */
+    OccupancyMap g_occupancy;
+
+    /** \brief True while processed clouds are integrated into g_occupancy,
+      * only when the gripper holds nothing the camera could see. */
+    std::atomic<bool> g_occupancy_integrating;
+
+    /** \brief True while g_occupancy feeds the planning scene. */
+    bool g_occupancy_active;
+
+    /** \brief True while processed clouds are cropped to a stack being inspected. */
+    std::atomic<bool> g_inspect_active;
+
+    /** \brief World frame box of the stack being inspected, set by the task
+      * thread and copied by the cloud callback under g_inspect_mutex. */
+    Eigen::AlignedBox3f g_inspect_roi;
+    boost::mutex g_inspect_mutex;
+
+    /** \brief True while the cluster of a stack being verified is recorded. */
+    std::atomic<bool> g_verify_active;
+
+    /** \brief Stack being verified and its number of layers. */
+    geometry_msgs::Point g_verify_point;
+    int g_verify_layers;
+
+    /** \brief Statistics of the stack cluster seen by the last verification cloud. */
+    ClusterStats g_verify_stats;
+    geometry_msgs::Point g_verify_centroid;
+    bool g_verify_found;
+
+    /** \brief Cubes of the front mat shared by the queued stacking jobs. */
+    WorldModel g_world_model;
+
+    /** \brief Seconds after which the world model is scanned again anyway. */
+    double g_world_model_max_age;
+
+    /** \brief File the world model is kept in across restarts, empty for none. */
+    std::string g_world_snapshot;
+
+    /** \brief Held while a task runs, tasks never run concurrently. */
+    boost::mutex g_task_mutex;
+
+    /** \brief Set to stop the running task, checked before every motion. */
+    std::atomic<bool> g_cancel_requested;
+
+    /** \brief Cubes stacked so far by the running task. */
+    std::atomic<int> g_cubes_placed;
+
+    /** \brief Receives the phase of the running task, set by the action servers. */
+    boost::function<void (const std::string &)> g_progress_callback;
+
+    /** \brief Join the pick retreat, transfer and place approach into one
+      * motion, ~blend_motions. */
+    bool g_blend_motions;
 
+    /** \brief Extra weight of the wrist rotation when choosing grasp yaws. */
+    double g_wrist_weight;
+
+    /** \brief Retreat pose of the last pick made without retreating. */
+    geometry_msgs::Pose g_pick_retreat_pose;
+
+    /** \brief Finger width under which a closed grasp is empty, and the finger
+      * effort a holding grasp needs, ~grasp_min_effort, 0 to ignore effort. */
+    double g_grasp_min_width;
+    double g_grasp_min_effort;
+
+    /** \brief Local re-grasps tried after an empty grasp before a pick fails. */
+    int g_max_regrasps;
+
+    /** \brief Collision objects of the changed occupancy map tiles. */
+    std::vector<moveit_msgs::CollisionObject> g_occupancy_objects;
+    
     /** \brief Current centroid found */
     geometry_msgs::PointStamped g_current_centroid;
 
@@ -501,32 +910,19 @@ class Cw3Solution
     /** \brief Stores the total number of pixels for colours found for all the scanned cubes in the stack */
     std::vector<int> g_current_stack_cube_color_count;
 
-    /** \brief ROS pose publishers. */
-    ros::Publisher g_pub_pose;
-    
-    /** \brief Voxel Grid filter's leaf size. */
-    double g_vg_leaf_sz;
-    
-    /** \brief Point Cloud (input) pointer. */
-    PointCPtr g_cloud_ptr;
-    
-    /** \brief Point Cloud (filtered) pointer. */
-    PointCPtr g_cloud_filtered, g_cloud_filtered2;
-    
-    /** \brief Point cloud to hold plane and cylinder points. */
-    PointCPtr g_cloud_plane;
-    
-    /** \brief Point Cloud (filtered) sensros_msg for publ. */
-    sensor_msgs::PointCloud2 g_cloud_filtered_msg;
-    
-    /** \brief Point Cloud (input). */
-    pcl::PCLPointCloud2 g_pcl_pc;
-    
-    /** \brief Voxel Grid filter. */
-    pcl::VoxelGrid<PointT> g_vx;
-    
-    /** \brief Pass Through filter. */
-    pcl::PassThrough<PointT> g_pt;
+    /** \brief Colour classes of the pixels of each scanned cube in the stack */
+    std::vector<ColourHistogram> g_current_stack_hists;
+
+    /** \brief Colour classes of the pixels of all cubes found in the current cloud */
+    std::vector<ColourHistogram> g_colour_hists;
+
+    /** \brief Filtering and segmentation stages of the point cloud callback. */
+    PerceptionPipelineBase *g_perception;
+
+    /** \brief The two point layouts of the pipeline, only the one picked by
+      * the compact_points parameter is created. */
+    boost::shared_ptr<PerceptionPipeline<PointT> > g_perception_full;
+    boost::shared_ptr<PerceptionPipeline<CompactPointT> > g_perception_compact;
     
     /** \brief  Min and Max y threshold sizes. */
     double g_y_thrs_min, g_y_thrs_max;
@@ -534,52 +930,9 @@ class Cw3Solution
     /** \brief Min and Max x threshold sizes. */
     double g_x_thrs_min, g_x_thrs_max;
     
-    /** \brief Color filter. */
-    pcl::ConditionalRemoval<PointT> g_cf;
-    
-    /** \brief Floor Filtering. */
-    pcl::ConditionalRemoval<PointT> g_ff;
-
-    /** \brief Color filter rgb filter values. */
-    double g_cf_red, g_cf_green, g_cf_blue;
-    
-    /** \brief KDTree for nearest neighborhood search. */
-    pcl::search::KdTree<PointT>::Ptr g_tree_ptr;
-    
-    /** \brief Normal estimation. */
-    pcl::NormalEstimation<PointT, pcl::Normal> g_ne;
-    
-    /** \brief Cloud of normals. */
-    pcl::PointCloud<pcl::Normal>::Ptr g_cloud_normals, g_cloud_normals2;
-    
-    /** \brief Nearest neighborhooh size for normal estimation. */
-    double g_k_nn;
-    
-    /** \brief SAC segmentation. */
-    pcl::SACSegmentationFromNormals<PointT, pcl::Normal> g_seg; 
-    
-    /** \brief Euclidean Cluster Extraction. */
-    pcl::EuclideanClusterExtraction<PointT> g_ec;
-    
-    /** \brief Extract point cloud indices. */
-    pcl::ExtractIndices<PointT> g_extract_pc;
-  
-    /** \brief Extract point cloud normal indices. */
-    pcl::ExtractIndices<pcl::Normal> g_extract_normals;
-    
-    /** \brief Point indices for plane. */
-    pcl::PointIndices::Ptr g_inliers_plane;
-      
-    
-    /** \brief Model coefficients for the plane segmentation. */
-    pcl::ModelCoefficients::Ptr g_coeff_plane;
-    
     /** \brief cw3Q1: TF listener definition. */
     tf::TransformListener g_listener_;
     
-    /** \brief Stores indices of point cloud for each cluster */
-    std::vector<pcl::PointIndices> g_cluster_indices;
-    
     /** \brief Stores all centroids found for the requested scan */
     std::vector<geometry_msgs::PointStamped> centroids;
 
@@ -599,6 +952,9 @@ class Cw3Solution
     /** \brief Stores the total number of pixels for colours found for all the scanned cubes */
     std::vector<int> colors_count;
 
+    /** \brief Stores the colour class held by most pixels of each scanned cube */
+    std::vector<int> colour_classes;
+
 
     /** \brief Stores the temperory rgba values of the cubes */
     std_msgs::ColorRGBA g_Color;
@@ -0,0 +1,117 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_DEBUG_OUTPUT_H_
+#define CW3_TEAM_2_DEBUG_OUTPUT_H_
+
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/PointStamped.h>
+#include <pcl/point_cloud.h>
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+/** \brief Debug topics of the point cloud callback, for rviz.
+  *
+  * Nothing is computed for a topic nobody subscribes to, and each topic is
+  * published at most at a fixed rate whatever the rate of the camera. The
+  * filtered cloud is decimated by a voxel grid before it is sent, and the
+  * cube centroids of a frame go out as one pose array.
+  */
+class DebugOutput
+{
+  public:
+
+    /** \brief  Class constructor, publishes nothing until advertise is called. */
+    DebugOutput();
+
+    /** \brief Advertise the debug topics.
+      *
+      * \input[in] nh node handle of the topics
+      * \input[in] rate highest publish rate of each topic, Hz
+      * \input[in] leaf_size voxel edge length of the published cloud, m, 0 sends every point
+      */
+    void
+    advertise (ros::NodeHandle &nh, double rate, double leaf_size);
+
+    /** \brief Check if the filtered cloud should be published for this frame,
+      * the next one is due a period later if so. */
+    bool
+    cloudDue ();
+
+    /** \brief Check if the centroids should be published for this frame,
+      * the next ones are due a period later if so. */
+    bool
+    detectionsDue ();
+
+    /** \brief Publish a decimated copy of a cloud.
+      *
+      * \input[in] cloud the filtered cloud, of either point layout
+      * \input[in] frame_id frame of the cloud
+      * \input[in] stamp capture time of the cloud
+      */
+    template <typename PointType> void
+    publishCloud (const pcl::PointCloud<PointType> &cloud,
+                  const std::string &frame_id,
+                  const ros::Time &stamp);
+
+    /** \brief Publish the cube centroids of a frame as one pose array.
+      *
+      * \input[in] centroids the centroids, all in the same frame
+      */
+    void
+    publishDetections (const std::vector<geometry_msgs::PointStamped> &centroids);
+
+  private:
+
+    /** \brief A topic is due if it has subscribers and its period has passed. */
+    bool
+    due (const ros::Publisher &pub, ros::WallTime &last);
+
+    ros::Publisher cloud_pub_, detections_pub_;
+
+    /** \brief Shortest time between two messages of a topic. */
+    ros::WallDuration period_;
+
+    /** \brief Last publish time of each topic. */
+    ros::WallTime last_cloud_, last_detections_;
+
+    double leaf_size_;
+
+    /** \brief Cloud message, reused between publishes. */
+    sensor_msgs::PointCloud2 cloud_msg_;
+};
+#endif
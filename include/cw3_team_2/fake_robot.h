@@ -0,0 +1,238 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_FAKE_ROBOT_H_
+#define CW3_TEAM_2_FAKE_ROBOT_H_
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <Eigen/Geometry>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/transformer.h>
+
+#include <cw3_team_2/robot_interface.h>
+#include <cw3_team_2/synthetic_scene.h>
+
+/** \brief Speeds, planner model and camera of the simulated robot. */
+struct FakeRobotConfig
+{
+  FakeRobotConfig();
+
+  /** \brief Cartesian and angular speed of the end effector */
+  double linear_speed, angular_speed;
+
+  /** \brief Speed of the gripper fingers, in metres of width per second */
+  double gripper_speed;
+
+  /** \brief Time spent at rest after every motion */
+  double settle_time;
+
+  /** \brief Log-normal planning time model, median in seconds and shape */
+  double planning_time_median, planning_time_sigma;
+
+  /** \brief Probability of a planning request failing */
+  double planning_failure_rate;
+
+  /** \brief Distance from the end effector pose to the centre of the fingers */
+  double finger_offset;
+
+  /** \brief Max distance of a cube from the finger centre for a grasp to hold */
+  double grasp_tolerance;
+
+  /** \brief Offset of the camera optical frame from the end effector */
+  Eigen::Vector3f camera_offset;
+
+  /** \brief Resolution, field of view and noise of the rendered clouds */
+  SyntheticSceneConfig camera;
+
+  /** \brief Seed of the planner model */
+  unsigned int seed;
+};
+
+/** \brief Kinematic-only stand-in for the Panda, its hand and the R200.
+  *
+  * Motions take no planning or dynamics, only simulated time worked out from
+  * the configured speeds. Cubes within reach of the fingers are carried, and
+  * after every arm motion, or when a cloud is requested, the camera renders
+  * the cubes on the mat and hands the cloud and its transform to the
+  * perception callback.
+  */
+class FakeRobot : public RobotInterface
+{
+  public:
+
+    typedef boost::function<void (const sensor_msgs::PointCloud2ConstPtr &)> CloudCallback;
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] config speeds, planner model and camera of the robot
+      */
+    FakeRobot(const FakeRobotConfig &config);
+
+    bool
+    moveArm (const geometry_msgs::Pose &target_pose, MotionType type = MOTION_TRANSFER);
+
+    bool
+    moveArmThrough (const std::vector<geometry_msgs::Pose> &waypoints,
+                    const std::vector<MotionType> &types);
+
+    bool
+    currentArmJoints (std::vector<double> &joints);
+
+    bool
+    solveArmIK (const geometry_msgs::Pose &pose,
+                const std::vector<double> &seed,
+                std::vector<double> &joints);
+
+    bool
+    moveGripper (double width, const std::string &object_name);
+
+    bool
+    fingerState (double &width, double &effort);
+
+    void
+    applyCollisionObjects (const std::vector<moveit_msgs::CollisionObject> &objects);
+
+    void
+    applyAttachedCollisionObjects (const std::vector<moveit_msgs::AttachedCollisionObject> &objects);
+
+    void
+    warmUp (const std::vector<geometry_msgs::Pose> &poses,
+            const std::vector<MotionType> &types);
+
+    void
+    requestFrame ();
+
+    /** \brief Replace the cubes on the mat and send the arm home.
+      *
+      * \input[in] cubes cubes of the new layout
+      */
+    void
+    resetWorld (const std::vector<SyntheticCube> &cubes);
+
+    /** \brief Set the function receiving the rendered clouds.
+      *
+      * \input[in] callback usually Cw3Solution::cloudCallBackOne
+      */
+    void
+    setCloudCallback (const CloudCallback &callback);
+
+    /** \brief Set the transformer used to publish the camera pose.
+      *
+      * \input[in] transformer usually the TF listener of Cw3Solution
+      */
+    void
+    setTransformer (tf::Transformer *transformer);
+
+    /** \brief Render the camera view at the current pose and deliver it. */
+    void
+    publishFrame ();
+
+    /** \brief Pose of the camera optical frame in the world frame. */
+    Eigen::Affine3f
+    cameraPose () const;
+
+    /** \brief Cubes on the mat, including the one being carried. */
+    const std::vector<SyntheticCube> &
+    cubes () const;
+
+    /** \brief Simulated seconds spent planning and moving since construction. */
+    double
+    elapsedTime () const;
+
+    /** \brief Wall clock seconds spent in the cloud callback since construction. */
+    double
+    perceptionTime () const;
+
+    /** \brief Simulated planning time of every arm plan since construction. */
+    const std::vector<double> &
+    planningTimes () const;
+
+    /** \brief Number of arm plans that failed since construction. */
+    int
+    planningFailures () const;
+
+    /** \brief Number of clouds rendered on request, without a motion. */
+    int
+    requestedFrames () const;
+
+    /** \brief Frame id of the rendered clouds. */
+    std::string camera_frame_;
+
+    /** \brief World frame the camera pose is published in. */
+    std::string base_frame_;
+
+  private:
+
+    /** \brief Move to a pose and charge the travel time, without settling.
+      *
+      * \input[in] target_pose pose of the end effector
+      */
+    void
+    travelTo (const geometry_msgs::Pose &target_pose);
+
+    /** \brief Centre of the fingers at the current pose. */
+    Eigen::Vector3f
+    fingerCentre () const;
+
+    /** \brief Let a released cube drop onto the mat or the cube below it. */
+    void
+    settleCube (SyntheticCube &cube) const;
+
+    FakeRobotConfig config_;
+    std::mt19937 rng_;
+    std::lognormal_distribution<double> planning_time_dist_;
+    std::uniform_real_distribution<double> failure_dist_;
+
+    CloudCallback cloud_callback_;
+    tf::Transformer *transformer_;
+
+    std::vector<SyntheticCube> cubes_;
+    Eigen::Vector3f position_;
+    Eigen::Quaternionf orientation_;
+    double gripper_width_;
+    int attached_cube_;
+    int frame_seq_;
+
+    double elapsed_time_;
+    double perception_time_;
+    std::vector<double> planning_times_;
+    int planning_failures_;
+    int requested_frames_;
+};
+#endif
@@ -0,0 +1,118 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_FRAME_GATE_H_
+#define CW3_TEAM_2_FRAME_GATE_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <ros/time.h>
+#include <sensor_msgs/JointState.h>
+
+/** \brief Decides whether a cloud was captured while the arm stood still.
+  *
+  * Tracks the arm joint velocities from /joint_states and only accepts clouds
+  * stamped a settle window after the arm last moved. Until a joint state
+  * arrives every cloud passes, so the gate never blocks a setup without them.
+  */
+class FrameGate
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] velocity_threshold joint speed below which the arm is still, rad/s
+      * \input[in] settle_window time the arm must be still before a cloud is used, s
+      */
+    FrameGate(double velocity_threshold = 0.01, double settle_window = 0.3);
+
+    /** \brief Update the motion state from a joint state message.
+      *
+      * Gripper finger joints are ignored, they do not move the camera.
+      *
+      * \input[in] msg the joint state message
+      */
+    void
+    addJointState (const sensor_msgs::JointState &msg);
+
+    /** \brief Reject every cloud stamped before a given time, called when the
+      * arm starts a motion so frames of the previous pose are never used.
+      *
+      * \input[in] stamp earliest accepted cloud stamp
+      */
+    void
+    setEarliestStamp (const ros::Time &stamp);
+
+    /** \brief Check if a cloud was captured with the arm settled.
+      *
+      * \input[in] stamp stamp of the cloud
+      *
+      * \return true if the cloud may be processed
+      */
+    bool
+    accept (const ros::Time &stamp);
+
+    /** \brief Number of clouds rejected so far. */
+    unsigned long
+    rejected () const { return rejected_; }
+
+  private:
+
+    double velocity_threshold_, settle_window_;
+
+    /** \brief Last time the arm moved faster than the threshold. */
+    ros::Time last_motion_;
+
+    /** \brief Clouds stamped before this are rejected. */
+    ros::Time earliest_;
+
+    /** \brief True while the last joint state showed the arm moving. */
+    bool moving_;
+
+    /** \brief True once a joint state has been received. */
+    bool has_joint_states_;
+
+    /** \brief Previous arm joint positions, for messages without velocities. */
+    std::vector<double> last_position_;
+    ros::Time last_stamp_;
+
+    unsigned long rejected_;
+
+    /** \brief Joint states and clouds arrive on different spinner threads. */
+    boost::mutex mutex_;
+};
+#endif
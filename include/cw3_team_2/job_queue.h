@@ -0,0 +1,111 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_JOB_QUEUE_H_
+#define CW3_TEAM_2_JOB_QUEUE_H_
+
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <ros/ros.h>
+
+#include <cw3_world_spawner/Task2Service.h>
+#include <cw3_team_2/cw3_team_2.h>
+
+/** \brief Queue of stacking jobs run back to back on a worker thread.
+  *
+  * Jobs are sent to the /stack_job service with the request of task 2 and
+  * the call returns as soon as the job is queued. The jobs share the world
+  * model of Cw3Solution, so a job following another only scans the mat
+  * again when the scene changed. A job claims its cubes in the model when
+  * it is queued, and is refused when the cubes left by the jobs ahead of
+  * it can not satisfy it.
+  */
+class JobQueue
+{
+  public:
+
+    /** \brief  Class constructor, advertises the service and starts the worker.
+      *
+      * \input[in] nh ROS node handle
+      * \input[in] solution the solution running the jobs
+      */
+    JobQueue(ros::NodeHandle &nh, Cw3Solution &solution);
+
+    /** \brief  Class destructor, the job running is finished first. */
+    ~JobQueue();
+
+    /** \brief Number of jobs waiting to run. */
+    size_t
+    pending ();
+
+  private:
+
+    /** \brief A queued stacking request. */
+    struct Job
+    {
+      int id;
+      cw3_world_spawner::Task2Service::Request request;
+    };
+
+    /** \brief Service callback queuing a job.
+      *
+      * \input[in] request stack position, rotation and colours
+      * \input[in] response empty
+      *
+      * \return false if the job was refused, see Cw3Solution::claimStackJob
+      */
+    bool
+    queueCallback (cw3_world_spawner::Task2Service::Request &request,
+                   cw3_world_spawner::Task2Service::Response &response);
+
+    /** \brief Run the queued jobs until the queue is destroyed. */
+    void
+    run ();
+
+    Cw3Solution &solution_;
+    ros::ServiceServer queue_srv_;
+
+    std::deque<Job> jobs_;
+    int next_id_;
+    bool stopping_;
+
+    boost::mutex mutex_;
+    boost::condition_variable cond_;
+    boost::thread worker_;
+};
+#endif
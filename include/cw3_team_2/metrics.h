@@ -0,0 +1,232 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_METRICS_H_
+#define CW3_TEAM_2_METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** \brief A count that only goes up, such as frames processed. */
+class MetricCounter
+{
+  public:
+
+    MetricCounter() : value_(0) {}
+
+    void
+    add (uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t
+    value () const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+
+    std::atomic<uint64_t> value_;
+};
+
+/** \brief A value that is set, such as cubes per minute. */
+class MetricGauge
+{
+  public:
+
+    MetricGauge() : value_(0.0) {}
+
+    void
+    set (double value) { value_.store(value, std::memory_order_relaxed); }
+
+    double
+    value () const { return value_.load(std::memory_order_relaxed); }
+
+  private:
+
+    std::atomic<double> value_;
+};
+
+/** \brief Distribution of observed values, such as stage latencies, over
+  * fixed buckets. */
+class MetricHistogram
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] bounds upper bounds of the buckets, increasing
+      */
+    MetricHistogram(const std::vector<double> &bounds);
+
+    /** \brief Count one value, without taking a lock. */
+    void
+    observe (double value);
+
+    /** \brief Upper bounds of the buckets, +Inf not included. */
+    const std::vector<double> &
+    bounds () const { return bounds_; }
+
+    /** \brief Values in a bucket, the last one past every bound. */
+    uint64_t
+    bucketCount (size_t bucket) const { return counts_[bucket].load(std::memory_order_relaxed); }
+
+    double
+    sum () const { return sum_.load(std::memory_order_relaxed); }
+
+  private:
+
+    std::vector<double> bounds_;
+
+    /** \brief One more entry than bounds_, not cumulative. */
+    std::vector<std::atomic<uint64_t> > counts_;
+
+    std::atomic<double> sum_;
+};
+
+/** \brief Counters, gauges and histograms of the node, rendered in the
+  * Prometheus text format.
+  *
+  * Metrics are registered once, usually at startup, and the references
+  * returned are updated with atomics, so the cloud callback and the task
+  * threads never wait on each other or on a scrape. Metrics of the same
+  * name and different labels form one family.
+  */
+class MetricsRegistry
+{
+  public:
+
+    /** \brief The registry of the process. */
+    static MetricsRegistry &
+    instance ();
+
+    /** \brief Register a counter, or find the one already registered.
+      *
+      * \input[in] name metric name, counters should end in _total
+      * \input[in] help one line description
+      * \input[in] labels label list without braces, e.g. stage="ingest"
+      */
+    MetricCounter &
+    counter (const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /** \brief Register a gauge, or find the one already registered. */
+    MetricGauge &
+    gauge (const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /** \brief Register a histogram of durations in seconds, or find the one
+      * already registered. */
+    MetricHistogram &
+    histogram (const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /** \brief Every metric in the Prometheus text exposition format. */
+    std::string
+    render () const;
+
+  private:
+
+    enum MetricKind
+    {
+      KIND_COUNTER,
+      KIND_GAUGE,
+      KIND_HISTOGRAM
+    };
+
+    struct Entry
+    {
+      std::string name, help, labels;
+      MetricKind kind;
+      boost::shared_ptr<MetricCounter> counter;
+      boost::shared_ptr<MetricGauge> gauge;
+      boost::shared_ptr<MetricHistogram> histogram;
+    };
+
+    /** \brief Find a registered metric, NULL if there is none. */
+    Entry *
+    find (const std::string &name, const std::string &labels, MetricKind kind);
+
+    /** \brief Registered metrics, in registration order. */
+    std::vector<Entry> entries_;
+
+    /** \brief Held while registering and rendering, never by an update. */
+    mutable boost::mutex mutex_;
+};
+
+/** \brief Serves MetricsRegistry::render over HTTP on a localhost port,
+  * for a Prometheus scraper. */
+class MetricsServer
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] registry the metrics to serve
+      */
+    MetricsServer(const MetricsRegistry &registry);
+
+    /** \brief  Class destructor, stops serving. */
+    ~MetricsServer();
+
+    /** \brief Listen on 127.0.0.1 and serve from a background thread.
+      *
+      * \input[in] port the TCP port
+      *
+      * \return false if the port could not be bound
+      */
+    bool
+    start (int port);
+
+    /** \brief Stop serving and close the port. */
+    void
+    stop ();
+
+  private:
+
+    /** \brief Accept and answer connections until stopped. */
+    void
+    serve ();
+
+    /** \brief Answer one request on a connected socket. */
+    void
+    answer (int client);
+
+    const MetricsRegistry &registry_;
+
+    int listen_fd_;
+    std::atomic<bool> stop_;
+    boost::thread thread_;
+};
+#endif
@@ -0,0 +1,153 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_MOVEIT_ROBOT_H_
+#define CW3_TEAM_2_MOVEIT_ROBOT_H_
+
+#include <moveit/move_group_interface/move_group_interface.h>
+#include <moveit/planning_scene_interface/planning_scene_interface.h>
+
+#include <atomic>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cw3_team_2/metrics.h>
+#include <cw3_team_2/planner_race.h>
+#include <cw3_team_2/robot_interface.h>
+
+/** \brief RobotInterface backed by the MoveIt move_group of the Panda. */
+class MoveItRobot : public RobotInterface
+{
+  public:
+
+    /** \brief  Class constructor, races planners when ~planner_racing is set.
+      *
+      * The move groups, the planning scene interface and the scene monitor
+      * each wait for move_group, they are connected side by side.
+      */
+    MoveItRobot();
+
+    /** \brief  Class destructor, stops the warm-up. */
+    ~MoveItRobot();
+
+    bool
+    moveArm (const geometry_msgs::Pose &target_pose, MotionType type = MOTION_TRANSFER);
+
+    bool
+    moveArmThrough (const std::vector<geometry_msgs::Pose> &waypoints,
+                    const std::vector<MotionType> &types);
+
+    bool
+    currentArmJoints (std::vector<double> &joints);
+
+    bool
+    solveArmIK (const geometry_msgs::Pose &pose,
+                const std::vector<double> &seed,
+                std::vector<double> &joints);
+
+    bool
+    moveGripper (double width, const std::string &object_name);
+
+    bool
+    fingerState (double &width, double &effort);
+
+    void
+    applyCollisionObjects (const std::vector<moveit_msgs::CollisionObject> &objects);
+
+    void
+    applyAttachedCollisionObjects (const std::vector<moveit_msgs::AttachedCollisionObject> &objects);
+
+    void
+    warmUp (const std::vector<geometry_msgs::Pose> &poses,
+            const std::vector<MotionType> &types);
+
+    /** \brief MoveIt interface to move groups to seperate the arm and the gripper,
+      * these are defined in urdf. */
+    boost::scoped_ptr<moveit::planning_interface::MoveGroupInterface> arm_group_;
+    boost::scoped_ptr<moveit::planning_interface::MoveGroupInterface> hand_group_;
+
+    /** \brief MoveIt interface to interact with the moveit planning scene 
+      * (eg collision objects). */
+    boost::scoped_ptr<moveit::planning_interface::PlanningSceneInterface> planning_scene_interface_;
+
+    /** \brief Planning scene of move_group, used to check blended motions
+      * and by the planner race. NULL if the scene could not be loaded. */
+    planning_scene_monitor::PlanningSceneMonitorPtr scene_monitor_;
+
+    /** \brief Racing planners for moveArm, NULL when racing is off. */
+    boost::scoped_ptr<PlannerRace> planner_race_;
+
+    /** \brief Largest deviation from a via-point when blending, ~blend_tolerance. */
+    double blend_tolerance_;
+
+  private:
+
+    /** \brief Plan to each warm-up pose in turn, until told to stop. */
+    void
+    warmUpPlans (std::vector<geometry_msgs::Pose> poses,
+                 std::vector<MotionType> types);
+
+    /** \brief Give up the warm-up and wait for its current plan, called
+      * before every use of arm_group_, which is not thread safe. */
+    void
+    stopWarmUp ();
+
+    /** \brief Background warm-up plans and the flag that stops them. */
+    boost::thread warm_up_thread_;
+    std::atomic<bool> warm_up_stop_;
+
+    /** \brief Planning and execution times of each motion type, and of the
+      * joined motions and the gripper. */
+    MetricHistogram *plan_seconds_[3], *execute_seconds_[3];
+    MetricHistogram *through_plan_seconds_, *through_execute_seconds_;
+    MetricHistogram *gripper_seconds_;
+
+    /** \brief Plan one segment of a joined motion.
+      *
+      * \input[in] target_pose pose to move the end effector to
+      * \input[in] type kind of the motion
+      * \input[in] start_state state at the end of the previous segment
+      * \input[out] plan the segment
+      *
+      * \return true if the plan succeeded
+      */
+    bool
+    planSegment (const geometry_msgs::Pose &target_pose,
+                 MotionType type,
+                 const moveit::core::RobotState &start_state,
+                 moveit::planning_interface::MoveGroupInterface::Plan &plan);
+};
+#endif
@@ -0,0 +1,167 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_OCCUPANCY_MAP_H_
+#define CW3_TEAM_2_OCCUPANCY_MAP_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <Eigen/Geometry>
+#include <moveit_msgs/CollisionObject.h>
+
+#include <cw3_team_2/perception_pipeline.h>
+
+/** \brief Incremental occupancy map of the workspace, fed to the planning scene.
+  *
+  * Voxels are kept in a hash map as log-odds. Every cloud raises the voxels
+  * its points fall in and lowers the known voxels in view that it should have
+  * hit, those in front of its points or with nothing in front of them, so
+  * objects that move away are cleared by the next view.
+  *
+  * For the planning scene the map is cut into square tiles of columns. Each
+  * occupied column is extruded down to the floor, as the camera never sees
+  * below the top of an object, and neighbouring columns of equal height are
+  * merged into one box. Only tiles that changed since the last export are
+  * sent, as one collision object per tile.
+  */
+class OccupancyMap
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] resolution voxel edge length, m
+      * \input[in] tile_size tile edge length in voxels
+      * \input[in] max_height voxels above this height are ignored, m
+      */
+    OccupancyMap(double resolution = 0.01, int tile_size = 8, double max_height = 0.4);
+
+    /** \brief Forget every voxel and carved region. Tiles already exported are
+      * removed by the next export. */
+    void
+    clear ();
+
+    /** \brief Integrate one cloud.
+      *
+      * \input[in] cloud the cloud in the camera frame, PointT or CompactPointT
+      * \input[in] camera_to_world camera pose when the cloud was taken
+      */
+    template <typename PointType> void
+    integrate (const pcl::PointCloud<PointType> &cloud, const Eigen::Isometry3f &camera_to_world);
+
+    /** \brief Remove a region from the map and keep it empty, used for the
+      * cubes the gripper is going to pick.
+      *
+      * \input[in] min_pt min corner of the region in the world frame
+      * \input[in] max_pt max corner of the region in the world frame
+      */
+    void
+    carve (const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt);
+
+    /** \brief Collision objects of the tiles changed since the last export.
+      *
+      * \input[in] frame_id frame of the collision objects
+      * \input[out] objects ADD for tiles with occupied voxels, REMOVE for
+      *             tiles that became empty
+      */
+    void
+    exportDirty (const std::string &frame_id,
+                 std::vector<moveit_msgs::CollisionObject> &objects);
+
+    /** \brief Number of occupied voxels. */
+    size_t
+    occupiedCount () const;
+
+    /** \brief Log-odds update of a hit and a miss, and the clamping bounds. */
+    float g_hit, g_miss, g_min_log_odds, g_max_log_odds;
+
+    /** \brief Tangents of the half field of view in which voxels are cleared,
+      * kept inside the camera field of view so edges are not cleared. */
+    float g_tan_half_fov_x, g_tan_half_fov_y;
+
+  private:
+
+    /** \brief Pack integer voxel coordinates into a hash key */
+    static uint64_t
+    key (int x, int y, int z);
+
+    /** \brief Voxel coordinates of a point in the world frame */
+    void
+    voxelOf (const Eigen::Vector3f &pt, int &x, int &y, int &z) const;
+
+    /** \brief Raise a voxel, marking its tile dirty if it becomes occupied */
+    void
+    hit (int x, int y, int z);
+
+    /** \brief Check if a voxel of the current cloud lies between the camera and a voxel */
+    bool
+    occluded (const Eigen::Vector3f &origin, int vx, int vy, int vz) const;
+
+    /** \brief Check if a point falls in a carved region */
+    bool
+    carved (const Eigen::Vector3f &pt) const;
+
+    double resolution_;
+    int tile_size_;
+    int max_z_;
+
+    /** \brief Log-odds of every voxel seen so far */
+    boost::unordered_map<uint64_t, float> voxels_;
+
+    /** \brief Export state of a tile */
+    struct Tile
+    {
+      Tile() : dirty(false), exported(false) {}
+      bool dirty, exported;
+    };
+
+    /** \brief Tiles by packed tile coordinates, z is always 0 */
+    boost::unordered_map<uint64_t, Tile> tiles_;
+
+    /** \brief Regions kept empty, as min and max corners */
+    std::vector<std::pair<Eigen::Vector3f, Eigen::Vector3f> > carved_;
+
+    /** \brief Hit voxels of the cloud being integrated, reused between clouds */
+    std::vector<uint64_t> hits_;
+
+    /** \brief Clouds are integrated by the point cloud callback while the
+      * service callbacks export and carve. */
+    mutable boost::mutex mutex_;
+};
+#endif
@@ -0,0 +1,440 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CW3_TEAM_2_PERCEPTION_PIPELINE_H_
+#define CW3_TEAM_2_PERCEPTION_PIPELINE_H_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <sensor_msgs/PointCloud2.h>
+
+#include <cw3_team_2/cloud_ingest.h>
+#include <cw3_team_2/colour_table.h>
+#include <cw3_team_2/voxel_downsample.h>
+
+// PCL specific includes
+#include <pcl/common/centroid.h>
+#include <pcl/common/common.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/filters/passthrough.h>
+#include <pcl/filters/conditional_removal.h>
+#include <pcl/filters/extract_indices.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/sample_consensus/method_types.h>
+#include <pcl/sample_consensus/model_types.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/segmentation/sac_segmentation.h>
+
+typedef pcl::PointXYZRGBA PointT;
+typedef pcl::PointCloud<PointT> PointC;
+typedef PointC::Ptr PointCPtr;
+
+/** \brief Point of the compact layout, xyz in 16 bytes. Its colour stays in
+  * the ingest buffer and is only gathered for the points of the clusters. */
+typedef pcl::PointXYZ CompactPointT;
+
+/** \brief Quantities extracted from a single cluster of the filtered cloud.
+  *
+  * Bounds and the orientation helpers are expressed in the world frame, the
+  * colour sums are raw 0-255 channel totals and the colour histograms point
+  * counts, so they can be averaged or voted on by the caller once all frames
+  * of a scan have been accumulated.
+  */
+struct ClusterStats
+{
+  /** \brief Min and max points of the cluster in the world frame */
+  pcl::PointXYZ min_pt, max_pt;
+
+  /** \brief y coordinate of the point holding the max x value */
+  double max_x_y;
+
+  /** \brief x coordinate of the point holding the max y value */
+  double max_y_x;
+
+  /** \brief Sum of the rgb values of every point in the cluster */
+  double r, g, b;
+
+  /** \brief Number of points summed into r, g and b */
+  int color_count;
+
+  /** \brief Colour classes of the points summed into r, g and b */
+  ColourHistogram hist;
+
+  /** \brief Sum of the rgb values of the points found in each cube layer of a stack */
+  std::vector<double> layer_r, layer_g, layer_b;
+
+  /** \brief Number of points summed into each layer */
+  std::vector<int> layer_count;
+
+  /** \brief Colour classes of the points of each layer */
+  std::vector<ColourHistogram> layer_hist;
+};
+
+/** \brief Scratch buffers of one cluster, owned by a FrameArena. */
+template <typename PointType>
+struct ClusterBuffers
+{
+  typedef pcl::PointCloud<PointType> Cloud;
+
+  ClusterBuffers();
+
+  /** \brief Indices of the cluster in the filtered cloud */
+  pcl::PointIndices indices;
+
+  /** \brief Cluster points in the camera frame and in the world frame */
+  typename Cloud::Ptr camera, world;
+
+  /** \brief Packed rgba of the cluster points, in the order of camera */
+  std::vector<uint32_t> rgba;
+
+  /** \brief Statistics of the cluster */
+  ClusterStats stats;
+};
+
+/** \brief Owns the per-frame perception scratch buffers.
+  *
+  * Cluster slots handed out during a frame are kept when the frame ends and
+  * handed out again by the next one, so their vectors keep their capacity.
+  * Once the number and size of the clusters reach their high-water mark,
+  * frames stop allocating memory of their own.
+  */
+template <typename PointType>
+class FrameArena
+{
+  public:
+
+    /** \brief  Class constructor. */
+    FrameArena();
+
+    /** \brief Start a new frame, every cluster slot becomes free again. */
+    void
+    reset ();
+
+    /** \brief Hand out the next free cluster slot, creating one past the
+      * high-water mark.
+      *
+      * \return the slot, its buffers hold data from an earlier frame
+      */
+    ClusterBuffers<PointType> &
+    acquireCluster ();
+
+    /** \brief Return the last slot handed out, when its cluster is rejected. */
+    void
+    releaseCluster ();
+
+    /** \brief Number of cluster slots handed out this frame. */
+    size_t
+    clusterCount () const { return cluster_count_; }
+
+    /** \brief Cluster slot i of this frame. */
+    ClusterBuffers<PointType> &
+    cluster (size_t i) { return *clusters_[i]; }
+
+    /** \brief Sort the clusters of this frame by decreasing size. */
+    void
+    sortClusters ();
+
+    /** \brief Most cluster slots used by a single frame so far. */
+    size_t
+    highWaterMark () const { return clusters_.size(); }
+
+    /** \brief Points processed flags used by cluster extraction. */
+    std::vector<char> processed;
+
+    /** \brief Neighbour search results used by cluster extraction. */
+    std::vector<int> nn_indices;
+    std::vector<float> nn_distances;
+
+  private:
+
+    /** \brief Cluster slots, held by pointer so handed out slots never move. */
+    std::vector<boost::shared_ptr<ClusterBuffers<PointType> > > clusters_;
+
+    /** \brief Number of cluster slots handed out this frame. */
+    size_t cluster_count_;
+};
+
+/** \brief Parameters and state of the perception stages that do not depend
+  * on the point layout.
+  *
+  * Holds the PCL filter parameters but no ROS handles, so the same code can
+  * be driven by the node and by the offline benchmarks.
+  */
+class PerceptionPipelineBase
+{
+  public:
+
+    /** \brief  Class constructor. */
+    PerceptionPipelineBase();
+
+    virtual ~PerceptionPipelineBase() {}
+
+    /** \brief Gather the points above the floor straight from a cloud message
+      * into g_cloud_filtered, in place of conversion and floor filtering.
+      *
+      * \input[in] msg the input cloud message in the camera frame
+      * \input[in] floor_z depth of the floor cut-off in the camera frame
+      *
+      * \return false if the message has no usable xyz and rgb fields
+      */
+    virtual bool
+    ingest (const sensor_msgs::PointCloud2 &msg, double floor_z) = 0;
+
+    /** \brief Plane segmentation and cluster extraction on g_cloud_filtered. */
+    virtual void
+    segment () = 0;
+
+    /** \brief Take the points of g_cloud_filtered inside a world box as the
+      * only cluster, in place of plane segmentation and clustering.
+      *
+      * Meant for clouds ingested with the box as ROI, looking at an object
+      * whose place is already known.
+      *
+      * \input[in] camera_to_world pose of the camera the cloud was taken from
+      * \input[in] world_roi the box in the world frame, above the floor
+      */
+    virtual void
+    segmentRoi (const Eigen::Isometry3f &camera_to_world,
+                const Eigen::AlignedBox3f &world_roi) = 0;
+
+    /** \brief Only ingest the points inside a box, until clearRoi is called.
+      *
+      * \input[in] roi the box in the camera frame
+      */
+    void
+    setRoi (const Eigen::AlignedBox3f &roi);
+
+    /** \brief Ingest whole clouds again. */
+    void
+    clearRoi ();
+
+    /* Variables */
+
+    /** \brief Voxel Grid filter's leaf size. */
+    double g_vg_leaf_sz;
+
+    /** \brief Nearest neighborhooh size for normal estimation. */
+    double g_k_nn;
+
+    /** \brief Euclidean clustering tolerance and size limits. */
+    double g_cluster_tolerance;
+    int g_min_cluster_size, g_max_cluster_size;
+
+    /** \brief Color filter rgb filter values. */
+    double g_cf_red, g_cf_green, g_cf_blue;
+
+    /** \brief Colour class of every point summed into the cluster colours. */
+    ColourTable g_colour_table;
+
+    /** \brief Region of interest of ingest in the camera frame, and whether it is used. */
+    Eigen::AlignedBox3f g_roi;
+    bool g_roi_enabled;
+
+    /** \brief Points kept by ingest, reused between frames. */
+    std::vector<CompactPoint> g_cloud_compact;
+
+    /** \brief True while g_cloud_filtered holds the points of g_cloud_compact,
+      * in the same order, so colours can be read from there. */
+    bool g_compact_colours;
+};
+
+/** \brief Perception stages used by Cw3Solution to find cubes in a cloud.
+  *
+  * Instantiated for PointT, 32 bytes per point with the colour, and for
+  * CompactPointT, 16 bytes per point with the colour left in the ingest
+  * buffer. The compact layout halves the memory every filter, the normal
+  * estimation and the KD-tree go through, but only knows the colours of
+  * clouds read by ingest.
+  */
+template <typename PointType>
+class PerceptionPipeline : public PerceptionPipelineBase
+{
+  public:
+
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef typename Cloud::Ptr CloudPtr;
+
+    /** \brief  Class constructor. */
+    PerceptionPipeline();
+
+    /** \brief Run every stage of the point cloud callback that does not need
+      * TF: filtering, plane segmentation and cluster extraction.
+      *
+      * \input[in] in_cloud_ptr the input cloud in the camera frame
+      * \input[in] floor_z depth of the floor cut-off in the camera frame
+      */
+    void
+    filterAndSegment (CloudPtr &in_cloud_ptr, double floor_z);
+
+    /** \brief Gather the points above the floor of a message into g_cloud_filtered. */
+    bool
+    ingest (const sensor_msgs::PointCloud2 &msg, double floor_z);
+
+    /** \brief Plane segmentation and cluster extraction on g_cloud_filtered. */
+    void
+    segment ();
+
+    /** \brief Take the points inside a world box as the only cluster. */
+    void
+    segmentRoi (const Eigen::Isometry3f &camera_to_world,
+                const Eigen::AlignedBox3f &world_roi);
+
+    /** \brief Apply Voxel Grid filtering. The frames of the node are not
+      * downsampled, this serves the benchmarks.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      * \input[out] out_cloud_ptr the output PointCloud2 pointer
+      */
+    void
+    applyVX (CloudPtr &in_cloud_ptr,
+             CloudPtr &out_cloud_ptr);
+
+    /** \brief Apply Floor filtering.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      * \input[out] out_cloud_ptr the output PointCloud2 pointer
+      * \input[in] floor_z depth of the floor cut-off in the camera frame
+      */
+    void
+    applyFF (CloudPtr &in_cloud_ptr,
+             CloudPtr &out_cloud_ptr,
+             double floor_z);
+
+    /** \brief Normal estimation.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      */
+    void
+    findNormals (CloudPtr &in_cloud_ptr);
+
+    /** \brief Segment Plane from point cloud.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      */
+    void
+    segPlane (CloudPtr &in_cloud_ptr);
+
+    /** \brief Extract inliers from input point cloud.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      */
+    void
+    extractInlier (CloudPtr &in_cloud_ptr);
+
+    /** \brief Segment clusters from point cloud into the cluster slots of
+      * g_arena, largest first.
+      *
+      * \input[in] in_cloud_ptr the input PointCloud2 pointer
+      */
+    void
+    segClusters (CloudPtr &in_cloud_ptr);
+
+    /** \brief Copy the points of one cluster and their colours out of the
+      * filtered cloud.
+      *
+      * \input[in] indices indices of the cluster in g_cloud_filtered
+      * \input[out] cluster the cluster points
+      * \input[out] rgba the packed colour of each cluster point
+      */
+    void
+    extractCluster (const pcl::PointIndices &indices,
+                    Cloud &cluster,
+                    std::vector<uint32_t> &rgba) const;
+
+    /** \brief Compute bounds, orientation helpers, colour sums and colour
+      * histograms of a cluster.
+      *
+      * \input[in] cluster_world the cluster points in the world frame
+      * \input[in] rgba the packed colour of each cluster point
+      * \input[in] stack_layers number of stack layers to bin colours into, 0 to skip
+      * \input[in] accumulate_colour true to sum the colour of the whole cluster
+      * \input[out] stats the computed statistics
+      */
+    void
+    computeClusterStats (const Cloud &cluster_world,
+                         const std::vector<uint32_t> &rgba,
+                         int stack_layers,
+                         bool accumulate_colour,
+                         ClusterStats &stats) const;
+
+    /** \brief Point Cloud (filtered) pointer. */
+    CloudPtr g_cloud_filtered, g_cloud_filtered2;
+
+    /** \brief Point cloud to hold plane and cylinder points. */
+    CloudPtr g_cloud_plane;
+
+    /** \brief Voxel Grid filter, spread over the cores. */
+    VoxelDownsampler<PointType> g_vx;
+
+    /** \brief Pass Through filter. */
+    pcl::PassThrough<PointType> g_pt;
+
+    /** \brief Color filter. */
+    pcl::ConditionalRemoval<PointType> g_cf;
+
+    /** \brief Floor Filtering. */
+    pcl::ConditionalRemoval<PointType> g_ff;
+
+    /** \brief KDTree for nearest neighborhood search. */
+    typename pcl::search::KdTree<PointType>::Ptr g_tree_ptr;
+
+    /** \brief Normal estimation. */
+    pcl::NormalEstimation<PointType, pcl::Normal> g_ne;
+
+    /** \brief Cloud of normals. */
+    pcl::PointCloud<pcl::Normal>::Ptr g_cloud_normals, g_cloud_normals2;
+
+    /** \brief SAC segmentation. */
+    pcl::SACSegmentationFromNormals<PointType, pcl::Normal> g_seg;
+
+    /** \brief Extract point cloud indices. */
+    pcl::ExtractIndices<PointType> g_extract_pc;
+
+    /** \brief Extract point cloud normal indices. */
+    pcl::ExtractIndices<pcl::Normal> g_extract_normals;
+
+    /** \brief Point indices for plane. */
+    pcl::PointIndices::Ptr g_inliers_plane;
+
+    /** \brief Model coefficients for the plane segmentation. */
+    pcl::ModelCoefficients::Ptr g_coeff_plane;
+
+    /** \brief Per-frame scratch buffers, holds the clusters of the last frame. */
+    FrameArena<PointType> g_arena;
+};
+#endif
@@ -0,0 +1,134 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_PLANNER_RACE_H_
+#define CW3_TEAM_2_PLANNER_RACE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <geometry_msgs/Pose.h>
+#include <moveit/move_group_interface/move_group_interface.h>
+#include <moveit/planning_interface/planning_interface.h>
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+#include <pluginlib/class_loader.hpp>
+#include <ros/ros.h>
+
+#include <cw3_team_2/robot_interface.h>
+
+/** \brief How one kind of motion is raced. */
+struct RaceConfig
+{
+  /** \brief OMPL planner configurations started, e.g. RRTConnectkConfigDefault */
+  std::vector<std::string> planners;
+
+  /** \brief Runs of each planner, each samples differently */
+  int attempts;
+
+  /** \brief Time the race may take, seconds */
+  double deadline;
+
+  /** \brief Take the first valid path, else the shortest one found by the deadline */
+  bool first_valid;
+};
+
+/** \brief Plans arm motions by racing several planners at once.
+  *
+  * The planner plugin of move_group is loaded in this node and each
+  * candidate gets its own planning context and thread, all planning on one
+  * copy of the monitored planning scene. move_group can not do this, its
+  * action server preempts a plan with the next request. The losers are
+  * terminated once the race is decided.
+  */
+class PlannerRace
+{
+  public:
+
+    /** \brief  Class constructor, loads the planner plugin.
+      *
+      * \input[in] nh node handle holding the race configuration, ~planner_race/<type>
+      * \input[in] group_name planning group of the arm
+      * \input[in] scene_monitor running monitor of the planning scene of move_group
+      */
+    PlannerRace(ros::NodeHandle &nh,
+                const std::string &group_name,
+                const planning_scene_monitor::PlanningSceneMonitorPtr &scene_monitor);
+
+    /** \brief Check if the planner plugin and the scene monitor are ready. */
+    bool
+    ready () const { return planner_.get() != NULL; }
+
+    /** \brief Plan to a pose target with the configuration of a motion type.
+      *
+      * \input[in] target_pose pose of the end effector link, planning frame
+      * \input[in] end_effector_link link to place at the target
+      * \input[in] position_tolerance goal position tolerance, m
+      * \input[in] orientation_tolerance goal orientation tolerance, rad
+      * \input[in] type kind of the motion
+      * \input[in] start_state state to plan from, NULL for the current state
+      * \input[out] plan time parameterised plan, ready to execute
+      *
+      * \return true if a planner found a path before the deadline
+      */
+    bool
+    plan (const geometry_msgs::Pose &target_pose,
+          const std::string &end_effector_link,
+          double position_tolerance,
+          double orientation_tolerance,
+          MotionType type,
+          const moveit::core::RobotState *start_state,
+          moveit::planning_interface::MoveGroupInterface::Plan &plan);
+
+  private:
+
+    /** \brief Read the configuration of a motion type, with defaults.
+      *
+      * \input[in] nh node handle of the race parameters
+      * \input[in] name name of the motion type in the parameters
+      * \input[in] defaults configuration used for missing parameters
+      */
+    RaceConfig
+    loadConfig (ros::NodeHandle &nh, const std::string &name, const RaceConfig &defaults);
+
+    std::string group_name_;
+    std::map<int, RaceConfig> configs_;
+
+    planning_scene_monitor::PlanningSceneMonitorPtr scene_monitor_;
+    boost::scoped_ptr<pluginlib::ClassLoader<planning_interface::PlannerManager> > loader_;
+    planning_interface::PlannerManagerPtr planner_;
+};
+#endif
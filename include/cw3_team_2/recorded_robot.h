@@ -0,0 +1,173 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_RECORDED_ROBOT_H_
+#define CW3_TEAM_2_RECORDED_ROBOT_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include <cw3_team_2/robot_interface.h>
+#include <cw3_team_2/task_log.h>
+
+/** \brief RobotInterface that passes every call on to another robot and
+  * logs what it returned.
+  *
+  * Planning scene updates and the warm-up return nothing a task reads, they
+  * are passed on without being logged. Motions are logged by their result
+  * only, their plans and planning times stay inside the robot.
+  */
+class RecordingRobot : public RobotInterface
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] robot the robot doing the work
+      * \input[in] log the log of the results
+      */
+    RecordingRobot(const boost::shared_ptr<RobotInterface> &robot,
+                   const boost::shared_ptr<TaskLogWriter> &log);
+
+    bool
+    moveArm (const geometry_msgs::Pose &target_pose, MotionType type = MOTION_TRANSFER);
+
+    bool
+    moveArmThrough (const std::vector<geometry_msgs::Pose> &waypoints,
+                    const std::vector<MotionType> &types);
+
+    bool
+    currentArmJoints (std::vector<double> &joints);
+
+    bool
+    solveArmIK (const geometry_msgs::Pose &pose,
+                const std::vector<double> &seed,
+                std::vector<double> &joints);
+
+    bool
+    moveGripper (double width, const std::string &object_name);
+
+    bool
+    fingerState (double &width, double &effort);
+
+    void
+    applyCollisionObjects (const std::vector<moveit_msgs::CollisionObject> &objects);
+
+    void
+    applyAttachedCollisionObjects (const std::vector<moveit_msgs::AttachedCollisionObject> &objects);
+
+    void
+    warmUp (const std::vector<geometry_msgs::Pose> &poses,
+            const std::vector<MotionType> &types);
+
+    void
+    requestFrame ();
+
+  private:
+
+    boost::shared_ptr<RobotInterface> robot_;
+    boost::shared_ptr<TaskLogWriter> log_;
+};
+
+/** \brief RobotInterface that answers every call with the result logged by
+  * a RecordingRobot, without moving anything.
+  *
+  * The calls must come in the logged order. The first call that does not
+  * match the log fails, and so does every call after it, so a run that has
+  * gone another way than the recorded one stops at once.
+  */
+class ReplayRobot : public RobotInterface
+{
+  public:
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] log the recorded run, shared with the replayed clouds
+      */
+    ReplayRobot(const boost::shared_ptr<TaskLogReader> &log);
+
+    bool
+    moveArm (const geometry_msgs::Pose &target_pose, MotionType type = MOTION_TRANSFER);
+
+    bool
+    moveArmThrough (const std::vector<geometry_msgs::Pose> &waypoints,
+                    const std::vector<MotionType> &types);
+
+    bool
+    currentArmJoints (std::vector<double> &joints);
+
+    bool
+    solveArmIK (const geometry_msgs::Pose &pose,
+                const std::vector<double> &seed,
+                std::vector<double> &joints);
+
+    bool
+    moveGripper (double width, const std::string &object_name);
+
+    bool
+    fingerState (double &width, double &effort);
+
+    void
+    applyCollisionObjects (const std::vector<moveit_msgs::CollisionObject> &objects);
+
+    void
+    applyAttachedCollisionObjects (const std::vector<moveit_msgs::AttachedCollisionObject> &objects);
+
+    void
+    warmUp (const std::vector<geometry_msgs::Pose> &poses,
+            const std::vector<MotionType> &types);
+
+    void
+    requestFrame ();
+
+    /** \brief Check if a call did not match the log. */
+    bool
+    diverged () const { return diverged_; }
+
+  private:
+
+    /** \brief Read the result of the next call from the log.
+      *
+      * \input[in] call the call being made
+      * \input[out] values its logged outputs
+      *
+      * \return the logged result, false once the run has diverged
+      */
+    bool
+    replay (RobotCall call, std::vector<double> &values);
+
+    boost::shared_ptr<TaskLogReader> log_;
+    bool diverged_;
+};
+#endif
@@ -0,0 +1,169 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_ROBOT_INTERFACE_H_
+#define CW3_TEAM_2_ROBOT_INTERFACE_H_
+
+#include <string>
+#include <vector>
+
+#include <geometry_msgs/Pose.h>
+#include <moveit_msgs/AttachedCollisionObject.h>
+#include <moveit_msgs/CollisionObject.h>
+
+/** \brief Kind of an arm motion, so planning can be tuned per kind. */
+enum MotionType
+{
+  /** \brief Moves between the scan and inspection poses */
+  MOTION_SCAN,
+
+  /** \brief Short vertical moves to grasp, place and retreat */
+  MOTION_APPROACH,
+
+  /** \brief Long moves to the pick and place locations */
+  MOTION_TRANSFER
+};
+
+/** \brief Arm, hand and planning scene operations used by Cw3Solution.
+  *
+  * The node drives MoveIt through MoveItRobot, the throughput benchmarks
+  * swap in a kinematic stand-in so no simulator or move_group is needed.
+  */
+class RobotInterface
+{
+  public:
+
+    virtual ~RobotInterface() {}
+
+    /** \brief Plan and execute a motion of the arm to a target pose.
+      *
+      * \input[in] target_pose pose to move the end effector to
+      * \input[in] type kind of the motion
+      *
+      * \return true if the plan succeeded
+      */
+    virtual bool
+    moveArm (const geometry_msgs::Pose &target_pose, MotionType type = MOTION_TRANSFER) = 0;
+
+    /** \brief Move the arm through several poses in one motion, without
+      * coming to rest at the intermediate ones.
+      *
+      * \input[in] waypoints poses to pass, the arm stops at the last one
+      * \input[in] types kind of the motion to each pose
+      *
+      * \return true if every segment was planned and the motion executed
+      */
+    virtual bool
+    moveArmThrough (const std::vector<geometry_msgs::Pose> &waypoints,
+                    const std::vector<MotionType> &types) = 0;
+
+    /** \brief Read the current positions of the arm joints.
+      *
+      * \input[out] joints joint positions from the base to the wrist
+      *
+      * \return false if the arm state is not available
+      */
+    virtual bool
+    currentArmJoints (std::vector<double> &joints) = 0;
+
+    /** \brief Solve the inverse kinematics of the arm within its joint limits.
+      *
+      * \input[in] pose pose of the end effector
+      * \input[in] seed joint positions the solution should stay close to
+      * \input[out] joints joint positions reaching the pose
+      *
+      * \return false if the pose can not be reached
+      */
+    virtual bool
+    solveArmIK (const geometry_msgs::Pose &pose,
+                const std::vector<double> &seed,
+                std::vector<double> &joints) = 0;
+
+    /** \brief Plan and execute a motion of the gripper fingers.
+      *
+      * \input[in] width desired gripper finger width, already clamped
+      * \input[in] object_name name of the object being grasped
+      *
+      * \return true if the plan succeeded
+      */
+    virtual bool
+    moveGripper (double width, const std::string &object_name) = 0;
+
+    /** \brief Read the current state of the gripper fingers.
+      *
+      * \input[out] width distance between the fingers
+      * \input[out] effort summed magnitude of the finger efforts, NaN if not reported
+      *
+      * \return false if the finger state is not available
+      */
+    virtual bool
+    fingerState (double &width, double &effort) = 0;
+
+    /** \brief Add, move or remove collision objects in the planning scene.
+      *
+      * \input[in] objects collision objects with their operation set
+      */
+    virtual void
+    applyCollisionObjects (const std::vector<moveit_msgs::CollisionObject> &objects) = 0;
+
+    /** \brief Add or remove attached collision objects in the planning scene.
+      *
+      * \input[in] objects attached collision objects with their operation set
+      */
+    virtual void
+    applyAttachedCollisionObjects (const std::vector<moveit_msgs::AttachedCollisionObject> &objects) = 0;
+
+    /** \brief Plan, without moving, to poses the tasks are about to use, so
+      * the planners have loaded everything before the first request.
+      *
+      * Returns at once, the plans are made in the background and given up
+      * as soon as a motion is requested.
+      *
+      * \input[in] poses poses to plan to from the current state
+      * \input[in] types kind of the motion to each pose
+      */
+    virtual void
+    warmUp (const std::vector<geometry_msgs::Pose> &poses,
+            const std::vector<MotionType> &types) = 0;
+
+    /** \brief Ask the camera for a cloud at the current pose, for a wait on
+      * a cloud that follows no motion.
+      *
+      * A camera that streams sends one anyway, so by default nothing is done.
+      */
+    virtual void
+    requestFrame () {}
+};
+#endif
@@ -0,0 +1,155 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_SCAN_INTEGRATOR_H_
+#define CW3_TEAM_2_SCAN_INTEGRATOR_H_
+
+#include <vector>
+
+#include <geometry_msgs/Point.h>
+#include <geometry_msgs/PointStamped.h>
+#include <std_msgs/ColorRGBA.h>
+
+#include <cw3_team_2/colour_table.h>
+
+/** \brief What the point cloud callback reports about one cluster. */
+struct ScanDetection
+{
+  /** \brief Centroid of the cluster in the world frame */
+  geometry_msgs::PointStamped centroid;
+
+  /** \brief Min and max points of the cluster in the world frame */
+  geometry_msgs::Point max, min;
+
+  /** \brief x of the point holding the max y, y of the point holding the max x */
+  double max_y_x, max_x_y;
+
+  /** \brief Sum of the rgb values of the cluster and the number of points summed */
+  std_msgs::ColorRGBA color;
+  int color_count;
+
+  /** \brief Colour classes of the points summed into color */
+  ColourHistogram colour_hist;
+};
+
+/** \brief Running mean and variance of a single value, Welford's method. */
+struct RunningStat
+{
+  RunningStat() : n(0), mean(0.0), m2(0.0) {}
+
+  void
+  add (double x)
+  {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+  }
+
+  /** \brief Variance of the mean, 0 until two values are added */
+  double
+  meanVariance () const { return (n > 1) ? m2 / (n - 1) / n : 0.0; }
+
+  int n;
+  double mean, m2;
+};
+
+/** \brief Merges the clusters seen in consecutive frames at one scan pose.
+  *
+  * Clusters are matched across frames by centroid distance. Positions are
+  * averaged with their variances tracked, colour sums, counts and colour
+  * histograms are added up.
+  * Storage is fixed, clusters past kMaxTracks are ignored.
+  */
+class ScanIntegrator
+{
+  public:
+
+    /** \brief Most clusters tracked at one scan pose. */
+    static const int kMaxTracks = 32;
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] match_distance max centroid distance of the same cluster in two frames, m
+      * \input[in] tolerance standard error of a centroid below which it is settled, m
+      */
+    ScanIntegrator(double match_distance = 0.02, double tolerance = 0.001);
+
+    /** \brief Forget every tracked cluster, before moving to a new scan pose. */
+    void
+    reset ();
+
+    /** \brief Add the clusters found in one frame.
+      *
+      * \input[in] detections the clusters of the frame
+      */
+    void
+    addFrame (const std::vector<ScanDetection> &detections);
+
+    /** \brief Number of frames added since the last reset. */
+    int
+    frames () const { return frames_; }
+
+    /** \brief Check if every cluster seen more than once has a settled centroid. */
+    bool
+    converged () const;
+
+    /** \brief Averaged clusters, only those seen in at least half of the frames.
+      *
+      * \input[out] out the averaged clusters, colours are summed over the frames
+      */
+    void
+    result (std::vector<ScanDetection> &out) const;
+
+  private:
+
+    /** \brief A cluster followed across frames */
+    struct Track
+    {
+      ScanDetection first;
+      RunningStat x, y, z;
+      RunningStat max_x, max_y, max_z, min_x, min_y, min_z;
+      RunningStat max_y_x, max_x_y;
+      double r, g, b;
+      int color_count;
+      ColourHistogram colour_hist;
+    };
+
+    double match_distance_, tolerance_;
+    Track tracks_[kMaxTracks];
+    int num_tracks_;
+    int frames_;
+};
+#endif
@@ -0,0 +1,143 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_SYNTHETIC_SCENE_H_
+#define CW3_TEAM_2_SYNTHETIC_SCENE_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include <cw3_team_2/perception_pipeline.h>
+
+/** \brief Number of cube colours used by the world spawner */
+const int kNumCubeColours = 3;
+
+/** \brief Cube colours used by the world spawner (red, blue, purple), 0-255 */
+extern const uint8_t kCubeColours[kNumCubeColours][3];
+
+/** \brief Colour of the black obstacles, 0-255 */
+extern const uint8_t kObstacleColour[3];
+
+/** \brief A cube on the synthetic mat, stacks are cubes sharing x and y. */
+struct SyntheticCube
+{
+  /** \brief Centre of the cube in the world frame */
+  Eigen::Vector3f centre;
+
+  /** \brief Rotation of the cube about the world z axis */
+  float yaw;
+
+  /** \brief Edge length of the cube */
+  float size;
+
+  /** \brief Colour of the cube, 0-255 per channel */
+  uint8_t r, g, b;
+};
+
+/** \brief Parameters used to generate a synthetic scene of the mat. */
+struct SyntheticSceneConfig
+{
+  SyntheticSceneConfig();
+
+  /** \brief Resolution and horizontal field of view of the depth camera */
+  int width, height;
+  double fov_x;
+
+  /** \brief Position of the camera in the world frame, looking straight down */
+  Eigen::Vector3f camera_position;
+
+  /** \brief Number of single cubes, cubes in the stack and black obstacles */
+  int num_cubes;
+  int stack_height;
+  int num_obstacles;
+
+  /** \brief Edge length of every cube */
+  double cube_size;
+
+  /** \brief Standard deviation of the depth noise in metres */
+  double noise_stddev;
+
+  /** \brief Fraction of pixels returned as NaN */
+  double dropout;
+
+  /** \brief Seed of the random layout, equal seeds give equal scenes */
+  unsigned int seed;
+};
+
+/** \brief A rendered synthetic scene and the ground truth used to build it. */
+struct SyntheticScene
+{
+  /** \brief Organized cloud in the camera optical frame */
+  PointCPtr cloud;
+
+  /** \brief Pose of the camera optical frame in the world frame */
+  Eigen::Affine3f camera_to_world;
+
+  /** \brief Ground truth cubes, including stack layers and obstacles */
+  std::vector<SyntheticCube> cubes;
+};
+
+/** \brief Pose of a camera optical frame looking straight down from a position.
+  *
+  * \input[in] position camera position in the world frame
+  * \return the camera to world transform
+  */
+Eigen::Affine3f
+downwardCameraPose (const Eigen::Vector3f &position);
+
+/** \brief Lay out random cubes, a stack and obstacles on the mat below the
+  * camera and render them.
+  *
+  * \input[in] config scene parameters
+  * \return the rendered scene
+  */
+SyntheticScene
+generateScene (const SyntheticSceneConfig &config);
+
+/** \brief Ray cast cubes lying on the mat into an organized cloud.
+  *
+  * \input[in] cubes cubes to render
+  * \input[in] camera_to_world pose of the camera optical frame
+  * \input[in] config camera resolution, field of view and noise
+  * \input[out] cloud the rendered cloud in the camera optical frame
+  */
+void
+renderScene (const std::vector<SyntheticCube> &cubes,
+             const Eigen::Affine3f &camera_to_world,
+             const SyntheticSceneConfig &config,
+             PointC &cloud);
+#endif
@@ -0,0 +1,138 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_TASK_ACTION_SERVER_H_
+#define CW3_TEAM_2_TASK_ACTION_SERVER_H_
+
+#include <atomic>
+#include <string>
+
+#include <actionlib/server/simple_action_server.h>
+#include <boost/thread/mutex.hpp>
+#include <ros/ros.h>
+
+#include <cw3_team_2/Task1Action.h>
+#include <cw3_team_2/Task2Action.h>
+#include <cw3_team_2/Task3Action.h>
+#include <cw3_team_2/cw3_team_2.h>
+
+/** \brief Action servers running the three tasks of Cw3Solution.
+  *
+  * Each task runs on the executor thread of its server, so the spinner stays
+  * free for clouds and joint states. Feedback reports the phase, the cubes
+  * placed and an estimate of the time left. A cancel stops the task before
+  * its next arm or gripper motion. Only one task runs at a time, a goal sent
+  * while another task runs waits for it to finish.
+  */
+class TaskActionServer
+{
+  public:
+
+    typedef actionlib::SimpleActionServer<cw3_team_2::Task1Action> Task1Server;
+    typedef actionlib::SimpleActionServer<cw3_team_2::Task2Action> Task2Server;
+    typedef actionlib::SimpleActionServer<cw3_team_2::Task3Action> Task3Server;
+
+    /** \brief  Class constructor, starts the servers.
+      *
+      * \input[in] nh ROS node handle
+      * \input[in] solution the solution running the tasks
+      */
+    TaskActionServer(ros::NodeHandle &nh, Cw3Solution &solution);
+
+  private:
+
+    void
+    executeTask1 (const cw3_team_2::Task1GoalConstPtr &goal);
+
+    void
+    executeTask2 (const cw3_team_2::Task2GoalConstPtr &goal);
+
+    void
+    executeTask3 (const cw3_team_2::Task3GoalConstPtr &goal);
+
+    /** \brief Cancel the running task if it belongs to the given server.
+      *
+      * \input[in] task number of the task whose goal was preempted
+      */
+    void
+    preemptCallback (int task);
+
+    /** \brief Wait for the task lock, then mark a task as running.
+      *
+      * \input[in] server server of the goal waiting to run
+      * \input[in] task number of the task
+      * \input[out] task_lock the task lock, held until the goal finishes
+      *
+      * \return false if the goal was preempted while waiting
+      */
+    template <class Server> bool
+    startTask (Server &server, int task, boost::unique_lock<boost::mutex> &task_lock);
+
+    /** \brief Mark the task as finished and set the final state of its goal,
+      * with the task lock still held.
+      *
+      * \input[in] server server of the goal
+      * \input[in] result result sent with the goal state
+      * \input[in] success value returned by the task
+      */
+    template <class Server, class Result> void
+    finishTask (Server &server, const Result &result, bool success);
+
+    /** \brief Send the progress of the running task as goal feedback.
+      *
+      * \input[in] server server of the running goal
+      * \input[in] phase current phase of the task
+      */
+    template <class Server, class Feedback> void
+    publishFeedback (Server &server, const std::string &phase);
+
+    Cw3Solution &solution_;
+
+    Task1Server task1_server_;
+    Task2Server task2_server_;
+    Task3Server task3_server_;
+
+    /** \brief Number of the task started by an action, 0 when none is. */
+    std::atomic<int> running_task_;
+
+    /** \brief Running average of the seconds taken to stack one cube, kept
+      * across goals so the first estimate of a goal is not a guess. */
+    double seconds_per_cube_;
+
+    /** \brief Cube counts of the last feedback and the time the count last changed. */
+    int cubes_placed_, cubes_total_;
+    ros::WallTime last_cube_time_;
+};
+#endif
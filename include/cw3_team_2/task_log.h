@@ -0,0 +1,276 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_TASK_LOG_H_
+#define CW3_TEAM_2_TASK_LOG_H_
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <Eigen/Geometry>
+#include <ros/serialization.h>
+#include <sensor_msgs/PointCloud2.h>
+
+/** \brief Kind of a record of a task log. */
+enum TaskLogType
+{
+  /** \brief Past the last record */
+  LOG_END = 0,
+
+  /** \brief A task started, with its service request */
+  LOG_TASK = 1,
+
+  /** \brief A cloud a task used, with the camera pose it was taken at */
+  LOG_FRAME = 2,
+
+  /** \brief A task waited for a cloud and none came */
+  LOG_NO_FRAME = 3,
+
+  /** \brief A robot call and what it returned */
+  LOG_ROBOT = 4
+};
+
+/** \brief Robot calls whose results are logged, see RobotInterface. */
+enum RobotCall
+{
+  CALL_MOVE_ARM,
+  CALL_MOVE_ARM_THROUGH,
+  CALL_ARM_JOINTS,
+  CALL_ARM_IK,
+  CALL_MOVE_GRIPPER,
+  CALL_FINGER_STATE
+};
+
+/** \brief Writes the inputs of task runs to a memory-mapped log.
+  *
+  * Everything a task reads from outside is logged in the order it is read:
+  * the request, each cloud the task takes its clusters from, and the
+  * result of each robot call. Records are copied straight into a shared
+  * mapping of the file, so a run that crashes still leaves its log behind.
+  * The mapping grows by doubling and the file is cut to its records when
+  * the log is closed.
+  */
+class TaskLogWriter
+{
+  public:
+
+    /** \brief  Class constructor, writes nothing until open is called. */
+    TaskLogWriter();
+
+    /** \brief  Class destructor, closes the log. */
+    ~TaskLogWriter();
+
+    /** \brief Create the log, replacing any file at the path.
+      *
+      * \input[in] path the log file
+      *
+      * \return false if the file could not be created or mapped
+      */
+    bool
+    open (const std::string &path);
+
+    /** \brief Cut the file to its records and unmap it. */
+    void
+    close ();
+
+    /** \brief Log the start of a task.
+      *
+      * \input[in] task number of the task, 1 to 3
+      * \input[in] request the service request of the task
+      */
+    template <typename Request> void
+    writeTask (int task, const Request &request)
+    {
+      uint32_t length = ros::serialization::serializationLength(request);
+      boost::mutex::scoped_lock lock(mutex_);
+      uint8_t *payload = reserve(sizeof(int32_t) + length);
+      if (not payload)
+        return;
+      int32_t number = task;
+      std::memcpy(payload, &number, sizeof(number));
+      ros::serialization::OStream stream(payload + sizeof(number), length);
+      ros::serialization::serialize(stream, request);
+      commit(LOG_TASK);
+    }
+
+    /** \brief Log a cloud a task used.
+      *
+      * \input[in] cloud the cloud as received from the camera
+      * \input[in] camera_to_world camera pose at the stamp of the cloud
+      */
+    void
+    writeFrame (const sensor_msgs::PointCloud2 &cloud, const Eigen::Isometry3f &camera_to_world);
+
+    /** \brief Log a wait for a cloud that timed out. */
+    void
+    writeNoFrame ();
+
+    /** \brief Log a robot call.
+      *
+      * \input[in] call the call
+      * \input[in] success what the call returned
+      * \input[in] values its outputs, such as joint positions
+      */
+    void
+    writeRobot (RobotCall call, bool success, const std::vector<double> &values);
+
+  private:
+
+    /** \brief Append a record header without its type and make room for
+      * its payload, with mutex_ held.
+      *
+      * \input[in] size size of the payload
+      *
+      * \return the payload, NULL if the log is closed or can not grow
+      */
+    uint8_t *
+    reserve (size_t size);
+
+    /** \brief Set the type of the reserved record once its payload is
+      * written, with mutex_ held.
+      *
+      * \input[in] type kind of the record
+      */
+    void
+    commit (TaskLogType type);
+
+    int fd_;
+    uint8_t *data_;
+    size_t capacity_, used_;
+
+    /** \brief Offset of the record reserve made room for */
+    size_t pending_;
+    boost::mutex mutex_;
+};
+
+/** \brief Reads a log written by TaskLogWriter, one record after the other. */
+class TaskLogReader
+{
+  public:
+
+    /** \brief  Class constructor, reads nothing until open is called. */
+    TaskLogReader();
+
+    /** \brief  Class destructor, unmaps the log. */
+    ~TaskLogReader();
+
+    /** \brief Map a log.
+      *
+      * \input[in] path the log file
+      *
+      * \return false if the file is missing or is not a task log
+      */
+    bool
+    open (const std::string &path);
+
+    /** \brief Kind of the next record, LOG_END past the last one. */
+    TaskLogType
+    peek () const;
+
+    /** \brief Number of records read so far, to locate a divergence. */
+    size_t
+    position () const { return records_; }
+
+    /** \brief Task number of the next record, 0 if it is not a task. */
+    int
+    nextTask () const;
+
+    /** \brief Read the request of the next record, a task.
+      *
+      * \input[out] request the service request of the task
+      *
+      * \return false if the next record is not a task or does not decode
+      */
+    template <typename Request> bool
+    readTask (Request &request)
+    {
+      const uint8_t *payload;
+      size_t size;
+      if (nextTask() == 0 || not take(LOG_TASK, payload, size))
+        return false;
+      try
+      {
+        ros::serialization::IStream stream(const_cast<uint8_t *>(payload) + sizeof(int32_t),
+                                           size - sizeof(int32_t));
+        ros::serialization::deserialize(stream, request);
+      }
+      catch (ros::serialization::StreamOverrunException &)
+      {
+        return false;
+      }
+      return true;
+    }
+
+    /** \brief Read the next record, a cloud.
+      *
+      * \input[out] cloud the cloud
+      * \input[out] camera_to_world camera pose at the stamp of the cloud
+      *
+      * \return false if the next record is not a cloud or does not decode
+      */
+    bool
+    readFrame (sensor_msgs::PointCloud2 &cloud, Eigen::Isometry3f &camera_to_world);
+
+    /** \brief Read the next record, a wait that timed out.
+      *
+      * \return false if the next record is something else
+      */
+    bool
+    readNoFrame ();
+
+    /** \brief Read the next record, a robot call.
+      *
+      * \input[in] call the call expected
+      * \input[out] success what the call returned
+      * \input[out] values its outputs
+      *
+      * \return false if the next record is not that call
+      */
+    bool
+    readRobot (RobotCall call, bool &success, std::vector<double> &values);
+
+  private:
+
+    /** \brief Step over the next record if it is of the given kind. */
+    bool
+    take (TaskLogType type, const uint8_t *&payload, size_t &size);
+
+    const uint8_t *data_;
+    size_t size_, offset_, records_;
+};
+#endif
@@ -0,0 +1,140 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_VOXEL_DOWNSAMPLE_H_
+#define CW3_TEAM_2_VOXEL_DOWNSAMPLE_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/** \brief Voxel grid downsampling split across threads, a drop-in for
+  * pcl::VoxelGrid behind PerceptionPipeline::applyVX and the debug cloud.
+  *
+  * The points are quantised to voxel coordinates, the voxel keys sorted
+  * with a parallel radix sort and each run of equal keys replaced by its
+  * centroid and mean colour. The keys order the voxels by z, then y, then
+  * x, as pcl::VoxelGrid does, and every thread owns a fixed slice of the
+  * points, so the output is the same for any number of threads. The worker
+  * threads and the buffers are kept between calls, a frame of the usual
+  * size neither starts a thread nor allocates.
+  */
+template <typename PointType>
+class VoxelDownsampler
+{
+  public:
+
+    /** \brief  Class constructor, 1 cm voxels on every core. */
+    VoxelDownsampler();
+
+    /** \brief  Class destructor, stops the worker threads. */
+    ~VoxelDownsampler();
+
+    /** \brief Set the edge length of the voxels, in metres. */
+    void
+    setLeafSize (float leaf_size) { leaf_size_ = leaf_size; }
+
+    /** \brief Set the most threads used, 0 for one per core. */
+    void
+    setThreads (int threads) { threads_ = threads; }
+
+    /** \brief Downsample a cloud.
+      *
+      * \input[in] input the cloud, points that are not finite are skipped
+      * \input[out] output one point per occupied voxel, may not be input
+      */
+    void
+    filter (const pcl::PointCloud<PointType> &input,
+            pcl::PointCloud<PointType> &output);
+
+  private:
+
+    /** \brief The steps of filter on slice s of the points. */
+    void
+    filterSlice (int s);
+
+    /** \brief Worker thread running slice s of every call after the given one. */
+    void
+    workerLoop (int s, unsigned long generation);
+
+    float leaf_size_;
+    int threads_;
+
+    /** \brief The call the slices work on, the voxel grid is set by slice 0. */
+    const pcl::PointCloud<PointType> *input_;
+    pcl::PointCloud<PointType> *output_;
+    size_t size_;
+    int slices_;
+    float inv_leaf_;
+    uint64_t dim_x_, dim_xy_, invalid_key_;
+    int passes_;
+    bool too_fine_;
+
+    /** \brief Voxel key and point index of each point, twice for the radix
+      * sort passes. */
+    std::vector<uint64_t> keys_[2];
+    std::vector<uint32_t> order_[2];
+
+    /** \brief Per thread digit counts of a radix pass, then their offsets. */
+    std::vector<uint32_t> histograms_;
+
+    /** \brief Voxel bounds and number of voxels starting in each thread's slice. */
+    std::vector<Eigen::Array4f, Eigen::aligned_allocator<Eigen::Array4f> > slice_min_, slice_max_;
+    std::vector<size_t> slice_voxels_;
+
+    /** \brief Worker threads, started as calls need them, and the barrier of
+      * the current number of slices. */
+    boost::thread_group workers_;
+    int worker_count_;
+    boost::scoped_ptr<boost::barrier> barrier_;
+    int barrier_slices_;
+
+    /** \brief Hands each call to the workers, generation_ counts the calls and
+      * running_ the workers still on the current one. */
+    boost::mutex pool_mutex_;
+    boost::condition_variable start_cond_, done_cond_;
+    unsigned long generation_;
+    int running_;
+    bool stopping_;
+};
+#endif
@@ -0,0 +1,239 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CW3_TEAM_2_WORLD_MODEL_H_
+#define CW3_TEAM_2_WORLD_MODEL_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <geometry_msgs/Point.h>
+#include <ros/time.h>
+#include <std_msgs/ColorRGBA.h>
+
+#include <cw3_team_2/colour_table.h>
+
+/** \brief A cube of the world model. */
+struct ModelCube
+{
+  /** \brief Centroid in the world frame, z of the top for a stack */
+  geometry_msgs::Point position;
+
+  /** \brief Orientation about z and mean colour, 0-1 channels */
+  double yaw;
+  std_msgs::ColorRGBA colour;
+
+  /** \brief Colour class voted by the pixels of the cube, see ColourTable */
+  int colour_class;
+
+  /** \brief Highest point of the cluster, used to tell stacks from cubes */
+  double height;
+
+  /** \brief True once the cube is part of a stack and can not be picked */
+  bool on_stack;
+
+  /** \brief Job holding the cube, -1 if it is free */
+  int reserved_by;
+};
+
+/** \brief Cubes on the front mat, kept between stacking jobs.
+  *
+  * Built from a full scan, then updated as cubes are stacked so a following
+  * job can start without scanning again. A job claims cubes by colour when
+  * it is queued, so the queue never accepts more jobs than the mat has cubes
+  * for, and reserves particular cubes when it runs, so it never picks a cube
+  * another job is stacking. Stacked cubes are never picked again. The job
+  * queue and the task thread use the model at the same time, every call
+  * takes its lock.
+  */
+class WorldModel
+{
+  public:
+
+    /** \brief Function telling if a world point is in the camera view. */
+    typedef boost::function<bool (const geometry_msgs::Point &)> ViewTest;
+
+    /** \brief  Class constructor.
+      *
+      * \input[in] match_distance max xy distance between a cube and its detection, m
+      * \input[in] stack_height clusters with a top higher than this are stacks, m
+      */
+    WorldModel(double match_distance = 0.03, double stack_height = 0.06);
+
+    /** \brief Forget the cubes, the next job scans again. The stacks built
+      * so far are kept, they do not move. */
+    void
+    invalidate ();
+
+    /** \brief Replace the cubes with those of a full scan.
+      *
+      * Clusters at a known stack or taller than a cube are marked as stacks.
+      * Reservations are dropped, so no job may be running. The claims of the
+      * queued jobs are kept, they name colours rather than cubes.
+      *
+      * \input[in] seen cubes of the scan, on_stack and reserved_by are ignored
+      */
+    void
+    rebuild (const std::vector<ModelCube> &seen);
+
+    /** \brief Check if the model holds a scan. */
+    bool
+    valid () const { return valid_; }
+
+    /** \brief Seconds since the last full scan. */
+    double
+    age () const { return (ros::WallTime::now() - stamp_).toSec(); }
+
+    /** \brief Claim free cubes of the given colours for a queued job.
+      *
+      * The cubes must be left over by the claims of the jobs queued before.
+      * Without a scan there is nothing to check against, the claim is kept
+      * and the job finds out when it runs.
+      *
+      * \input[in] job id of the job
+      * \input[in] colour_classes colour classes of the cubes the job needs
+      *
+      * \return false if the scanned cubes can not satisfy the job, nothing
+      * is claimed then
+      */
+    bool
+    claim (int job, const std::vector<int> &colour_classes);
+
+    /** \brief Reserve one free cube for each colour class, in order, in place
+      * of the claim of the job.
+      *
+      * \input[in] job id of the job
+      * \input[in] colour_classes colour classes of the cubes to reserve
+      * \input[out] cube_ids indices of the reserved cubes, one per class
+      *
+      * \return false if a class has no free cube, nothing is reserved then
+      */
+    bool
+    reserve (int job,
+             const std::vector<int> &colour_classes,
+             std::vector<int> &cube_ids);
+
+    /** \brief Free every cube still held or claimed by a job.
+      *
+      * \input[in] job id of the job
+      */
+    void
+    release (int job);
+
+    /** \brief Record that a cube was put on a stack.
+      *
+      * \input[in] cube_id index of the cube
+      * \input[in] stack_point position of the stack, z is ignored
+      */
+    void
+    moveToStack (int cube_id, const geometry_msgs::Point &stack_point);
+
+    /** \brief Compare the clusters of one cloud with the model.
+      *
+      * Every free cube and stack the camera should see must have a cluster
+      * near it, and every cluster must belong to a cube or a stack.
+      *
+      * \input[in] detected cluster centroids in the world frame
+      * \input[in] in_view tells if a model position is in the camera view
+      *
+      * \return true if the cloud shows no change
+      */
+    bool
+    consistentWith (const std::vector<geometry_msgs::Point> &detected,
+                    const ViewTest &in_view) const;
+
+    /** \brief Write the cubes, the stacks and the time of the scan to a file.
+      *
+      * The file is written next to the path and renamed over it, so a crash
+      * while saving leaves the previous snapshot whole.
+      *
+      * \input[in] path the snapshot file
+      *
+      * \return false if the file could not be written
+      */
+    bool
+    save (const std::string &path) const;
+
+    /** \brief Read a snapshot written by save, mapped rather than read.
+      *
+      * The cubes are restored free of reservations. The model is as old as
+      * the scan it came from, so it still has to be checked against the
+      * scene before it is used.
+      *
+      * \input[in] path the snapshot file
+      *
+      * \return false if the file is missing, of another version or truncated,
+      * the model is unchanged then
+      */
+    bool
+    load (const std::string &path);
+
+    /** \brief Cubes of the model, indexed by the ids given by reserve. */
+    const std::vector<ModelCube> &
+    cubes () const { return cubes_; }
+
+  private:
+
+    /** \brief Check if two points are within the match distance in xy. */
+    bool
+    near (const geometry_msgs::Point &a, const geometry_msgs::Point &b) const;
+
+    /** \brief release with mutex_ held. */
+    void
+    releaseLocked (int job);
+
+    /** \brief Check if a point is at a known stack. */
+    bool
+    atStack (const geometry_msgs::Point &p) const;
+
+    double match_distance_, stack_height_;
+
+    std::vector<ModelCube> cubes_;
+
+    /** \brief Positions of the stacks built by the jobs. */
+    std::vector<geometry_msgs::Point> stacks_;
+
+    /** \brief Colour classes claimed by each queued job. */
+    std::map<int, std::vector<int> > claims_;
+
+    mutable boost::mutex mutex_;
+
+    bool valid_;
+    ros::WallTime stamp_;
+};
+#endif
@@ -0,0 +1,166 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/cloud_ingest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+////////////////////////////////////////////////////////////////////////////////
+bool CloudFieldOffsets::find(const sensor_msgs::PointCloud2 &msg)
+{
+  /* Looks the fields up by name, the r200 driver publishes rgb while PCL
+     publishes rgba, either gives the same packed colour */
+
+  int found = 0;
+  for (size_t i = 0; i < msg.fields.size(); i++)
+  {
+    const sensor_msgs::PointField &field = msg.fields[i];
+    if (field.count != 1 || (field.datatype != sensor_msgs::PointField::FLOAT32 &&
+                             field.datatype != sensor_msgs::PointField::UINT32))
+      continue;
+
+    if (field.name == "x")
+      x = field.offset, found |= 1;
+    else if (field.name == "y")
+      y = field.offset, found |= 2;
+    else if (field.name == "z")
+      z = field.offset, found |= 4;
+    else if (field.name == "rgb" || field.name == "rgba")
+      rgb = field.offset, found |= 8;
+  }
+
+  return found == 15;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ingestCloud(const sensor_msgs::PointCloud2 &msg,
+                 float max_depth,
+                 std::vector<CompactPoint> &out,
+                 const Eigen::AlignedBox3f *roi)
+{
+  /* Walks the rows of the buffer once, keeping only the points that would
+     survive the floor filter */
+
+  out.clear();
+
+  // A region of interest only narrows the depth range and adds the x, y tests
+  if (roi != NULL)
+    max_depth = std::min(max_depth, roi->max().z());
+
+  CloudFieldOffsets offsets;
+  if (msg.is_bigendian || not offsets.find(msg))
+    return false;
+  if (msg.width == 0 || msg.height == 0)
+    return true;
+
+  // Every field inside a point and every row inside the buffer, a malformed
+  // message is refused rather than read past its end
+  uint32_t last_field = std::max(std::max(offsets.x, offsets.y), std::max(offsets.z, offsets.rgb));
+  uint64_t row_size = static_cast<uint64_t>(msg.width) * msg.point_step;
+  if (static_cast<uint64_t>(last_field) + 4 > msg.point_step ||
+      (msg.height > 1 && row_size > msg.row_step) ||
+      static_cast<uint64_t>(msg.height - 1) * msg.row_step + row_size > msg.data.size())
+    return false;
+
+  CompactPoint pt;
+  for (uint32_t row = 0; row < msg.height; row++)
+  {
+    const uint8_t *point = &msg.data[0] + row * msg.row_step;
+    const uint8_t *row_end = point + msg.width * msg.point_step;
+
+    for (; point < row_end; point += msg.point_step)
+    {
+      memcpy(&pt.z, point + offsets.z, sizeof(float));
+
+      // NaN compares false, so this also drops the missing returns
+      if (not (pt.z < max_depth))
+        continue;
+
+      memcpy(&pt.x, point + offsets.x, sizeof(float));
+      memcpy(&pt.y, point + offsets.y, sizeof(float));
+      if (not std::isfinite(pt.x) || not std::isfinite(pt.y))
+        continue;
+
+      if (roi != NULL && (pt.x < roi->min().x() || pt.x > roi->max().x() ||
+                          pt.y < roi->min().y() || pt.y > roi->max().y() ||
+                          pt.z < roi->min().z()))
+        continue;
+
+      memcpy(&pt.rgba, point + offsets.rgb, sizeof(uint32_t));
+      out.push_back(pt);
+    }
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void compactToCloud(const std::vector<CompactPoint> &in,
+                    pcl::PointCloud<pcl::PointXYZRGBA> &out)
+{
+  out.points.resize(in.size());
+  for (size_t i = 0; i < in.size(); i++)
+  {
+    pcl::PointXYZRGBA &pt = out.points[i];
+    pt.x = in[i].x;
+    pt.y = in[i].y;
+    pt.z = in[i].z;
+    pt.data[3] = 1.0f;
+    pt.rgba = in[i].rgba;
+  }
+  out.width = out.points.size();
+  out.height = 1;
+  out.is_dense = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void compactToCloud(const std::vector<CompactPoint> &in,
+                    pcl::PointCloud<pcl::PointXYZ> &out)
+{
+  out.points.resize(in.size());
+  for (size_t i = 0; i < in.size(); i++)
+  {
+    pcl::PointXYZ &pt = out.points[i];
+    pt.x = in[i].x;
+    pt.y = in[i].y;
+    pt.z = in[i].z;
+    pt.data[3] = 1.0f;
+  }
+  out.width = out.points.size();
+  out.height = 1;
+  out.is_dense = true;
+}
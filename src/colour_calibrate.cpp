@@ -0,0 +1,124 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Builds the colour lookup table of the node from labelled samples.
+ *
+ *   rosrun cw3_team_2 cw3_team_2_colour_calibrate samples.txt colours.lut [max_distance]
+ *
+ * Each line of the sample file is "r g b class", 0-255 channels and one of
+ * red, blue, purple or black, for example points cropped from recorded clouds
+ * of cubes of known colour. Lines starting with # are skipped. The table is
+ * loaded by the node from the colour_table parameter.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cw3_team_2/colour_table.h>
+
+////////////////////////////////////////////////////////////////////////////////
+int
+main (int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    std::cerr << "usage: " << argv[0] << " samples.txt colours.lut [max_distance]" << std::endl;
+    return 1;
+  }
+
+  std::ifstream file(argv[1]);
+  if (not file)
+  {
+    std::cerr << "Cannot read " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::vector<ColourSample> samples;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line))
+  {
+    line_number++;
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    int r, g, b;
+    std::string name;
+    if (not (fields >> r >> g >> b >> name) || r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255)
+    {
+      std::cerr << argv[1] << ":" << line_number << ": expected \"r g b class\"" << std::endl;
+      return 1;
+    }
+
+    ColourSample sample;
+    sample.r = r;
+    sample.g = g;
+    sample.b = b;
+    sample.colour_class = COLOUR_UNKNOWN;
+    for (int c = COLOUR_UNKNOWN + 1; c < NUM_COLOUR_CLASSES; c++)
+      if (name == ColourTable::name(c))
+        sample.colour_class = c;
+
+    if (sample.colour_class == COLOUR_UNKNOWN)
+    {
+      std::cerr << argv[1] << ":" << line_number << ": unknown class " << name << std::endl;
+      return 1;
+    }
+    samples.push_back(sample);
+  }
+
+  double max_distance = (argc > 3) ? std::atof(argv[3]) : 20.0;
+
+  ColourTable table;
+  if (not table.calibrate(samples, max_distance))
+  {
+    std::cerr << "Every class needs at least one sample" << std::endl;
+    return 1;
+  }
+
+  if (not table.save(argv[2]))
+  {
+    std::cerr << "Cannot write " << argv[2] << std::endl;
+    return 1;
+  }
+
+  std::cout << "Table written to " << argv[2] << " from " << samples.size() << " samples" << std::endl;
+  return 0;
+}
@@ -0,0 +1,316 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/colour_table.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+  /** \brief Spawner colours of the classes, 0-255, as in the synthetic scene */
+  const uint8_t kPrototypes[NUM_COLOUR_CLASSES][3] = {{0, 0, 0},
+                                                       {204, 26, 26},
+                                                       {26, 26, 204},
+                                                       {204, 26, 204},
+                                                       {20, 20, 20}};
+
+  const char *const kNames[NUM_COLOUR_CLASSES] = {"unknown", "red", "blue", "purple", "black"};
+
+  /** \brief Distance past which a cell is unknown, with the spawner colours */
+  const double kDefaultMaxDistance = 20.0;
+
+  /** \brief Header of a table file */
+  const char kMagic[4] = {'C', 'W', 'L', 'T'};
+  const uint32_t kVersion = 1;
+
+  double
+  linearise (double c)
+  {
+    c /= 255.0;
+    return (c <= 0.04045) ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+  }
+
+  double
+  labCurve (double t)
+  {
+    return (t > 0.008856) ? std::cbrt(t) : (7.787 * t + 16.0 / 116.0);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void rgbToLab(double r, double g, double b, double lab[3])
+{
+  double rl = linearise(r), gl = linearise(g), bl = linearise(b);
+
+  // sRGB to XYZ, normalised by the D65 white point
+  double x = (0.4124 * rl + 0.3576 * gl + 0.1805 * bl) / 0.95047;
+  double y = (0.2126 * rl + 0.7152 * gl + 0.0722 * bl);
+  double z = (0.0193 * rl + 0.1192 * gl + 0.9505 * bl) / 1.08883;
+
+  double fx = labCurve(x), fy = labCurve(y), fz = labCurve(z);
+  lab[0] = 116.0 * fy - 16.0;
+  lab[1] = 500.0 * (fx - fy);
+  lab[2] = 200.0 * (fy - fz);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ColourHistogram::clear()
+{
+  std::fill(counts, counts + NUM_COLOUR_CLASSES, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ColourHistogram::add(const ColourHistogram &other)
+{
+  for (int c = 0; c < NUM_COLOUR_CLASSES; c++)
+    counts[c] += other.counts[c];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int ColourHistogram::total() const
+{
+  int sum = 0;
+  for (int c = 0; c < NUM_COLOUR_CLASSES; c++)
+    sum += counts[c];
+  return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int ColourHistogram::majority(double min_share) const
+{
+  /* Unknown points are edges and highlights, they do not vote */
+
+  int best = COLOUR_UNKNOWN;
+  int classified = 0;
+  for (int c = COLOUR_UNKNOWN + 1; c < NUM_COLOUR_CLASSES; c++)
+  {
+    classified += counts[c];
+    if (counts[c] > counts[best] || best == COLOUR_UNKNOWN)
+      best = c;
+  }
+
+  if (classified == 0 || counts[best] < min_share * classified)
+    return COLOUR_UNKNOWN;
+
+  return best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ColourTable::ColourTable() : table_(kBins * kBins * kBins, COLOUR_UNKNOWN)
+{
+  useDefaults();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ColourTable::useDefaults()
+{
+  /* The spawner colours as the camera sees them on faces from fully lit to
+     shaded */
+
+  std::vector<ColourSample> samples;
+  for (int c = COLOUR_UNKNOWN + 1; c < NUM_COLOUR_CLASSES; c++)
+    for (double shade = 0.4; shade < 1.25; shade += 0.1)
+    {
+      ColourSample sample;
+      sample.r = std::min(255.0, kPrototypes[c][0] * shade);
+      sample.g = std::min(255.0, kPrototypes[c][1] * shade);
+      sample.b = std::min(255.0, kPrototypes[c][2] * shade);
+      sample.colour_class = c;
+      samples.push_back(sample);
+    }
+
+  calibrate(samples, kDefaultMaxDistance);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ColourTable::calibrate(const std::vector<ColourSample> &samples, double max_distance)
+{
+  /* Each cell holding samples takes the class most of them have. Every other
+     cell takes the class of the nearest such cell in Lab, where distances
+     follow what the eye sees better than in rgb */
+
+  const int cells = kBins * kBins * kBins;
+  std::vector<int> votes(cells * NUM_COLOUR_CLASSES, 0);
+
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    int c = samples[i].colour_class;
+    if (c <= COLOUR_UNKNOWN || c >= NUM_COLOUR_CLASSES)
+      continue;
+    votes[cellOf(samples[i].r, samples[i].g, samples[i].b) * NUM_COLOUR_CLASSES + c]++;
+  }
+
+  std::vector<int> seed_cells, seed_classes;
+  bool seen[NUM_COLOUR_CLASSES] = {};
+  for (int cell = 0; cell < cells; cell++)
+  {
+    const int *cell_votes = &votes[cell * NUM_COLOUR_CLASSES];
+    int best = std::max_element(cell_votes, cell_votes + NUM_COLOUR_CLASSES) - cell_votes;
+    if (cell_votes[best] == 0)
+      continue;
+
+    seed_cells.push_back(cell);
+    seed_classes.push_back(best);
+    seen[best] = true;
+  }
+
+  for (int c = COLOUR_UNKNOWN + 1; c < NUM_COLOUR_CLASSES; c++)
+    if (not seen[c])
+      return false;
+
+  // Lab of the centre of every cell
+  const int step = 1 << (8 - kBits);
+  std::vector<float> lab(cells * 3);
+  for (int cell = 0; cell < cells; cell++)
+  {
+    double centre[3];
+    rgbToLab(((cell >> (2 * kBits)) & (kBins - 1)) * step + step / 2,
+             ((cell >> kBits) & (kBins - 1)) * step + step / 2,
+             (cell & (kBins - 1)) * step + step / 2, centre);
+    std::copy(centre, centre + 3, &lab[cell * 3]);
+  }
+
+  double max_distance_sq = max_distance * max_distance;
+  for (int cell = 0; cell < cells; cell++)
+  {
+    const float *p = &lab[cell * 3];
+
+    int best = COLOUR_UNKNOWN;
+    double best_distance_sq = max_distance_sq;
+    for (size_t s = 0; s < seed_cells.size(); s++)
+    {
+      const float *q = &lab[seed_cells[s] * 3];
+      double distance_sq = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) +
+                           (p[2] - q[2]) * (p[2] - q[2]);
+      if (distance_sq < best_distance_sq)
+      {
+        best = seed_classes[s];
+        best_distance_sq = distance_sq;
+      }
+    }
+
+    table_[cell] = best;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ColourTable::load(const std::string &path)
+{
+  /* Magic, version, cells along an axis, number of classes, then one class
+     byte per cell, r major */
+
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (not file)
+    return false;
+
+  char magic[4];
+  uint32_t version, bins, classes;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char *>(&version), sizeof(version));
+  file.read(reinterpret_cast<char *>(&bins), sizeof(bins));
+  file.read(reinterpret_cast<char *>(&classes), sizeof(classes));
+  if (not file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || version != kVersion ||
+      bins != kBins || classes != NUM_COLOUR_CLASSES)
+    return false;
+
+  std::vector<uint8_t> table(table_.size());
+  file.read(reinterpret_cast<char *>(table.data()), table.size());
+  if (not file)
+    return false;
+
+  for (size_t i = 0; i < table.size(); i++)
+    if (table[i] >= NUM_COLOUR_CLASSES)
+      return false;
+
+  table_.swap(table);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ColourTable::save(const std::string &path) const
+{
+  std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (not file)
+    return false;
+
+  uint32_t version = kVersion, bins = kBins, classes = NUM_COLOUR_CLASSES;
+  file.write(kMagic, sizeof(kMagic));
+  file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  file.write(reinterpret_cast<const char *>(&bins), sizeof(bins));
+  file.write(reinterpret_cast<const char *>(&classes), sizeof(classes));
+  file.write(reinterpret_cast<const char *>(table_.data()), table_.size());
+
+  return static_cast<bool>(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int ColourTable::classify(double r, double g, double b) const
+{
+  if (std::isnan(r) || std::isnan(g) || std::isnan(b))
+    return COLOUR_UNKNOWN;
+
+  r = std::min(std::max(r, 0.0), 1.0);
+  g = std::min(std::max(g, 0.0), 1.0);
+  b = std::min(std::max(b, 0.0), 1.0);
+
+  return lookup(static_cast<uint8_t>(r * 255.0 + 0.5),
+                static_cast<uint8_t>(g * 255.0 + 0.5),
+                static_cast<uint8_t>(b * 255.0 + 0.5));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ColourTable::prototype(int colour_class, double &r, double &g, double &b)
+{
+  if (colour_class <= COLOUR_UNKNOWN || colour_class >= NUM_COLOUR_CLASSES)
+    colour_class = COLOUR_UNKNOWN;
+
+  r = kPrototypes[colour_class][0] / 255.0;
+  g = kPrototypes[colour_class][1] / 255.0;
+  b = kPrototypes[colour_class][2] / 255.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const char *ColourTable::name(int colour_class)
+{
+  if (colour_class <= COLOUR_UNKNOWN || colour_class >= NUM_COLOUR_CLASSES)
+    return kNames[COLOUR_UNKNOWN];
+
+  return kNames[colour_class];
+}
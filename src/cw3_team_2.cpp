@@ -33,39 +33,148 @@
  */
 
 #include <cw3_team_2/cw3_team_2.h>
+#include <cw3_team_2/moveit_robot.h>
+#include <cw3_team_2/recorded_robot.h>
 
-typedef pcl::PointXYZRGBA PointT;
-typedef pcl::PointCloud<PointT> PointC;
-typedef PointC::Ptr PointCPtr;
+////////////////////////////////////////////////////////////////////////////////
+Cw3Solution::Cw3Solution(ros::NodeHandle &nh) : Cw3Solution(nh, boost::shared_ptr<RobotInterface>(new MoveItRobot))
+{
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-Cw3Solution::Cw3Solution(ros::NodeHandle &nh) : g_cloud_ptr(new PointC),                            // input point cloud
-                                                g_cloud_filtered(new PointC),                       // filtered point cloud
-                                                g_cloud_filtered2(new PointC),                      // filtered point cloud
-                                                g_cloud_plane(new PointC),                          // plane point cloud
-                                                g_tree_ptr(new pcl::search::KdTree<PointT>()),      // KdTree
-                                                g_cloud_normals(new pcl::PointCloud<pcl::Normal>),  // segmentation
-                                                g_cloud_normals2(new pcl::PointCloud<pcl::Normal>), // segmentation
-                                                g_inliers_plane(new pcl::PointIndices),             // plane seg
-                                                g_coeff_plane(new pcl::ModelCoefficients),          // plane coeff
-                                                debug_(false)
+Cw3Solution::Cw3Solution(ros::NodeHandle &nh,
+                         boost::shared_ptr<RobotInterface> robot) : robot_(robot),
+                                                                    g_processed_frames(0),
+                                                                    g_consumed_frames(0),
+                                                                    g_occupancy_integrating(false),
+                                                                    g_occupancy_active(false),
+                                                                    g_inspect_active(false),
+                                                                    g_verify_active(false),
+                                                                    g_cancel_requested(false),
+                                                                    g_cubes_placed(0),
+                                                                    debug_(false)
 {
   g_nh = nh;
 
-  // Define the publishers
-  g_pub_cloud = g_nh.advertise<sensor_msgs::PointCloud2>("filtered_cloud", 1, true);
-  g_pub_pose = g_nh.advertise<geometry_msgs::PointStamped>("cube_pt", 1, true);
+  // 16 byte points through every filter and the KD-tree, the colours are
+  // only read for the points of the clusters
+  bool compact_points;
+  g_nh.param("compact_points", compact_points, true);
+  if (compact_points)
+  {
+    g_perception_compact.reset(new PerceptionPipeline<CompactPointT>);
+    g_perception = g_perception_compact.get();
+  }
+  else
+  {
+    g_perception_full.reset(new PerceptionPipeline<PointT>);
+    g_perception = g_perception_full.get();
+  }
+
+  // Debug topics, only filled while somebody subscribes and at most at debug_rate
+  double debug_rate, debug_leaf_size;
+  g_nh.param("debug_rate", debug_rate, 2.0);
+  g_nh.param("debug_leaf_size", debug_leaf_size, 0.005);
+  g_debug.advertise(g_nh, debug_rate, debug_leaf_size);
+
+  // The clusters of every processed cloud in one message
+  g_pub_detections = g_nh.advertise<cw3_team_2::CubeDetectionArray>("cube_detections", 10);
+
+  // Registered once, the callback and the tasks only touch atomics after this
+  MetricsRegistry &metrics = MetricsRegistry::instance();
+  g_frames_processed_metric = &metrics.counter("cw3_frames_processed_total", "Point clouds processed");
+  g_frames_unsettled_metric = &metrics.counter("cw3_frames_dropped_total", "Point clouds dropped", "reason=\"unsettled\"");
+  g_frames_stale_metric = &metrics.counter("cw3_frames_dropped_total", "Point clouds dropped", "reason=\"stale\"");
+  g_frames_transform_metric = &metrics.counter("cw3_frames_dropped_total", "Point clouds dropped", "reason=\"transform\"");
+  g_frames_format_metric = &metrics.counter("cw3_frames_dropped_total", "Point clouds dropped", "reason=\"format\"");
+  g_ingest_metric = &metrics.histogram("cw3_perception_stage_seconds", "Time of a perception stage", "stage=\"ingest\"");
+  g_segment_metric = &metrics.histogram("cw3_perception_stage_seconds", "Time of a perception stage", "stage=\"segment\"");
+  g_clusters_metric = &metrics.histogram("cw3_perception_stage_seconds", "Time of a perception stage", "stage=\"clusters\"");
+  g_scene_update_metric = &metrics.histogram("cw3_scene_update_seconds", "Time to send the obstacles to the planning scene");
+  g_picks_attempted_metric = &metrics.counter("cw3_picks_attempted_total", "Picks started");
+  g_picks_succeeded_metric = &metrics.counter("cw3_picks_succeeded_total", "Picks that ended holding a cube");
+  g_cubes_placed_metric = &metrics.counter("cw3_cubes_placed_total", "Cubes put on a stack");
+  g_stacks_confirmed_metric = &metrics.counter("cw3_stack_checks_total", "Stacks checked with the camera", "result=\"confirmed\"");
+  g_stacks_mismatched_metric = &metrics.counter("cw3_stack_checks_total", "Stacks checked with the camera", "result=\"mismatch\"");
+  g_stacks_unseen_metric = &metrics.counter("cw3_stack_checks_total", "Stacks checked with the camera", "result=\"unseen\"");
+  g_frame_timeouts_metric = &metrics.counter("cw3_frame_wait_timeouts_total", "Waits for a settled point cloud that timed out");
+  g_cubes_per_minute_metric = &metrics.gauge("cw3_cubes_per_minute", "Cubes stacked per minute by the current or last run");
+
+  // Prometheus endpoint on localhost, 0 turns it off
+  int metrics_port;
+  g_nh.param("metrics_port", metrics_port, 9102);
+  if (metrics_port > 0)
+  {
+    g_metrics_server.reset(new MetricsServer(metrics));
+    if (not g_metrics_server->start(metrics_port))
+    {
+      ROS_WARN("Cannot serve metrics on port %d", metrics_port);
+      g_metrics_server.reset();
+    }
+  }
 
   // Initialize public variables
-  g_vg_leaf_sz = 0.01;
   g_x_thrs_min = -0.7;
   g_x_thrs_max = -0.5;
   g_y_thrs_min = 0.0;
   g_y_thrs_max = 0.4;
-  g_cf_red = 25.5;
-  g_cf_blue = 204;
-  g_cf_green = 25.5;
-  g_k_nn = 50;
+  g_tf_timeout = 0.1;
+  g_max_cloud_age = 0.5;
+  g_settled_frame_timeout = 3.0;
+  g_grasp_min_width = 0.01;
+  g_world_model_max_age = 600.0;
+  g_wrist_weight = 1.0;
+  g_max_regrasps = 2;
+
+  // Simulated finger controllers report little effort, so it is off by default
+  g_nh.param("grasp_min_effort", g_grasp_min_effort, 0.0);
+
+  // Motions between a pick and a place do not stop at the via-points
+  g_nh.param("blend_motions", g_blend_motions, true);
+
+  // Colour table written by cw3_team_2_colour_calibrate, the spawner colours without one
+  std::string colour_table;
+  g_nh.param("colour_table", colour_table, std::string(""));
+  if (not colour_table.empty() && not g_perception->g_colour_table.load(colour_table))
+    ROS_ERROR("Cannot load the colour table %s, using the spawner colours", colour_table.c_str());
+
+  // The world model of the last run, checked against one cloud before the first job uses it
+  g_nh.param("world_snapshot", g_world_snapshot, std::string(""));
+  if (not g_world_snapshot.empty() && g_world_model.load(g_world_snapshot))
+    ROS_INFO("Restored %zu cubes scanned %.1f s ago", g_world_model.cubes().size(), g_world_model.age());
+
+  // Frames averaged at each scan pose, 1 keeps the single frame behaviour
+  g_nh.param("scan_frames", g_scan_frames, 1);
+  if (g_scan_frames < 1)
+    g_scan_frames = 1;
+  g_camera_to_world.setIdentity();
+  g_world_to_camera.setIdentity();
+  g_frame_world_to_camera.setIdentity();
+  g_frame_camera_to_world.setIdentity();
+
+  // Every input of the tasks logged for cw3_team_2_task_replay, empty records nothing
+  std::string record_log;
+  g_nh.param("record_log", record_log, std::string(""));
+  if (not record_log.empty())
+  {
+    g_task_recorder.reset(new TaskLogWriter);
+    if (g_task_recorder->open(record_log))
+    {
+      robot_.reset(new RecordingRobot(robot_, g_task_recorder));
+      ROS_INFO("Recording the tasks to %s", record_log.c_str());
+    }
+    else
+    {
+      ROS_ERROR("Cannot create the task log %s, tasks are not recorded", record_log.c_str());
+      g_task_recorder.reset();
+    }
+  }
+
+  // The robot is connected by now, its planners load while the node waits for a task
+  bool warm_up;
+  g_nh.param("warm_up", warm_up, true);
+  if (warm_up)
+    warmUpPlanners();
 
   // namespace for our ROS services, they will appear as "/namespace/srv_name"
   std::string service_ns = "/cw3_team_2";
@@ -84,17 +193,40 @@ Cw3Solution::Cw3Solution(ros::NodeHandle &nh) : g_cloud_ptr(new PointC),
   // Create a ROS subscriber for the input point cloud
   g_sub_cloud = g_nh.subscribe("/r200/camera/depth_registered/points", 1,
                                &Cw3Solution::cloudCallBackOne, this);
+
+  // Arm motion, used to drop clouds captured before the arm settled
+  g_sub_joint_states = g_nh.subscribe("/joint_states", 10,
+                                      &Cw3Solution::jointStateCallback, this);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Cw3Solution::task1Callback(cw3_world_spawner::Task1Service::Request &request,
                                 cw3_world_spawner::Task1Service::Response &response)
+{
+  // One task at a time, whether started by a service or an action
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not beginTask(task_lock))
+  {
+    ROS_ERROR("Task 1 rejected, another task is running");
+    return false;
+  }
+
+  return runTask1(request, response);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::runTask1(cw3_world_spawner::Task1Service::Request &request,
+                           cw3_world_spawner::Task1Service::Response &response)
 {
   /* This service scans the environment and finds the pose of the stack of cubes.
      After getting the stack of cubes, the colour of each of the cubes are obtained.
   */
 
+  if (g_task_recorder)
+    g_task_recorder->writeTask(1, request);
+
   // clearing the list that store centroids of any previous centroid values from global variables
   clearPreviousScanData();
 
@@ -104,7 +236,9 @@ bool Cw3Solution::task1Callback(cw3_world_spawner::Task1Service::Request &reques
   g_check_objects_stack = true;
 
   // This function scans a predefined region and stores essential data from the scan in respective global variables.
-  scanFrontMat();
+  reportProgress("scanning");
+  if (not scanFrontMat() || g_cancel_requested)
+    return false;
 
   // FINDING ORIENTATION of the first centroid found (as only one object present in the environment)
   yaw = atan2(((clusters_max[0].x) - (clusters_max_y_x[0])), ((clusters_max[0].y) - (clusters_max_x_y[0])));
@@ -114,15 +248,8 @@ bool Cw3Solution::task1Callback(cw3_world_spawner::Task1Service::Request &reques
   stack_index = 0;
   g_number_of_cubes_in_recorded_stack = g_number_of_cubes_in_stack;
 
-  // Initializing color array and cube pixel counter, used to find an average rgb value for each cube
-  for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
-  {
-    g_Color.r = 0.0;
-    g_Color.g = 0.0;
-    g_Color.b = 0.0;
-    g_current_stack_colours.push_back(g_Color);
-    g_current_stack_cube_color_count.push_back(0);
-  }
+  // Initializing color array, cube pixel counter and colour class histogram of each cube in the stack
+  resetStackColours();
 
   geometry_msgs::Pose check_col;
   check_col.position = centroids[0].point;
@@ -142,19 +269,29 @@ bool Cw3Solution::task1Callback(cw3_world_spawner::Task1Service::Request &reques
 
   check_col.orientation = check_orientation;
 
-  moveArm(check_col);
+  reportProgress("reading stack");
+  beginInspection(centroids[0].point, g_number_of_cubes_in_recorded_stack);
+  moveArm(check_col, MOTION_SCAN);
 
-  g_sub_cloud;
+  // The stack colours are summed by the clouds processed at this pose
+  if (not waitForSettledFrame(g_settled_frame_timeout))
+    ROS_WARN("No settled point cloud of the stack");
+  endInspection();
 
-  // If a stack is found, find the average RGB values for each cube
-  if (g_number_of_cubes_in_recorded_stack > 0)
+  // If a stack is found, find the colour class of each cube, the spawner colour of
+  // that class is reported, the average RGB value when no class holds most points
+  std::vector<int> stack_classes;
+  finishStackColours(stack_classes);
+  for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
   {
-    for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
-    {
-      g_current_stack_colours[i].r = ((g_current_stack_colours[i].r) / (g_current_stack_cube_color_count[i])) / 255;
-      g_current_stack_colours[i].g = ((g_current_stack_colours[i].g) / (g_current_stack_cube_color_count[i])) / 255;
-      g_current_stack_colours[i].b = ((g_current_stack_colours[i].b) / (g_current_stack_cube_color_count[i])) / 255;
-    }
+    if (stack_classes[i] == COLOUR_UNKNOWN)
+      continue;
+
+    double r, g, b;
+    ColourTable::prototype(stack_classes[i], r, g, b);
+    g_current_stack_colours[i].r = r;
+    g_current_stack_colours[i].g = g;
+    g_current_stack_colours[i].b = b;
   }
   g_check_objects_stack = false;
 
@@ -176,6 +313,22 @@ bool Cw3Solution::task1Callback(cw3_world_spawner::Task1Service::Request &reques
 bool Cw3Solution::task2Callback(cw3_world_spawner::Task2Service::Request &request,
                                 cw3_world_spawner::Task2Service::Response &response)
 {
+  // One task at a time, whether started by a service or an action
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not beginTask(task_lock))
+  {
+    ROS_ERROR("Task 2 rejected, another task is running");
+    return false;
+  }
+
+  return runTask2(request, response);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::runTask2(cw3_world_spawner::Task2Service::Request &request,
+                           cw3_world_spawner::Task2Service::Response &response)
+{
 
   /* This service scans the environment and stores the centroids of the cubes
       to be picked within scan area. Then gets the stack colours, and pose
@@ -184,45 +337,17 @@ bool Cw3Solution::task2Callback(cw3_world_spawner::Task2Service::Request &reques
 
   */
 
-  // clearing the list that store centroids of any previous centroid values from global variables
-  clearPreviousScanData();
-
-  g_check_objects_floor = true;
-
-  int size = 0; // initialise variable to store number of centroids
-
-  scanFrontMat();
-
-  size = centroids.size();
-  g_size = size;
-
-  // Initialise vector to store the orientation of all cubes
-  for (int i = 0; i < g_size; i++)
-  {
-    g_yaw_list.push_back(0);
-  }
-
-  g_oldcentroids = centroids;
-
-  for (int i = 0; i < g_size; i++)
-  {
-    // finding the accurate value for the centroid to the nearest second half decimal for accurate value.
-    g_oldcentroids[i].point.x = floor(((g_oldcentroids[i].point.x) * 20) + 0.5) / 20;
-    g_oldcentroids[i].point.y = floor(((g_oldcentroids[i].point.y) * 20) + 0.5) / 20;
+  if (g_task_recorder)
+    g_task_recorder->writeTask(2, request);
 
-    // FINDING ORIENTATION AND STORING IN LIST:
-    g_yaw_list[i] = atan2(((clusters_max[i].x) - (clusters_max_y_x[i])), ((clusters_max[i].y) - (clusters_max_x_y[i])));
-  }
+  // The cubes moved by this task are not tracked by the job world model
+  g_world_model.invalidate();
+  saveWorldSnapshot();
 
-  g_check_objects_floor = false;
+  if (not scanFrontMatCubes())
+    return false;
 
-  // calculating the average RGB values for each of the cubes found and approximating to the nearest 2 dp
-  for (int i = 0; i < g_size; i++)
-  {
-    colors[i].r = ceil(((colors[i].r) / (colors_count[i])) / 255 * 10) / 10;
-    colors[i].g = ceil(((colors[i].g) / (colors_count[i])) / 255 * 10) / 10;
-    colors[i].b = ceil(((colors[i].b) / (colors_count[i])) / 255 * 10) / 10;
-  }
+  int size = g_size;
 
   std::vector<std_msgs::ColorRGBA> list_of_colours;
 
@@ -239,12 +364,16 @@ bool Cw3Solution::task2Callback(cw3_world_spawner::Task2Service::Request &reques
     g_index_of_cubes_to_stack.push_back(0);
   }
 
-  // Finding the first cube which matches, using a threshold, the colour required and storing it in a vector if it has not been stored already.
+  // Finding the first cube of the colour class required and storing it in a vector if it has not been stored already.
   for (int i = 0; i < g_num_of_cubes_to_stack; i++)
   {
+    int colour_class = g_perception->g_colour_table.classify(list_of_colours[i].r, list_of_colours[i].g, list_of_colours[i].b);
+    if (colour_class == COLOUR_UNKNOWN)
+      ROS_WARN("Requested colour %d is not one of the cube colours", i);
+
     for (int j = 0; j < size; j++)
     {
-      if (abs(list_of_colours[i].r - colors[j].r) <= 0.3 && abs(list_of_colours[i].g - colors[j].g) <= 0.3 && abs(list_of_colours[i].b - colors[j].b) <= 0.3)
+      if ((colour_class != COLOUR_UNKNOWN) && (colour_classes[j] == colour_class))
       {
         if (std::find(g_index_of_cubes_to_stack.begin(), g_index_of_cubes_to_stack.end(), j) != g_index_of_cubes_to_stack.end() && g_index_of_cubes_to_stack.size() > 0)
         {
@@ -273,6 +402,8 @@ bool Cw3Solution::task2Callback(cw3_world_spawner::Task2Service::Request &reques
     ROS_ERROR("Task 2 Pick and Place Failed");
     return false;
   }
+
+  return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -280,6 +411,22 @@ bool Cw3Solution::task2Callback(cw3_world_spawner::Task2Service::Request &reques
 bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &request,
                                 cw3_world_spawner::Task3Service::Response &response)
 {
+  // One task at a time, whether started by a service or an action
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not beginTask(task_lock))
+  {
+    ROS_ERROR("Task 3 rejected, another task is running");
+    return false;
+  }
+
+  return runTask3(request, response);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::runTask3(cw3_world_spawner::Task3Service::Request &request,
+                           cw3_world_spawner::Task3Service::Response &response)
+{
 
   /* This service scans the entire environment and stores the centroids of the cubes
       to be picked within scan area based on the colours from a stack of cubes. Then gets the stack colours, and pose
@@ -288,11 +435,29 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
 
   */
 
+  if (g_task_recorder)
+    g_task_recorder->writeTask(3, request);
+
   // clearing the list that store centroids of any previous centroid values from global variables
   clearPreviousScanData();
 
+  // The cubes moved by this task are not tracked by the job world model
+  g_world_model.invalidate();
+  saveWorldSnapshot();
+
+  // Obstacles are taken from what the camera sees during the scans
+  g_occupancy.clear();
+  g_occupancy_active = true;
+  g_occupancy_integrating = true;
+
   // Scan the entire mat and store the centroids present
-  scanEntireMat();
+  reportProgress("scanning");
+  if (not scanEntireMat() || g_cancel_requested)
+  {
+    g_occupancy_integrating = false;
+    g_occupancy_active = false;
+    return false;
+  }
 
   int size = centroids.size();
   g_size = size;
@@ -308,9 +473,13 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
   for (int i = 0; i < g_size; i++)
   {
 
-    // finding the accurate value for the centroid to the nearest second half decimal for accurate value.
-    g_oldcentroids[i].point.x = floor(((g_oldcentroids[i].point.x) * 20) + 0.5) / 20;
-    g_oldcentroids[i].point.y = floor(((g_oldcentroids[i].point.y) * 20) + 0.5) / 20;
+    // finding the accurate value for the centroid to the nearest second half decimal for accurate value,
+    // not needed when the centroids are averaged over several frames
+    if (g_scan_frames <= 1)
+    {
+      g_oldcentroids[i].point.x = floor(((g_oldcentroids[i].point.x) * 20) + 0.5) / 20;
+      g_oldcentroids[i].point.y = floor(((g_oldcentroids[i].point.y) * 20) + 0.5) / 20;
+    }
 
     // FINDING ORIENTATION AND STORING IN LIST:
     g_yaw_list[i] = atan2(((clusters_max[i].x) - (clusters_max_y_x[i])), ((clusters_max[i].y) - (clusters_max_x_y[i])));
@@ -318,37 +487,18 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
 
   g_check_objects_floor = false;
 
-  // Compute the colours of the cube and add collision objects to them.
+  // Compute the colours of the cubes and find the obstacles.
   for (int i = 0; i < g_size; i++)
   {
-    colors[i].r = ceil(((colors[i].r) / (colors_count[i])) / 255 * 10) / 10;
-    colors[i].g = ceil(((colors[i].g) / (colors_count[i])) / 255 * 10) / 10;
-    colors[i].b = ceil(((colors[i].b) / (colors_count[i])) / 255 * 10) / 10;
+    colors[i].r = ((colors[i].r) / (colors_count[i])) / 255;
+    colors[i].g = ((colors[i].g) / (colors_count[i])) / 255;
+    colors[i].b = ((colors[i].b) / (colors_count[i])) / 255;
 
     height_vector.push_back(clusters_max[i].z);
 
-    if (((((colors[i].r) >= 0.0) && ((colors[i].r) < 0.31)) && (((colors[i].g) >= 0.0) && ((colors[i].g) < 0.31)) && (((colors[i].b) >= 0.0) && ((colors[i].b) < 0.31))) || (std::isnan(colors[i].r)))
+    // Black cubes are obstacles, they are already in the occupancy map, as are clusters without colour
+    if ((colour_classes[i] == COLOUR_BLACK) || (colors_count[i] == 0))
     {
-
-      //////////////////////////////////////////////////////////////////////////////////
-      /////// ADDING COLLISION OBJECT //////////////////////////////////////////////////
-
-      g_collision_object = std::to_string(i);
-
-      // this is used in defining the origin of the box collision object
-      box_origin = origin(box_origin, g_oldcentroids[i].point.x, g_oldcentroids[i].point.y, g_oldcentroids[i].point.z);
-
-      // this is used in defining the dimension of the box collision object
-      box_dimension = dimension(box_dimension, 0.040, 0.040, ((clusters_max[i].z) + 0.02));
-
-      // this is used in defining the orientation of the box collision object
-      box_orientation = orientation(box_orientation, 0.0, 0.0, 0.0, 1.0);
-
-      // function call to add a box collision object with the arguments defined above
-      addCollisionObject(g_collision_object, box_origin, box_dimension, box_orientation);
-
-      //////////////////////////////////////////////////////////////////////////////////
-
       g_index_of_collision_objects.push_back(i);
     }
   }
@@ -358,6 +508,7 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
   {
     colors.erase(colors.begin() + *it);
     colors_count.erase(colors_count.begin() + *it);
+    colour_classes.erase(colour_classes.begin() + *it);
     g_yaw_list.erase(g_yaw_list.begin() + *it);
     g_oldcentroids.erase(g_oldcentroids.begin() + *it);
     centroids.erase(centroids.begin() + *it);
@@ -376,63 +527,33 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
 
   g_number_of_cubes_in_recorded_stack = round(((clusters_max[stack_index].z) - 0.017) / 0.04);
 
-  // Initializing color array and cube pixel counter, used to find an average rgb value for each cube
-  for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
-  {
-    g_Color.r = 0.0;
-    g_Color.g = 0.0;
-    g_Color.b = 0.0;
-    g_current_stack_colours.push_back(g_Color);
-    g_current_stack_cube_color_count.push_back(0);
-  }
+  // Initializing color array, cube pixel counter and colour class histogram of each cube in the stack
+  resetStackColours();
 
   geometry_msgs::Pose check_col;
 
   // Scan the stack of colours to determine the pose and colour of the cubes
   check_col = scan(check_col, g_oldcentroids[stack_index].point.x, g_oldcentroids[stack_index].point.y, 0.6);
 
-  bool check_col_success = moveArm(check_col);
-
-  g_sub_cloud;
+  reportProgress("reading stack");
+  beginInspection(g_oldcentroids[stack_index].point, g_number_of_cubes_in_recorded_stack);
+  bool check_col_success = moveArm(check_col, MOTION_SCAN);
 
-  std::vector<std_msgs::ColorRGBA> list_of_colours;
+  // The stack colours are summed by the clouds processed at this pose
+  if (not waitForSettledFrame(g_settled_frame_timeout))
+    ROS_WARN("No settled point cloud of the stack");
+  endInspection();
 
-  // If there is a stack of more than 1 cube, for every cube, compute the colour by finding the
-  // average of the RGB values present in the number of pixels close to the centroid.
-  if (g_number_of_cubes_in_recorded_stack > 0)
-  {
-    for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
-    {
-      g_current_stack_colours[i].r = ceil(((g_current_stack_colours[i].r) / (g_current_stack_cube_color_count[i])) / 255 * 10) / 10;
-      g_current_stack_colours[i].g = ceil(((g_current_stack_colours[i].g) / (g_current_stack_cube_color_count[i])) / 255 * 10) / 10;
-      g_current_stack_colours[i].b = ceil(((g_current_stack_colours[i].b) / (g_current_stack_cube_color_count[i])) / 255 * 10) / 10;
-      list_of_colours.push_back(g_current_stack_colours[i]);
-    }
-  }
+  // If there is a stack of more than 1 cube, for every cube, find the colour class held by
+  // most of the pixels close to the centroid.
+  std::vector<int> stack_classes;
+  finishStackColours(stack_classes);
   g_check_objects_stack = false;
 
-  //////////////////////////////////////////////////////////////////////////////////
-  /////// ADDING COLLISION OBJECT //////////////////////////////////////////////////
-
-  g_collision_object = std::to_string(stack_index);
-
-  // this is used in defining the origin of the box collision object
-  box_origin = origin(box_origin, g_oldcentroids[stack_index].point.x, g_oldcentroids[stack_index].point.y, g_oldcentroids[stack_index].point.z);
-
-  // this is used in defining the dimension of the box collision object
-  box_dimension = dimension(box_dimension, 0.040, 0.040, (height_vector[stack_index] + 0.02));
-
-  // this is used in defining the orientation of the box collision object
-  box_orientation = orientation(box_orientation, 0.0, 0.0, (g_yaw_list[stack_index] + (3.14159 / 4.0)), 1.0);
-
-  // function call to add a box collision object with the arguments defined above
-  addCollisionObject(g_collision_object, box_origin, box_dimension, box_orientation);
-
-  //////////////////////////////////////////////////////////////////////////////////
-
   // Remove the stack of cubes so that the robot can only identify the singular cubes
   colors.erase(colors.begin() + stack_index);
   colors_count.erase(colors_count.begin() + stack_index);
+  colour_classes.erase(colour_classes.begin() + stack_index);
   g_yaw_list.erase(g_yaw_list.begin() + stack_index);
   g_oldcentroids.erase(g_oldcentroids.begin() + stack_index);
   centroids.erase(centroids.begin() + stack_index);
@@ -459,7 +580,7 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
 
   g_index_of_cubes_to_stack.clear();
 
-  g_num_of_cubes_to_stack = list_of_colours.size();
+  g_num_of_cubes_to_stack = stack_classes.size();
 
   // Initialising the vector which stores the indices of the cubes to be stacked
   for (int i = 0; i < g_num_of_cubes_to_stack; i++)
@@ -468,13 +589,13 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
   }
 
   // Algorithm to find the indices of the cubes to stack
-  // To find the indices, it searches through all the cubes to find the colour which matches closest to a specified colour
+  // To find the indices, it searches through all the cubes to find one of the colour class of the stack cube
   // It only stores this index if it has not stored that index before
   for (int i = 0; i < g_num_of_cubes_to_stack; i++)
   {
     for (int j = 0; j < g_oldcentroids.size(); j++)
     {
-      if (abs(list_of_colours[i].r - colors[j].r) <= 0.3 && abs(list_of_colours[i].g - colors[j].g) <= 0.3 && abs(list_of_colours[i].b - colors[j].b) <= 0.3)
+      if ((stack_classes[i] != COLOUR_UNKNOWN) && (colour_classes[j] == stack_classes[i]))
       {
         if (std::find(g_index_of_cubes_to_stack.begin(), g_index_of_cubes_to_stack.end(), j) != g_index_of_cubes_to_stack.end() && g_index_of_cubes_to_stack.size() > 0)
         {
@@ -489,6 +610,18 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
     }
   }
 
+  // The cubes to pick must not be obstacles, the stack read above stays one
+  for (int i = 0; i < g_num_of_cubes_to_stack; i++)
+  {
+    const geometry_msgs::Point &c = g_oldcentroids[g_index_of_cubes_to_stack[i]].point;
+    g_occupancy.carve(Eigen::Vector3f(c.x - 0.04, c.y - 0.04, -0.01),
+                      Eigen::Vector3f(c.x + 0.04, c.y + 0.04, 0.12));
+  }
+
+  // Clouds seen with a cube in the gripper would put the cube in the map
+  g_occupancy_integrating = false;
+  updateOccupancyScene();
+
   // determine the placing location
   g_target_point.x = request.stack_point.x;
   g_target_point.y = request.stack_point.y;
@@ -499,6 +632,8 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
   // Function to stack the cubes
   bool success = pickAndPlaceIndexedCubes(); // Stack the cubes
 
+  g_occupancy_active = false;
+
   if (not success)
   {
     ROS_ERROR("Task 3 Pick and Place Failed");
@@ -508,6 +643,217 @@ bool Cw3Solution::task3Callback(cw3_world_spawner::Task3Service::Request &reques
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::stackColourClasses(const cw3_world_spawner::Task2Service::Request &request,
+                                     std::vector<int> &classes)
+{
+  classes.resize(request.stack_colours.size());
+  for (size_t i = 0; i < classes.size(); i++)
+  {
+    const std_msgs::ColorRGBA &colour = request.stack_colours[i];
+    classes[i] = g_perception->g_colour_table.classify(colour.r, colour.g, colour.b);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::claimStackJob(int job_id, const cw3_world_spawner::Task2Service::Request &request)
+{
+  /* Runs on the service thread while another job may be stacking, the world
+     model takes care of the locking */
+
+  std::vector<int> classes;
+  stackColourClasses(request, classes);
+  return g_world_model.claim(job_id, classes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::runStackJob(int job_id, const cw3_world_spawner::Task2Service::Request &request)
+{
+  /* Same stacking as task 2, but the cubes come from the world model kept
+     between jobs. The front mat is only scanned again when the model is
+     missing, too old, or one cloud of the mat disagrees with it */
+
+  bool rescan = not g_world_model.valid() || (g_world_model.age() > g_world_model_max_age);
+  if (not rescan)
+  {
+    reportProgress("checking scene");
+    rescan = not sceneUnchanged();
+  }
+
+  if (g_cancel_requested)
+    return false;
+
+  if (rescan)
+  {
+    if (not scanFrontMatCubes())
+      return false;
+
+    std::vector<ModelCube> seen(g_size);
+    for (int i = 0; i < g_size; i++)
+    {
+      seen[i].position = g_oldcentroids[i].point;
+      seen[i].yaw = g_yaw_list[i];
+      seen[i].colour = colors[i];
+      seen[i].colour_class = colour_classes[i];
+      seen[i].height = clusters_max[i].z;
+    }
+    g_world_model.rebuild(seen);
+    saveWorldSnapshot();
+  }
+  else
+  {
+    ROS_INFO("Job %d reuses the scan from %.1f s ago", job_id, g_world_model.age());
+  }
+
+  std::vector<int> classes;
+  stackColourClasses(request, classes);
+
+  std::vector<int> cube_ids;
+  if (not g_world_model.reserve(job_id, classes, cube_ids))
+  {
+    ROS_ERROR("Job %d: not enough free cubes of the requested colours", job_id);
+    return false;
+  }
+
+  // The reserved cubes, in stacking order, in the lists used by pickAndPlaceIndexedCubes
+  g_num_of_cubes_to_stack = cube_ids.size();
+  g_oldcentroids.resize(g_num_of_cubes_to_stack);
+  g_yaw_list.resize(g_num_of_cubes_to_stack);
+  colors.resize(g_num_of_cubes_to_stack);
+  colour_classes.resize(g_num_of_cubes_to_stack);
+  g_index_of_cubes_to_stack.resize(g_num_of_cubes_to_stack);
+  for (int i = 0; i < g_num_of_cubes_to_stack; i++)
+  {
+    const ModelCube &cube = g_world_model.cubes()[cube_ids[i]];
+    g_oldcentroids[i].point = cube.position;
+    g_yaw_list[i] = cube.yaw;
+    colors[i] = cube.colour;
+    colour_classes[i] = cube.colour_class;
+    g_index_of_cubes_to_stack[i] = i;
+  }
+
+  g_target_point.x = request.stack_point.x;
+  g_target_point.y = request.stack_point.y;
+  g_target_point.z = 0.03;
+  g_place_angle_offset_ = request.stack_rotation;
+
+  bool success = pickAndPlaceIndexedCubes();
+
+  for (int i = 0; i < g_cubes_placed; i++)
+    g_world_model.moveToStack(cube_ids[i], request.stack_point);
+  g_world_model.release(job_id);
+
+  // A failed pick may have pushed cubes around
+  if (not success)
+    g_world_model.invalidate();
+  saveWorldSnapshot();
+
+  return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::sceneUnchanged()
+{
+  /* One cloud from above the middle of the front mat, compared with the
+     model where the camera can see it */
+
+  geometry_msgs::Pose overview;
+  overview = scan(overview, 0.5, 0.0, 0.7);
+
+  if (not moveArm(overview, MOTION_SCAN) || not waitForSettledFrame(g_settled_frame_timeout, false))
+    return false;
+
+  // The camera pose of the cloud, g_world_to_camera already belongs to the next one
+  Eigen::Isometry3f world_to_camera;
+  collectDetections(g_frame_detections, &world_to_camera);
+  std::vector<geometry_msgs::Point> detected(g_frame_detections.size());
+  for (size_t i = 0; i < g_frame_detections.size(); i++)
+    detected[i] = g_frame_detections[i].centroid.point;
+
+  // Positions near the image border may be cut off, they are not checked
+  double tan_half_fov = 0.8 * tan(M_PI / 6);
+  WorldModel::ViewTest in_view = [world_to_camera, tan_half_fov](const geometry_msgs::Point &p)
+  {
+    Eigen::Vector3f c = world_to_camera * Eigen::Vector3f(p.x, p.y, p.z);
+    return (c.z() > 0) && (fabs(c.x()) < c.z() * tan_half_fov) && (fabs(c.y()) < c.z() * tan_half_fov * 0.75);
+  };
+
+  bool unchanged = g_world_model.consistentWith(detected, in_view);
+  if (not unchanged)
+    ROS_INFO("The front mat changed since the last scan");
+
+  return unchanged;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::saveWorldSnapshot()
+{
+  /* Only called between the steps of a task, the model does not change
+     while it is written */
+
+  if (g_world_snapshot.empty())
+    return;
+
+  if (not g_world_model.save(g_world_snapshot))
+    ROS_WARN("Cannot write the world snapshot %s", g_world_snapshot.c_str());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::scanFrontMatCubes()
+{
+  /* Scans the front mat and leaves the cubes found in g_oldcentroids, with
+     their orientation in g_yaw_list, their mean colour in colors and their
+     colour class in colour_classes */
+
+  // clearing the list that store centroids of any previous centroid values from global variables
+  clearPreviousScanData();
+
+  g_check_objects_floor = true;
+
+  reportProgress("scanning");
+  if (not scanFrontMat() || g_cancel_requested)
+    return false;
+
+  g_size = centroids.size();
+
+  // Initialise vector to store the orientation of all cubes
+  g_yaw_list.assign(g_size, 0);
+
+  g_oldcentroids = centroids;
+
+  for (int i = 0; i < g_size; i++)
+  {
+    // finding the accurate value for the centroid to the nearest second half decimal for accurate value,
+    // not needed when the centroids are averaged over several frames
+    if (g_scan_frames <= 1)
+    {
+      g_oldcentroids[i].point.x = floor(((g_oldcentroids[i].point.x) * 20) + 0.5) / 20;
+      g_oldcentroids[i].point.y = floor(((g_oldcentroids[i].point.y) * 20) + 0.5) / 20;
+    }
+
+    // FINDING ORIENTATION AND STORING IN LIST:
+    g_yaw_list[i] = atan2(((clusters_max[i].x) - (clusters_max_y_x[i])), ((clusters_max[i].y) - (clusters_max_x_y[i])));
+  }
+
+  g_check_objects_floor = false;
+
+  // calculating the average RGB values for each of the cubes found, the colour classes are used for matching
+  for (int i = 0; i < g_size; i++)
+  {
+    colors[i].r = ((colors[i].r) / (colors_count[i])) / 255;
+    colors[i].g = ((colors[i].g) / (colors_count[i])) / 255;
+    colors[i].b = ((colors[i].b) / (colors_count[i])) / 255;
+  }
+
+  return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void Cw3Solution::clearPreviousScanData()
 {
@@ -519,10 +865,38 @@ void Cw3Solution::clearPreviousScanData()
   clusters_max_x_y.clear();
   colors.clear();
   colors_count.clear();
+  colour_classes.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Cw3Solution::resetStackColours()
+{
+  // One entry per cube of the recorded stack, summed by the point cloud callback
+  g_current_stack_colours.assign(g_number_of_cubes_in_recorded_stack, std_msgs::ColorRGBA());
+  g_current_stack_cube_color_count.assign(g_number_of_cubes_in_recorded_stack, 0);
+  g_current_stack_hists.assign(g_number_of_cubes_in_recorded_stack, ColourHistogram());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void Cw3Solution::finishStackColours(std::vector<int> &stack_classes)
+{
+  /* Turns the sums of the stack colours into average RGB values, 0-1, and
+     votes the colour class of each cube */
+
+  stack_classes.resize(g_current_stack_colours.size());
+  for (size_t i = 0; i < g_current_stack_colours.size(); i++)
+  {
+    g_current_stack_colours[i].r = ((g_current_stack_colours[i].r) / (g_current_stack_cube_color_count[i])) / 255;
+    g_current_stack_colours[i].g = ((g_current_stack_colours[i].g) / (g_current_stack_cube_color_count[i])) / 255;
+    g_current_stack_colours[i].b = ((g_current_stack_colours[i].b) / (g_current_stack_cube_color_count[i])) / 255;
+
+    stack_classes[i] = g_current_stack_hists[i].majority();
+    ROS_INFO("Stack cube %zu is %s", i, ColourTable::name(stack_classes[i]));
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::scanFrontMat()
+bool Cw3Solution::scanFrontMat()
 {
   // initializing variable to scan an area of the robot arm environment
   float x_scan = 0.50;
@@ -535,6 +909,10 @@ void Cw3Solution::scanFrontMat()
 
   for (int i = 0; i < 3; i++)
   {
+    // a cancelled task stops scanning
+    if (g_cancel_requested)
+      return false;
+
     // function call setting the scan area to specific coordinate
     scan1 = scan(scan1, x_scan, y_scan, 0.7);
 
@@ -545,19 +923,21 @@ void Cw3Solution::scanFrontMat()
     g_y_thrs_max = g_y_thrs_min + 0.3;
 
     // function call to move arm towards scan coordinates
-    bool scan1_success = moveArm(scan1);
+    bool scan1_success = moveArm(scan1, MOTION_SCAN);
 
     // storing the centroids founds in scan area to the initialized centroids variable
-    findCentroidsAtScanLocation();
+    if (not findCentroidsAtScanLocation())
+      return false;
 
     // updating the scan area for the next iteration
     y_scan -= 0.35;
     y_thrs_min -= 0.30;
   }
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::scanEntireMat()
+bool Cw3Solution::scanEntireMat()
 {
   // initializing variable to scan an area of the robot arm environment
   float x_scan = 0.5;
@@ -577,6 +957,10 @@ void Cw3Solution::scanEntireMat()
 
   for (int i = 0; i < 3; i++)
   {
+    // a cancelled task stops scanning
+    if (g_cancel_requested)
+      return false;
+
     // function call setting the scan area to specific coordinate
     scan1 = scan(scan1, x_scan, y_scan, 0.6);
 
@@ -587,10 +971,11 @@ void Cw3Solution::scanEntireMat()
     g_y_thrs_max = g_y_thrs_min + 0.3;
 
     // function call to move arm towards scan coordinates
-    bool scan1_success = moveArm(scan1);
+    bool scan1_success = moveArm(scan1, MOTION_SCAN);
 
     // storing the centroids founds in scan area to the initialized centroids variable
-    findCentroidsAtScanLocation();
+    if (not findCentroidsAtScanLocation())
+      return false;
 
     // updating the scan area for the next iteration
     y_scan -= 0.35;
@@ -612,10 +997,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.3;
 
   // function call to move arm towards scan coordinates
-  bool scan4_success = moveArm(scan4);
+  bool scan4_success = moveArm(scan4, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 5th scan location:
 
@@ -632,10 +1018,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.3;
 
   // function call to move arm towards scan coordinates
-  bool scan5_success = moveArm(scan5);
+  bool scan5_success = moveArm(scan5, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 6th scan location:
 
@@ -652,10 +1039,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.30;
 
   // function call to move arm towards scan coordinates
-  bool scan6_success = moveArm(scan6);
+  bool scan6_success = moveArm(scan6, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 7th scan location:
 
@@ -672,10 +1060,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.30;
 
   // function call to move arm towards scan coordinates
-  bool scan7_success = moveArm(scan7);
+  bool scan7_success = moveArm(scan7, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 8th scan location:
 
@@ -692,10 +1081,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.30;
 
   // function call to move arm towards scan coordinates
-  bool scan8_success = moveArm(scan8);
+  bool scan8_success = moveArm(scan8, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 9th scan location:
 
@@ -712,10 +1102,11 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.30;
 
   // function call to move arm towards scan coordinates
-  bool scan9_success = moveArm(scan9);
+  bool scan9_success = moveArm(scan9, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // Scanning for the blue boxes at the 10th scan location:
 
@@ -732,17 +1123,19 @@ void Cw3Solution::scanEntireMat()
   g_y_thrs_max = g_y_thrs_min + 0.30;
 
   // function call to move arm towards scan coordinates
-  bool scan10_success = moveArm(scan10);
+  bool scan10_success = moveArm(scan10, MOTION_SCAN);
 
   // storing the centroids founds in scan area to the initialized centroids variable
-  findCentroidsAtScanLocation();
+  if (not findCentroidsAtScanLocation())
+    return false;
 
   // std::cout<< "Number of centroids found: "<<centroids.size()<<std::endl;
+  return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-void Cw3Solution::findCentroidsAtScanLocation()
+bool Cw3Solution::findCentroidsAtScanLocation()
 {
   /*this function is used to find centroids and the min and max x,y coordinates of object particular colour within
    * a particular scan area
@@ -760,25 +1153,50 @@ void Cw3Solution::findCentroidsAtScanLocation()
   double cluster_max_y_x;
   double cluster_max_x_y;
 
-  g_sub_cloud;
-
-  int size = g_centroids.size();
-
-  if (size > 0)
+  // The centroids must come from clouds taken at this scan location, averaged
+  // over up to g_scan_frames of them
+  g_scan_integrator.reset();
+  for (int k = 0; k < g_scan_frames; k++)
   {
-    for (int i = 0; i < size; i++)
+    if (not waitForSettledFrame(g_settled_frame_timeout, false))
     {
-      centroid = g_centroids[i];
-      cluster_max = g_clusters_max[i];
-      cluster_min = g_clusters_min[i];
-      cluster_max_y_x = g_clusters_max_y_x[i];
-      cluster_max_x_y = g_clusters_max_x_y[i];
+      if (k > 0)
+        break;
 
-      if (g_check_objects_floor == true)
+      // Clouds from an earlier pose would put the cubes in the wrong place
+      ROS_WARN("No settled point cloud at this scan location yet, waiting longer");
+      if (not waitForSettledFrame(3 * g_settled_frame_timeout, false))
       {
-        color = g_colors[i];
-        color_count = g_colors_count[i];
+        ROS_ERROR("No settled point cloud at this scan location");
+        return false;
       }
+    }
+
+    // The next frame must be a newer one
+    g_consumed_frames = g_processed_frames.load();
+
+    collectDetections(g_frame_detections);
+    g_scan_integrator.addFrame(g_frame_detections);
+
+    // Stop early once the centroids have settled
+    if (g_scan_integrator.converged())
+      break;
+  }
+  g_scan_integrator.result(g_frame_detections);
+
+  int size = g_frame_detections.size();
+
+  if (size > 0)
+  {
+    for (int i = 0; i < size; i++)
+    {
+      centroid = g_frame_detections[i].centroid;
+      cluster_max = g_frame_detections[i].max;
+      cluster_min = g_frame_detections[i].min;
+      cluster_max_y_x = g_frame_detections[i].max_y_x;
+      cluster_max_x_y = g_frame_detections[i].max_x_y;
+      color = g_frame_detections[i].color;
+      color_count = g_frame_detections[i].color_count;
 
       double x = centroid.point.x;
       double y = centroid.point.y;
@@ -805,9 +1223,220 @@ void Cw3Solution::findCentroidsAtScanLocation()
         colors.push_back(color);
         // append number of pixels of current cluster found to the list
         colors_count.push_back(color_count);
+        // append the colour class held by most of the pixels to the list
+        colour_classes.push_back(g_frame_detections[i].colour_hist.majority());
       }
     }
   }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::updateOccupancyScene()
+{
+  /* Only the tiles that changed are sent, in a single planning scene update */
+
+  ros::WallTime start = ros::WallTime::now();
+  g_occupancy.exportDirty("panda_link0", g_occupancy_objects);
+  if (not g_occupancy_objects.empty())
+    robot_->applyCollisionObjects(g_occupancy_objects);
+  g_scene_update_metric->observe((ros::WallTime::now() - start).toSec());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::warmUpPlanners()
+{
+  /* The motions every task starts with: the three scans of the front mat,
+     then down to a cube and back up */
+
+  std::vector<geometry_msgs::Pose> poses;
+  std::vector<MotionType> types;
+  geometry_msgs::Pose scan_pose;
+  for (float y_scan : {0.35f, 0.0f, -0.35f})
+  {
+    poses.push_back(scan(scan_pose, 0.5, y_scan, 0.7));
+    types.push_back(MOTION_SCAN);
+  }
+
+  geometry_msgs::Point mat_centre;
+  mat_centre.x = 0.5;
+  geometry_msgs::Pose grasp_pose = topDownPose(mat_centre, 0.0);
+  geometry_msgs::Pose approach_pose = grasp_pose;
+  approach_pose.position.z += approach_distance_;
+  poses.push_back(approach_pose);
+  types.push_back(MOTION_TRANSFER);
+  poses.push_back(grasp_pose);
+  types.push_back(MOTION_APPROACH);
+
+  robot_->warmUp(poses, types);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::observeOccupancy()
+{
+  g_occupancy_integrating = true;
+
+  // Wait for a cloud processed after integration was switched on
+  g_consumed_frames = g_processed_frames.load();
+  if (not waitForSettledFrame(g_settled_frame_timeout))
+    ROS_WARN("No settled point cloud to update the occupancy map");
+
+  g_occupancy_integrating = false;
+  updateOccupancyScene();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::verifyStack(const geometry_msgs::Point &base,
+                              int expected_cubes,
+                              int expected_class,
+                              int &observed_cubes)
+{
+  /* Processes one cloud cropped to a box around the stack, which takes a few
+     milliseconds and no arm motion when the camera already looks at it */
+
+  if (not observeAt(base, expected_cubes))
+  {
+    ROS_WARN("Stack at (%.3f, %.3f) not seen", base.x, base.y);
+    g_stacks_unseen_metric->add();
+    observed_cubes = -1;
+    return false;
+  }
+
+  // Same estimate as the number of cubes in a recorded stack
+  observed_cubes = round(((g_verify_stats.max_pt.z) - 0.017) / 0.04);
+  if (observed_cubes != expected_cubes)
+  {
+    g_stacks_mismatched_metric->add();
+    return false;
+  }
+
+  // Colour class of the top cube
+  int top = expected_cubes - 1;
+  int top_class = g_verify_stats.layer_hist[top].majority();
+  if (top_class != expected_class)
+  {
+    ROS_WARN("Top of the stack is %s, expected %s", ColourTable::name(top_class), ColourTable::name(expected_class));
+    g_stacks_mismatched_metric->add();
+    return false;
+  }
+
+  g_stacks_confirmed_metric->add();
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::observeAt(const geometry_msgs::Point &base, int layers, bool *got_frame)
+{
+  /* The cloud callback crops the next settled cloud to a box around the
+     point and records the cluster it finds there */
+
+  g_verify_point = base;
+  g_verify_layers = layers;
+  g_verify_found = false;
+  g_verify_active = true;
+  beginInspection(base, layers);
+
+  g_consumed_frames = g_processed_frames.load();
+  bool settled = waitForSettledFrame(g_settled_frame_timeout);
+
+  endInspection();
+  g_verify_active = false;
+
+  if (got_frame)
+    *got_frame = settled;
+  return settled && g_verify_found;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::beginInspection(const geometry_msgs::Point &base, int layers)
+{
+  /* The box starts above the mat, so its points need no plane segmentation,
+     and is wide enough for a stack turned by any yaw */
+
+  // The cloud callback copies the box under the same lock
+  boost::mutex::scoped_lock lock(g_inspect_mutex);
+  g_inspect_roi = Eigen::AlignedBox3f(Eigen::Vector3f(base.x - 0.06, base.y - 0.06, 0.025),
+                                      Eigen::Vector3f(base.x + 0.06, base.y + 0.06, 0.04 * layers + 0.06));
+  g_inspect_active = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::endInspection()
+{
+  boost::mutex::scoped_lock lock(g_inspect_mutex);
+  g_inspect_active = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+GraspState Cw3Solution::graspState()
+{
+  /* Closing on nothing brings the fingers together, closing on a cube stops
+     them at its width with the fingers pushing against it */
+
+  double width, effort;
+  if (not robot_->fingerState(width, effort))
+  {
+    ROS_WARN("Finger state not available");
+    return GRASP_UNKNOWN;
+  }
+
+  ROS_INFO("Grasp closed at width %.4f, effort %.2f", width, effort);
+
+  if (width < g_grasp_min_width)
+    return GRASP_EMPTY;
+
+  // NaN when the controllers report no effort, then the width decides
+  if ((g_grasp_min_effort > 0) && not std::isnan(effort) && (effort < g_grasp_min_effort))
+    return GRASP_EMPTY;
+
+  return GRASP_HOLDING;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void Cw3Solution::collectDetections(std::vector<ScanDetection> &detections,
+                                    Eigen::Isometry3f *world_to_camera)
+{
+  /* Gathers the clusters left by the last processed cloud */
+
+  boost::mutex::scoped_lock lock(g_frame_mutex);
+  if (world_to_camera)
+    *world_to_camera = g_frame_world_to_camera;
+
+  // The log holds the cloud these clusters came from, not a newer one
+  recordFrameLocked();
+
+  detections.resize(g_centroids.size());
+  for (int i = 0; i < g_centroids.size(); i++)
+  {
+    detections[i].centroid = g_centroids[i];
+    detections[i].max = g_clusters_max[i];
+    detections[i].min = g_clusters_min[i];
+    detections[i].max_y_x = g_clusters_max_y_x[i];
+    detections[i].max_x_y = g_clusters_max_x_y[i];
+
+    // Colours are only stored while the cubes on the floor are being checked
+    if ((g_check_objects_floor == true) && (i < g_colors.size()))
+    {
+      detections[i].color = g_colors[i];
+      detections[i].color_count = g_colors_count[i];
+      detections[i].colour_hist = g_colour_hists[i];
+    }
+    else
+    {
+      detections[i].color = std_msgs::ColorRGBA();
+      detections[i].color_count = 0;
+      detections[i].colour_hist.clear();
+    }
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -923,36 +1552,62 @@ Cw3Solution::orientation(geometry_msgs::Quaternion collision_orientation, float
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool Cw3Solution::moveArm(geometry_msgs::Pose target_pose)
+bool Cw3Solution::moveArm(geometry_msgs::Pose target_pose, MotionType type)
 {
   /* This function moves the move_group to the target position */
 
-  // setup the target pose
-  ROS_INFO("Setting pose target");
-  arm_group_.setPoseTarget(target_pose);
+  if (g_cancel_requested)
+  {
+    ROS_WARN("Task cancelled, arm motion skipped");
+    return false;
+  }
+
+  // Clouds from before the motion must not be mistaken for the new view
+  g_consumed_frames = g_processed_frames.load();
+  g_frame_gate.setEarliestStamp(ros::Time::now());
 
-  // create a movement plan for the arm
-  ROS_INFO("Attempting to plan the path");
-  moveit::planning_interface::MoveGroupInterface::Plan my_plan;
-  bool success = (arm_group_.plan(my_plan) ==
-                  moveit::planning_interface::MoveItErrorCode::SUCCESS);
+  return robot_->moveArm(target_pose, type);
+}
 
-  ROS_INFO("Visualising plan %s", success ? "" : "FAILED");
+///////////////////////////////////////////////////////////////////////////////
 
-  // execute the planned path
-  arm_group_.move();
+bool Cw3Solution::moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                                 const std::vector<MotionType> &types)
+{
+  /* The robot joins the segments into one motion, stopping only at the end */
 
-  return success;
+  if (not g_blend_motions)
+  {
+    bool success = true;
+    for (size_t i = 0; i < waypoints.size() && success; i++)
+      success = moveArm(waypoints[i], types[i]);
+    return success;
+  }
+
+  if (g_cancel_requested)
+  {
+    ROS_WARN("Task cancelled, arm motion skipped");
+    return false;
+  }
+
+  // Clouds from before the motion must not be mistaken for the new view
+  g_consumed_frames = g_processed_frames.load();
+  g_frame_gate.setEarliestStamp(ros::Time::now());
+
+  return robot_->moveArmThrough(waypoints, types);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 bool Cw3Solution::moveGripper(float width)
 {
-  /* this function moves the gripper fingers to a new position. Joints are:
-      - panda_finger_joint1
-      - panda_finger_joint2
-  */
+  /* this function moves the gripper fingers to a new position */
+
+  if (g_cancel_requested)
+  {
+    ROS_WARN("Task cancelled, gripper motion skipped");
+    return false;
+  }
 
   // safety checks
   if (width > gripper_open_)
@@ -960,29 +1615,7 @@ bool Cw3Solution::moveGripper(float width)
   if (width < gripper_closed_)
     width = gripper_closed_;
 
-  // calculate the joint targets as half each of the requested distance
-  double eachJoint = width / 2.0;
-
-  // create a vector to hold the joint target for each joint
-  std::vector<double> gripperJointTargets(2);
-  gripperJointTargets[0] = eachJoint;
-  gripperJointTargets[1] = eachJoint;
-
-  // apply the joint target
-  hand_group_.setJointValueTarget(gripperJointTargets);
-  hand_group_.planGraspsAndPick(g_pick_object);
-
-  // move the robot hand
-  ROS_INFO("Attempting to plan the path");
-  moveit::planning_interface::MoveGroupInterface::Plan my_plan;
-  bool success = (hand_group_.plan(my_plan) ==
-                  moveit::planning_interface::MoveItErrorCode::SUCCESS);
-
-  ROS_INFO("Visualising plan %s", success ? "" : "FAILED");
-
-  hand_group_.move();
-
-  return success;
+  return robot_->moveGripper(width, g_pick_object);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1022,7 +1655,7 @@ void Cw3Solution::addCollisionObject(std::string object_name,
 
   // add the collision object to the vector, then apply to planning scene
   object_vector.push_back(collision_object);
-  planning_scene_interface_.applyCollisionObjects(object_vector);
+  robot_->applyCollisionObjects(object_vector);
 
   return;
 }
@@ -1069,7 +1702,7 @@ void Cw3Solution::addAttachedCollisionObject(std::string object_name,
   // add the collision object to the vector, then apply to planning scene
   ROS_INFO("Adding the object into the world at the location of the hand.");
   object_vector.push_back(collision_object);
-  planning_scene_interface_.applyAttachedCollisionObjects(object_vector);
+  robot_->applyAttachedCollisionObjects(object_vector);
 
   return;
 }
@@ -1089,32 +1722,104 @@ void Cw3Solution::removeCollisionObject(std::string object_name)
 
   // apply this collision object removal to the scene
   object_vector.push_back(collision_object);
-  planning_scene_interface_.applyCollisionObjects(object_vector);
+  robot_->applyCollisionObjects(object_vector);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool Cw3Solution::pick(geometry_msgs::Point position)
+geometry_msgs::Pose Cw3Solution::topDownPose(const geometry_msgs::Point &position, double offset)
 {
-  /* This function picks up an object using a pose. The given point is where the
-  centre of the gripper fingers will converge */
-
-  // define grasping as from above
+  /* The hand points down, turned about z by the offset plus the 45 degrees
+     between the hand frame and the fingers */
 
-  // determine the grasping orientation
-  // define placing as from above
   tf2::Quaternion q_x180deg(-1, 0, 0, 0);
   tf2::Quaternion q_object;
-  tf2::Quaternion q_result;
-  q_object.setRPY(0, 0, (angle_offset_ + (3.14159 / 4.0)));
-  q_result = q_x180deg * q_object;
-  geometry_msgs::Quaternion grasp_orientation = tf2::toMsg(q_result);
+  q_object.setRPY(0, 0, (offset + (3.14159 / 4.0)));
 
-  // set the desired grasping pose
-  geometry_msgs::Pose grasp_pose;
-  grasp_pose.position = position;
-  grasp_pose.orientation = grasp_orientation;
-  grasp_pose.position.z += z_offset_;
+  geometry_msgs::Pose pose;
+  pose.position = position;
+  pose.position.z += z_offset_;
+  pose.orientation = tf2::toMsg(q_x180deg * q_object);
+
+  return pose;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::chooseGraspYaws(const geometry_msgs::Point &pick_position,
+                                  const geometry_msgs::Point &place_position,
+                                  double &pick_offset,
+                                  double &place_offset)
+{
+  /* A cube looks the same after a quarter turn, so it can be grasped at four
+     yaws and put down at four yaws and still line up with the stack. Each
+     pair is scored by the joint travel from the current arm state to the
+     grasp and on to the place pose, the wrist counted with an extra weight */
+
+  std::vector<double> start;
+  if (not robot_->currentArmJoints(start))
+    return false;
+
+  double best_cost = std::numeric_limits<double>::infinity();
+  double best_pick = pick_offset, best_place = place_offset;
+
+  for (int k = 0; k < 4; k++)
+  {
+    double pick_candidate = pick_offset + k * (M_PI / 2);
+    std::vector<double> pick_joints;
+    if (not robot_->solveArmIK(topDownPose(pick_position, pick_candidate), start, pick_joints))
+      continue;
+
+    for (int m = 0; m < 4; m++)
+    {
+      double place_candidate = place_offset + m * (M_PI / 2);
+      std::vector<double> place_joints;
+      if (not robot_->solveArmIK(topDownPose(place_position, place_candidate), pick_joints, place_joints))
+        continue;
+
+      double cost = jointTravel(start, pick_joints) + jointTravel(pick_joints, place_joints);
+      if (cost < best_cost)
+      {
+        best_cost = cost;
+        best_pick = pick_candidate;
+        best_place = place_candidate;
+      }
+    }
+  }
+
+  if (std::isinf(best_cost))
+    return false;
+
+  pick_offset = best_pick;
+  place_offset = best_place;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+double Cw3Solution::jointTravel(const std::vector<double> &from, const std::vector<double> &to)
+{
+  /* The last joint is the wrist, its turns are slow and near its limits */
+
+  double travel = 0.0;
+  for (size_t j = 0; j < from.size() && j < to.size(); j++)
+    travel += fabs(to[j] - from[j]);
+
+  if (not from.empty() && from.size() == to.size())
+    travel += g_wrist_weight * fabs(to.back() - from.back());
+
+  return travel;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool Cw3Solution::pick(geometry_msgs::Point position, bool retreat)
+{
+  /* This function picks up an object using a pose. The given point is where the
+  centre of the gripper fingers will converge */
+
+  // set the desired grasping pose, from above
+  geometry_msgs::Pose grasp_pose = topDownPose(position, angle_offset_);
 
   // set the desired pre-grasping pose
   geometry_msgs::Pose approach_pose;
@@ -1136,35 +1841,104 @@ bool Cw3Solution::pick(geometry_msgs::Point position)
     return false;
   }
 
-  // open the gripper
-  success *= moveGripper(gripper_open_);
-
-  if (not success)
+  for (int attempt = 0; ; attempt++)
   {
-    ROS_ERROR("Opening gripper prior to pick failed");
-    return false;
-  }
+    // open the gripper
+    success *= moveGripper(gripper_open_);
 
-  // approach to grasping pose
-  success *= moveArm(grasp_pose);
+    if (not success)
+    {
+      ROS_ERROR("Opening gripper prior to pick failed");
+      return false;
+    }
 
-  if (not success)
-  {
-    ROS_ERROR("Moving arm to grasping pose failed");
-    return false;
-  }
+    // approach to grasping pose
+    success *= moveArm(grasp_pose, MOTION_APPROACH);
 
-  // grasp!
-  success *= moveGripper(gripper_closed_);
+    if (not success)
+    {
+      ROS_ERROR("Moving arm to grasping pose failed");
+      return false;
+    }
 
-  if (not success)
+    // grasp!
+    g_picks_attempted_metric->add();
+    success *= moveGripper(gripper_closed_);
+
+    if (not success)
+    {
+      ROS_ERROR("Closing gripper to grasp failed");
+      return false;
+    }
+
+    GraspState grasp = graspState();
+    if (grasp == GRASP_UNKNOWN)
+    {
+      // Without the fingers the pick site is looked at, a cube left there was missed
+      success *= moveArm(approach_pose, MOTION_APPROACH);
+
+      if (not success)
+      {
+        ROS_ERROR("Moving arm to look at the pick site failed");
+        return false;
+      }
+
+      bool got_frame;
+      bool cube_left = observeAt(position, 1, &got_frame);
+      if (not got_frame)
+      {
+        ROS_ERROR("Cannot tell whether the grasp holds, no finger state and no cloud");
+        return false;
+      }
+      grasp = cube_left ? GRASP_EMPTY : GRASP_HOLDING;
+    }
+
+    if (grasp == GRASP_HOLDING)
+    {
+      g_picks_succeeded_metric->add();
+      break;
+    }
+
+    // An empty grasp is retried from here rather than carried to the place pose
+    moveGripper(gripper_open_);
+    success *= moveArm(approach_pose, MOTION_APPROACH);
+
+    if (attempt >= g_max_regrasps || not success)
+    {
+      ROS_ERROR("Grasp is empty after %d attempts", attempt + 1);
+      return false;
+    }
+
+    ROS_WARN("Grasp is empty, looking for the cube again");
+
+    // The cube may have been pushed, it is searched for around the first grasp
+    if (observeAt(position, 1))
+    {
+      grasp_pose.position.x = g_verify_centroid.x;
+      grasp_pose.position.y = g_verify_centroid.y;
+      approach_pose.position.x = g_verify_centroid.x;
+      approach_pose.position.y = g_verify_centroid.y;
+
+      success *= moveArm(approach_pose, MOTION_APPROACH);
+
+      if (not success)
+      {
+        ROS_ERROR("Moving arm to the re-grasp approach pose failed");
+        return false;
+      }
+    }
+  }
+
+  // The retreat may be joined with the motion to the place location
+  if (not retreat)
   {
-    ROS_ERROR("Closing gripper to grasp failed");
-    return false;
+    g_pick_retreat_pose = approach_pose;
+    ROS_INFO("Pick operation successful, retreat left to the place motion");
+    return true;
   }
 
   // retreat with object
-  success *= moveArm(approach_pose);
+  success *= moveArm(approach_pose, MOTION_APPROACH);
 
   if (not success)
   {
@@ -1179,25 +1953,14 @@ bool Cw3Solution::pick(geometry_msgs::Point position)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool Cw3Solution::place(geometry_msgs::Point position)
+bool Cw3Solution::place(geometry_msgs::Point position,
+                        const std::vector<geometry_msgs::Pose> &lead_in)
 {
   /* This function places an object using a pose. The given point is where the
   centre of the gripper fingers will converge */
 
-  // determine the placing orientation
-  // define placing as from above
-  tf2::Quaternion q_x180deg(-1, 0, 0, 0);
-  tf2::Quaternion q_object;
-  tf2::Quaternion q_result;
-  q_object.setRPY(0, 0, (angle_offset_ + (3.14159 / 4.0)));
-  q_result = q_x180deg * q_object;
-  geometry_msgs::Quaternion place_orientation = tf2::toMsg(q_result);
-
-  // set the desired placing pose
-  geometry_msgs::Pose place_pose;
-  place_pose.position = position;
-  place_pose.orientation = place_orientation;
-  place_pose.position.z += z_offset_;
+  // set the desired placing pose, from above
+  geometry_msgs::Pose place_pose = topDownPose(position, angle_offset_);
 
   // set the desired pre-placing pose
   geometry_msgs::Pose approach_pose;
@@ -1210,17 +1973,15 @@ bool Cw3Solution::place(geometry_msgs::Point position)
 
   ROS_INFO("Begining place operation");
 
-  // move the arm above the place location
-  success *= moveArm(approach_pose);
-
-  if (not success)
-  {
-    ROS_ERROR("Moving arm to place approach pose failed");
-    return false;
-  }
+  // pass the lead-in poses, move above the place location and down to it
+  std::vector<geometry_msgs::Pose> waypoints = lead_in;
+  std::vector<MotionType> types(lead_in.size(), MOTION_APPROACH);
+  waypoints.push_back(approach_pose);
+  types.push_back(MOTION_TRANSFER);
+  waypoints.push_back(place_pose);
+  types.push_back(MOTION_APPROACH);
 
-  // approach to placing pose
-  success *= moveArm(place_pose);
+  success *= moveArmThrough(waypoints, types);
 
   if (not success)
   {
@@ -1248,6 +2009,11 @@ bool Cw3Solution::pickAndPlaceIndexedCubes()
 
   if (g_num_of_cubes_to_stack > 0)
   {
+    // Cubes on the stack, as last seen by the camera
+    int stack_cubes = 0;
+
+    // Start of the run, for the cubes per minute
+    ros::WallTime run_start = ros::WallTime::now();
 
     for (int i = 0; i < g_num_of_cubes_to_stack; i++)
     {
@@ -1266,10 +2032,19 @@ bool Cw3Solution::pickAndPlaceIndexedCubes()
       g_pick_object = std::to_string(i);
       g_pick_objects.push_back(g_pick_object);
 
-      angle_offset_ = g_yaw_list[g_index_of_cubes_to_stack[i]];
+      reportProgress("picking");
+
+      // Of the four grasps of the cube and the four ways to put it down, the
+      // pair turning the arm the least
+      double pick_offset = g_yaw_list[g_index_of_cubes_to_stack[i]];
+      double place_offset = g_place_angle_offset_;
+      if (not chooseGraspYaws(position, g_target_point, pick_offset, place_offset))
+        ROS_WARN("No reachable grasp yaw pair, using the measured yaws");
+
+      angle_offset_ = pick_offset;
 
       // function call to pick an object from the identified coordinate
-      g_pick_success = pick(position);
+      g_pick_success = pick(position, not g_blend_motions);
       if (not g_pick_success)
       {
         ROS_ERROR("Object Pick up  failed");
@@ -1278,8 +2053,12 @@ bool Cw3Solution::pickAndPlaceIndexedCubes()
       }
 
       // place the requested cube
-      angle_offset_ = g_place_angle_offset_;
-      g_place_success = place(g_target_point);
+      angle_offset_ = place_offset;
+      reportProgress("placing");
+      std::vector<geometry_msgs::Pose> lead_in;
+      if (g_blend_motions)
+        lead_in.push_back(g_pick_retreat_pose);
+      g_place_success = place(g_target_point, lead_in);
       if (not g_place_success)
       {
         ROS_ERROR("Object Placing failed");
@@ -1308,7 +2087,7 @@ bool Cw3Solution::pickAndPlaceIndexedCubes()
       q_result = q_x180deg * q_object;
       target_pose.orientation = tf2::toMsg(q_result);
       // retract arm
-      g_move_success = moveArm(target_pose);
+      g_move_success = moveArm(target_pose, MOTION_APPROACH);
 
       if (not g_move_success)
       {
@@ -1316,25 +2095,61 @@ bool Cw3Solution::pickAndPlaceIndexedCubes()
 
         return false;
       }
-      //////////////////////////////////////////////////////////////////////////////////
-      /////// ADDING COLLISION OBJECT //////////////////////////////////////////////////
 
-      // this is used in defining the origin of the box collision object
-      box_origin = origin(box_origin, g_target_point.x, g_target_point.y, g_target_point.z);
+      // The retract pose looks down at the stack, check what is really on it
+      int observed_cubes;
+      int expected_class = colour_classes[g_index_of_cubes_to_stack[i]];
+      if (not verifyStack(g_target_point, stack_cubes + 1, expected_class, observed_cubes))
+        ROS_WARN("Stack holds %d cubes, %d expected", observed_cubes, stack_cubes + 1);
 
-      // this is used in defining the dimension of the box collision object
-      box_dimension = dimension(box_dimension, 0.040, 0.040, 0.040);
+      // A count more than a cube off is a bad view or a toppled stack, look again
+      if (observed_cubes >= 0 && abs(observed_cubes - (stack_cubes + 1)) > 1)
+      {
+        verifyStack(g_target_point, stack_cubes + 1, expected_class, observed_cubes);
+        if (observed_cubes >= 0 && abs(observed_cubes - (stack_cubes + 1)) > 1)
+        {
+          ROS_ERROR("Stack holds %d cubes, %d expected, stopping", observed_cubes, stack_cubes + 1);
+          return false;
+        }
+      }
+
+      if (g_occupancy_active)
+      {
+        // The placed cube is taken from the camera
+        observeOccupancy();
+      }
+      else
+      {
+        //////////////////////////////////////////////////////////////////////////////////
+        /////// ADDING COLLISION OBJECT //////////////////////////////////////////////////
 
-      // this is used in defining the orientation of the box collision object
-      box_orientation = orientation(box_orientation, 0.0, 0.0, g_place_angle_offset_, 1.0);
+        // this is used in defining the origin of the box collision object
+        box_origin = origin(box_origin, g_target_point.x, g_target_point.y, g_target_point.z);
 
-      // function call to add a box collision object with the arguments defined above
-      addCollisionObject(g_pick_objects[i], box_origin, box_dimension, box_orientation);
+        // this is used in defining the dimension of the box collision object
+        box_dimension = dimension(box_dimension, 0.040, 0.040, 0.040);
 
-      //////////////////////////////////////////////////////////////////////////////////
+        // this is used in defining the orientation of the box collision object
+        box_orientation = orientation(box_orientation, 0.0, 0.0, g_place_angle_offset_, 1.0);
 
-      // Incrementing target point for next deposit
-      g_target_point.z = g_target_point.z + 0.04;
+        // function call to add a box collision object with the arguments defined above
+        addCollisionObject(g_pick_objects[i], box_origin, box_dimension, box_orientation);
+
+        //////////////////////////////////////////////////////////////////////////////////
+      }
+
+      // Next deposit goes on top of the cubes seen, within a cube of the count
+      // expected, or one cube higher if the stack was not seen
+      if (observed_cubes >= 0)
+        stack_cubes = observed_cubes;
+      else
+        stack_cubes = stack_cubes + 1;
+      g_target_point.z = 0.03 + (0.04 * stack_cubes);
+
+      g_cubes_placed = i + 1;
+      g_cubes_placed_metric->add();
+      g_cubes_per_minute_metric->set((i + 1) * 60.0 / (ros::WallTime::now() - run_start).toSec());
+      reportProgress("placed");
     }
   }
   return true;
@@ -1346,18 +2161,98 @@ void Cw3Solution::cloudCallBackOne(const sensor_msgs::PointCloud2ConstPtr &cloud
   // Extract inout point cloud info
   g_input_pc_frame_id_ = cloud_input_msg->header.frame_id;
 
-  // Convert to PCL data type
-  pcl_conversions::toPCL(*cloud_input_msg, g_pcl_pc);
-  pcl::fromPCLPointCloud2(g_pcl_pc, *g_cloud_ptr);
+  // Clouds captured before the arm settled are dropped before any processing
+  if (not g_frame_gate.accept(cloud_input_msg->header.stamp))
+  {
+    g_frames_unsettled_metric->add();
+    return;
+  }
+
+  // Every stage of this frame uses the camera pose at the time of capture
+  if (not snapshotCameraTransform(cloud_input_msg->header))
+    return;
+
+  processCloud(cloud_input_msg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void Cw3Solution::processCloud(const sensor_msgs::PointCloud2ConstPtr &cloud_input_msg)
+{
+  /* Everything after the camera pose lookup, the same for a live cloud and
+     a replayed one */
 
-  // Perform the filtering
-  applyVX(g_cloud_ptr, g_cloud_filtered);
-  applyFF(g_cloud_ptr, g_cloud_filtered); // floor filtering
+  // A stack being inspected only needs the points around it
+  bool inspecting;
+  Eigen::AlignedBox3f inspect_roi;
+  {
+    boost::mutex::scoped_lock lock(g_inspect_mutex);
+    inspecting = g_inspect_active;
+    inspect_roi = g_inspect_roi;
+  }
+  if (inspecting)
+  {
+    Eigen::AlignedBox3f roi;
+    for (int corner = 0; corner < 8; corner++)
+      roi.extend(g_world_to_camera * inspect_roi.corner(static_cast<Eigen::AlignedBox3f::CornerType>(corner)));
+    g_perception->setRoi(roi);
+  }
+  else
+  {
+    g_perception->clearRoi();
+  }
 
-  // Segment plane and cube
-  findNormals(g_cloud_filtered);
-  segPlane(g_cloud_filtered);
-  segClusters(g_cloud_filtered);
+  // Read the points above the floor straight out of the message
+  ros::WallTime stage_start = ros::WallTime::now();
+  if (not g_perception->ingest(*cloud_input_msg, findFloorDepth()))
+  {
+    ROS_ERROR("Point cloud has no xyz and rgb fields or is truncated");
+    g_frames_format_metric->add();
+    return;
+  }
+  ros::WallTime stage_end = ros::WallTime::now();
+  g_ingest_metric->observe((stage_end - stage_start).toSec());
+
+  // Segment plane and cube, the points of an inspected stack are its only cluster
+  stage_start = stage_end;
+  if (inspecting)
+    g_perception->segmentRoi(g_camera_to_world, inspect_roi);
+  else
+    g_perception->segment();
+  stage_end = ros::WallTime::now();
+  g_segment_metric->observe((stage_end - stage_start).toSec());
+
+  stage_start = stage_end;
+  if (g_perception_compact)
+    processFrame(*g_perception_compact, cloud_input_msg);
+  else
+    processFrame(*g_perception_full, cloud_input_msg);
+  g_clusters_metric->observe((ros::WallTime::now() - stage_start).toSec());
+  g_frames_processed_metric->add();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void Cw3Solution::processFrame(PerceptionPipeline<PointType> &pipeline,
+                               const sensor_msgs::PointCloud2ConstPtr &cloud_input_msg)
+{
+  /* Finds the centroid, bounds and colours of every cluster of the frame */
+
+  // Obstacles for the planning scene, everything above the floor is used
+  if (g_occupancy_integrating && not g_inspect_active)
+    g_occupancy.integrate(*pipeline.g_cloud_filtered, g_camera_to_world);
+
+  // Clouds arrive at the camera rate, so the sizes are printed at most once a second
+  ROS_DEBUG_THROTTLE(1.0, "%zu points above the floor in %zu clusters",
+                     pipeline.g_cloud_filtered->size(), pipeline.g_arena.clusterCount());
+
+  // The task threads copy the lists and the camera pose of the same cloud
+  boost::mutex::scoped_lock frame_lock(g_frame_mutex);
+  g_frame_world_to_camera = g_world_to_camera;
+  if (g_task_recorder)
+  {
+    g_frame_cloud = cloud_input_msg;
+    g_frame_camera_to_world = g_camera_to_world;
+  }
 
   // Clear the lists
   g_centroids.clear();
@@ -1367,128 +2262,93 @@ void Cw3Solution::cloudCallBackOne(const sensor_msgs::PointCloud2ConstPtr &cloud
   g_clusters_max_x_y.clear();
   g_colors.clear();
   g_colors_count.clear();
+  g_colour_hists.clear();
 
-  std_msgs::ColorRGBA Color;
-
-  for (std::vector<pcl::PointIndices>::const_iterator it = g_cluster_indices.begin(); it != g_cluster_indices.end(); ++it)
+  // Sent as a shared pointer, subscribers in the same process get it without a copy
+  cw3_team_2::CubeDetectionArrayPtr detections;
+  if (g_pub_detections.getNumSubscribers() > 0)
   {
-    pcl::PointCloud<PointT>::Ptr cloud_cluster(new pcl::PointCloud<PointT>);
-    for (const auto &idx : it->indices)
-      cloud_cluster->push_back((*g_cloud_filtered)[idx]); //*
-    cloud_cluster->width = cloud_cluster->size();
-    cloud_cluster->height = 1;
-    cloud_cluster->is_dense = true;
+    detections.reset(new cw3_team_2::CubeDetectionArray);
+    detections->header.frame_id = "panda_link0";
+    detections->header.stamp = g_camera_stamp;
+    detections->frame_seq = g_processed_frames;
+    detections->detections.reserve(pipeline.g_arena.clusterCount());
+  }
 
-    ROS_INFO("Number of data points in the curent PointCloud cluster: ", cloud_cluster->size());
+  for (size_t c = 0; c < pipeline.g_arena.clusterCount(); c++)
+  {
+    // The cluster buffers are reused from frame to frame
+    ClusterBuffers<PointType> &cluster = pipeline.g_arena.cluster(c);
+    typename pcl::PointCloud<PointType>::Ptr &cloud_cluster = cluster.camera;
+    pipeline.extractCluster(cluster.indices, *cloud_cluster, cluster.rgba);
 
     // finding centroid pose of current cube cluster found
-    g_current_centroid = findCubePose(cloud_cluster);
-
-    sensor_msgs::PointCloud2 temp_cloud;
-    pcl::toROSMsg(*cloud_cluster, temp_cloud);
-    sensor_msgs::PointCloud cloud_cluster_camera;
-    sensor_msgs::convertPointCloud2ToPointCloud(temp_cloud, cloud_cluster_camera);
-    cloud_cluster_camera.header.frame_id = g_input_pc_frame_id_;
-    cloud_cluster_camera.header.stamp = ros::Time(0);
-    sensor_msgs::PointCloud cloud_cluster_world;
-    try
-    {
-      g_listener_.transformPointCloud("panda_link0",
-                                      cloud_cluster_camera,
-                                      cloud_cluster_world);
-    }
-    catch (tf::TransformException &ex)
-    {
-      ROS_ERROR("Received a trasnformation exception: %s", ex.what());
-    }
-
-    sensor_msgs::convertPointCloudToPointCloud2(cloud_cluster_world, temp_cloud);
-    PointC cloud_world;
-    pcl::fromROSMsg(temp_cloud, cloud_world);
-
-    // finding min and max depth points of the cluster
-    PointT minPt, maxPt;
-    pcl::getMinMax3D(cloud_world, minPt, maxPt);
-    g_current_cluster_max.x = maxPt.x;
-    g_current_cluster_max.y = maxPt.y;
-    g_current_cluster_max.z = maxPt.z;
-    g_current_cluster_min.x = minPt.x;
-    g_current_cluster_min.y = minPt.y;
-    g_current_cluster_min.z = minPt.z;
-
-    g_number_of_cubes_in_stack = round(((g_current_cluster_max.z) - 0.017) / 0.04); // Calculate number of cubes in the stack
-
-    // Initialising variables
-    g_current_cluster_max_x_y = 0.0;
-    g_current_cluster_max_y_x = 0.0;
+    g_current_centroid = findCubePose(*cloud_cluster);
 
-    g_current_stack_colours.clear();
-    g_current_stack_cube_color_count.clear();
+    pcl::transformPointCloud(*cloud_cluster, *cluster.world, g_camera_to_world.matrix());
+    const pcl::PointCloud<PointType> &cloud_world = *cluster.world;
+    ClusterStats &stats = cluster.stats;
 
-    g_current_color.r = 0;
-    g_current_color.g = 0;
-    g_current_color.b = 0;
-    g_current_color_count = 0;
-
-    // Iterate through every point in a cluster
-    for (int nIndex = 0; nIndex < cloud_world.size(); nIndex++)
+    // Colours of the stack layers are only read from the cluster found at the stack centroid
+    int stack_layers = 0;
+    bool verified_stack = false;
+    if (g_verify_active)
     {
-
-      if ((cloud_world[nIndex].x) == g_current_cluster_max.x) // Finding the y coordinate that corresoponds with the max depth points x coordiante
+      if (hypot(g_current_centroid.point.x - g_verify_point.x, g_current_centroid.point.y - g_verify_point.y) < 0.04)
       {
-        g_current_cluster_max_x_y = cloud_world[nIndex].y;
+        stack_layers = g_verify_layers;
+        verified_stack = true;
       }
-      if ((cloud_world[nIndex].y) == g_current_cluster_max.y) // Finding the x coordinate that corresoponds with the max depth points y coordiante
+    }
+    else if ((g_number_of_cubes_in_recorded_stack > 0) && (g_check_objects_stack == true))
+    {
+      // Calculating the Euclidean distance between the current centroid and the centroid of the stack
+      eu_distance = sqrt(pow((g_current_centroid.point.x - g_oldcentroids[stack_index].point.x), 2) + pow((g_current_centroid.point.y - g_oldcentroids[stack_index].point.y), 2));
+      if (eu_distance < 0.04)
       {
-        g_current_cluster_max_y_x = cloud_world[nIndex].x;
+        stack_layers = g_number_of_cubes_in_recorded_stack;
       }
+    }
 
-      if ((g_number_of_cubes_in_recorded_stack > 0) && (g_check_objects_stack == true))
-      {
-        // Calculating the Euclidean distance between the current centroid and the centroid of the stack
-        eu_distance = sqrt(pow((g_current_centroid.point.x - g_oldcentroids[stack_index].point.x), 2) + pow((g_current_centroid.point.y - g_oldcentroids[stack_index].point.y), 2));
-        if (eu_distance < 0.04)
-        {
+    // finding min and max depth points, orientation points and colours of the cluster
+    pipeline.computeClusterStats(cloud_world, cluster.rgba, stack_layers, g_check_objects_floor, stats);
 
-          for (int i = 0; i < g_number_of_cubes_in_recorded_stack; i++)
-          {
-            // Creating the lower bound
-            g_pt_world_lb.header.frame_id = "panda_link0";
-            g_pt_world_lb.header.stamp = ros::Time(0);
-            g_pt_world_lb.point.x = -2;
-            g_pt_world_lb.point.y = -2;
-            g_pt_world_lb.point.z = ((0.03) + ((i)*0.04));
-
-            // Creating the upper bound
-            g_pt_world_ub.header.frame_id = "panda_link0";
-            g_pt_world_ub.header.stamp = ros::Time(0);
-            g_pt_world_ub.point.x = 2;
-            g_pt_world_ub.point.y = 2;
-            g_pt_world_ub.point.z = (((i + 1) * 0.04));
-
-            if (((cloud_world[nIndex].z) < g_pt_world_ub.point.z) && ((cloud_world[nIndex].z) > g_pt_world_lb.point.z))
-            { // Find the colours of the cubes on the stack by adding the RGB values of all the points in the cluster
-              g_current_stack_colours[i].r = g_current_stack_colours[i].r + cloud_cluster->points[nIndex].r;
-              g_current_stack_colours[i].g = g_current_stack_colours[i].g + cloud_cluster->points[nIndex].g;
-              g_current_stack_colours[i].b = g_current_stack_colours[i].b + cloud_cluster->points[nIndex].b;
-
-              g_current_stack_cube_color_count[i] = g_current_stack_cube_color_count[i] + 1;
-            }
-          }
-        }
-      }
+    if (verified_stack)
+    {
+      g_verify_stats = stats;
+      g_verify_centroid = g_current_centroid.point;
+      g_verify_found = true;
+    }
 
-      if (g_check_objects_floor == true) // Find the colours of the cubes on the floor by adding the RGB values of all the points in the cluster
-      {
+    g_current_cluster_max.x = stats.max_pt.x;
+    g_current_cluster_max.y = stats.max_pt.y;
+    g_current_cluster_max.z = stats.max_pt.z;
+    g_current_cluster_min.x = stats.min_pt.x;
+    g_current_cluster_min.y = stats.min_pt.y;
+    g_current_cluster_min.z = stats.min_pt.z;
 
-        g_current_color.r = g_current_color.r + cloud_cluster->points[nIndex].r;
-        g_current_color.g = g_current_color.g + cloud_cluster->points[nIndex].g;
-        g_current_color.b = g_current_color.b + cloud_cluster->points[nIndex].b;
+    g_number_of_cubes_in_stack = round(((g_current_cluster_max.z) - 0.017) / 0.04); // Calculate number of cubes in the stack
 
-        g_current_color_count = g_current_color_count + 1;
-      }
+    g_current_cluster_max_x_y = stats.max_x_y;
+    g_current_cluster_max_y_x = stats.max_y_x;
+
+    // Add the colours of the stack layers to the totals of the current scan, these are
+    // initialised by the task callbacks so they must not be cleared here
+    for (int i = 0; i < stack_layers && i < g_current_stack_colours.size(); i++)
+    {
+      g_current_stack_colours[i].r = g_current_stack_colours[i].r + stats.layer_r[i];
+      g_current_stack_colours[i].g = g_current_stack_colours[i].g + stats.layer_g[i];
+      g_current_stack_colours[i].b = g_current_stack_colours[i].b + stats.layer_b[i];
+
+      g_current_stack_cube_color_count[i] = g_current_stack_cube_color_count[i] + stats.layer_count[i];
+      g_current_stack_hists[i].add(stats.layer_hist[i]);
     }
 
+    g_current_color.r = stats.r;
+    g_current_color.g = stats.g;
+    g_current_color.b = stats.b;
+    g_current_color_count = stats.color_count;
+
     // Store the centroids and the min and max values of the cluster to their respective clusters
     g_centroids.push_back(g_current_centroid);
     g_clusters_max.push_back(g_current_cluster_max);
@@ -1500,200 +2360,240 @@ void Cw3Solution::cloudCallBackOne(const sensor_msgs::PointCloud2ConstPtr &cloud
     {
       g_colors.push_back(g_current_color);
       g_colors_count.push_back(g_current_color_count);
+      g_colour_hists.push_back(stats.hist);
+    }
+
+    if (detections)
+    {
+      cw3_team_2::CubeDetection detection;
+      detection.centroid = g_current_centroid.point;
+      detection.min = g_current_cluster_min;
+      detection.max = g_current_cluster_max;
+      detection.yaw = atan2(stats.max_pt.x - stats.max_y_x, stats.max_pt.y - stats.max_x_y);
+      detection.colour_class = stats.hist.majority();
+      if (stats.color_count > 0)
+      {
+        detection.colour.r = stats.r / stats.color_count / 255.0;
+        detection.colour.g = stats.g / stats.color_count / 255.0;
+        detection.colour.b = stats.b / stats.color_count / 255.0;
+        detection.colour.a = 1.0;
+      }
+      detection.point_count = cloud_cluster->size();
+      detection.stack_layers = g_number_of_cubes_in_stack;
+      detections->detections.push_back(detection);
     }
   }
 
-  // Finding centroid pose of the entire filtered cloud to publish
-  findCubePose(g_cloud_filtered);
+  // Debug output, skipped while nobody listens and rate limited apart from the frames
+  if (g_debug.cloudDue())
+    g_debug.publishCloud(*pipeline.g_cloud_filtered, g_input_pc_frame_id_, g_camera_stamp);
+  if (g_debug.detectionsDue())
+    g_debug.publishDetections(g_centroids);
 
-  // Publish the data
-  ROS_INFO("Publishing Filtered Cloud");
-  pubFilteredPCMsg(g_pub_cloud, *g_cloud_filtered);
+  if (detections)
+    g_pub_detections.publish(detections);
+
+  g_processed_frames++;
 
   return;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::applyVX(PointCPtr &in_cloud_ptr,
-                          PointCPtr &out_cloud_ptr)
+void Cw3Solution::jointStateCallback(const sensor_msgs::JointStateConstPtr &msg)
 {
-  /*this is used to downsample a point cloud using a voxel grid filter*/
-  g_vx.setInputCloud(in_cloud_ptr);
-  g_vx.setLeafSize(g_vg_leaf_sz, g_vg_leaf_sz, g_vg_leaf_sz);
-  g_vx.filter(*out_cloud_ptr);
-
-  return;
+  g_frame_gate.addJointState(*msg);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::applyFF(PointCPtr &in_cloud_ptr,
-                          PointCPtr &out_cloud_ptr)
+bool Cw3Solution::waitForSettledFrame(double timeout, bool record_frame)
 {
+  /* The gate only lets settled clouds through, so any cloud processed since
+     the last motion started was taken at the current pose. Scans that average
+     several clouds move g_consumed_frames on to wait for a newer one */
+
+  // A replay processes the cloud the recorded run used, on this thread
+  if (g_task_replay)
+    return replayFrame();
+
+  // A check without a motion before it needs a cloud a streaming camera
+  // sends anyway, but the benchmark robot only renders when asked
+  if (g_processed_frames <= g_consumed_frames)
+    robot_->requestFrame();
+
+  bool settled = true;
+  ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+  while (g_processed_frames <= g_consumed_frames)
+  {
+    if (not ros::ok() || g_cancel_requested || ros::WallTime::now() > deadline)
+    {
+      g_frame_timeouts_metric->add();
+      settled = false;
+      break;
+    }
+    ros::WallDuration(0.01).sleep();
+  }
 
-  /* This function is used to apply a colour filter to a point cloud to remove the floor*/
-
-  geometry_msgs::PointStamped pt_camera;
-  geometry_msgs::PointStamped pt_world;
-  double lb_x = 0.0;
-  double lb_y = 0.0;
-  double lb_z = 0.03;
-  pt_world.header.frame_id = "panda_link0";
-  pt_world.header.stamp = ros::Time(0);
-  pt_world.point.x = lb_x;
-  pt_world.point.y = lb_y;
-  pt_world.point.z = lb_z;
-  try
+  if (g_task_recorder && not settled)
   {
-    g_listener_.transformPoint(g_input_pc_frame_id_,
-                               pt_world,
-                               pt_camera);
+    g_task_recorder->writeNoFrame();
   }
-  catch (tf::TransformException &ex)
+  else if (g_task_recorder && record_frame)
   {
-    ROS_ERROR("Received a trasnformation exception: %s", ex.what());
+    boost::mutex::scoped_lock lock(g_frame_mutex);
+    recordFrameLocked();
   }
 
-  lb_z = pt_camera.point.z;
-
-  // determines if a point meets this condition
-  pcl::ConditionAnd<PointT>::Ptr range_condition(new pcl::ConditionAnd<PointT>());
+  return settled;
+}
 
-  pcl::FieldComparison<PointT>::ConstPtr ub(new pcl::FieldComparison<PointT>("z", pcl::ComparisonOps::LT, lb_z));
-  range_condition->addComparison(ub);
+////////////////////////////////////////////////////////////////////////////////
+void Cw3Solution::recordFrameLocked()
+{
+  /* A replay hands this cloud to the wait it belongs to, in log order */
 
-  g_ff.setCondition(range_condition);
-  g_ff.setInputCloud(in_cloud_ptr);
-  g_ff.filter(*out_cloud_ptr);
+  if (not g_task_recorder)
+    return;
 
-  return;
+  if (g_frame_cloud)
+    g_task_recorder->writeFrame(*g_frame_cloud, g_frame_camera_to_world);
+  else
+    g_task_recorder->writeNoFrame();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::findNormals(PointCPtr &in_cloud_ptr)
+bool Cw3Solution::replayFrame()
 {
-  // Estimate point normals
-  g_ne.setInputCloud(in_cloud_ptr);
-  g_ne.setSearchMethod(g_tree_ptr);
-  g_ne.setKSearch(g_k_nn);
-  g_ne.compute(*g_cloud_normals);
+  /* Takes the place of the camera, the frame gate and the TF lookup. A wait
+     that timed out in the recorded run times out again */
 
-  return;
+  if (g_task_replay->readNoFrame())
+    return false;
+
+  sensor_msgs::PointCloud2Ptr cloud(new sensor_msgs::PointCloud2);
+  if (not g_task_replay->readFrame(*cloud, g_camera_to_world))
+  {
+    ROS_ERROR("Replay diverged at record %zu, no cloud was used here", g_task_replay->position());
+    return false;
+  }
+
+  g_world_to_camera = g_camera_to_world.inverse();
+  g_camera_stamp = cloud->header.stamp;
+  g_input_pc_frame_id_ = cloud->header.frame_id;
+  processCloud(cloud);
+
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::segPlane(PointCPtr &in_cloud_ptr)
+bool Cw3Solution::taskRunning()
 {
-  // Create the segmentation object for the planar model
-  // and set all the params
-  g_seg.setOptimizeCoefficients(true);
-  g_seg.setModelType(pcl::SACMODEL_NORMAL_PLANE);
-  g_seg.setNormalDistanceWeight(0.1);
-  g_seg.setMethodType(pcl::SAC_RANSAC);
-  g_seg.setMaxIterations(100);
-  g_seg.setDistanceThreshold(0.03);
-  g_seg.setInputCloud(in_cloud_ptr);
-  g_seg.setInputNormals(g_cloud_normals);
-
-  // Obtain the plane inliers and coefficients
-  g_seg.segment(*g_inliers_plane, *g_coeff_plane);
-
-  Cw3Solution::extractInlier(in_cloud_ptr);
+  boost::unique_lock<boost::mutex> lock(g_task_mutex, boost::try_to_lock);
+  return not lock.owns_lock();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::segClusters(PointCPtr &in_cloud_ptr)
+void Cw3Solution::cancelTask()
 {
+  g_cancel_requested = true;
+}
 
-  /*this function is used to extract euclidean cluster*/
-
-  std::cout << "Number of data points in the unclustered PointCloud: " << in_cloud_ptr->size() << std::endl;
+////////////////////////////////////////////////////////////////////////////////
+bool Cw3Solution::beginTask(boost::unique_lock<boost::mutex> &task_lock)
+{
+  /* The services and the action servers run tasks on different threads.
+     A service refuses a second task, an action goal tries again until the
+     lock is free */
 
-  // To clear previous cluster indices
-  g_cluster_indices.clear();
+  boost::unique_lock<boost::mutex> lock(g_task_mutex, boost::try_to_lock);
+  if (not lock.owns_lock())
+    return false;
+  task_lock.swap(lock);
 
-  g_ec.setClusterTolerance(0.02); // 2cm
+  g_cancel_requested = false;
+  g_cubes_placed = 0;
+  g_num_of_cubes_to_stack = 0;
 
-  // Minimum set so that half cut cubes are not classified as clusters
-  g_ec.setMinClusterSize(200);
-  g_ec.setMaxClusterSize(300000);
-  g_ec.setSearchMethod(g_tree_ptr);
-  g_ec.setInputCloud(in_cloud_ptr);
-  g_ec.extract(g_cluster_indices);
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::extractInlier(PointCPtr &in_cloud_ptr)
+void Cw3Solution::reportProgress(const std::string &phase)
 {
-  /* A function to extract the inliers from the input cloud */
-
-  // Extract the planar inliers from the input cloud
-  g_extract_pc.setInputCloud(in_cloud_ptr);
-  g_extract_pc.setIndices(g_inliers_plane);
-  g_extract_pc.setNegative(false);
-
-  // Write the planar inliers to disk
-  g_extract_pc.filter(*g_cloud_plane);
-
-  // Remove the planar inliers, extract the rest
-  g_extract_pc.setNegative(true);
-  g_extract_pc.filter(*g_cloud_filtered2);
-  g_extract_normals.setNegative(true);
-  g_extract_normals.setInputCloud(g_cloud_normals);
-  g_extract_normals.setIndices(g_inliers_plane);
-  g_extract_normals.filter(*g_cloud_normals2);
+  ROS_INFO("Task phase: %s", phase.c_str());
+
+  if (g_progress_callback)
+    g_progress_callback(phase);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-geometry_msgs::PointStamped
-Cw3Solution::findCubePose(PointCPtr &in_cloud_ptr)
+bool Cw3Solution::snapshotCameraTransform(const std_msgs::Header &header)
 {
+  /* Looks the camera pose up at the stamp of the cloud, a single lookup
+     replaces the ones each stage used to make at ros::Time(0) */
 
-  Eigen::Vector4f centroid_in;
-  pcl::compute3DCentroid(*in_cloud_ptr, centroid_in);
+  g_camera_stamp = header.stamp;
 
-  g_cube_pt_msg.header.frame_id = g_input_pc_frame_id_;
-  g_cube_pt_msg.header.stamp = ros::Time(0);
-  g_cube_pt_msg.point.x = centroid_in[0];
-  g_cube_pt_msg.point.y = centroid_in[1];
-  g_cube_pt_msg.point.z = centroid_in[2];
+  // A cloud left waiting in the queue while the arm moved on is of no use
+  if (not header.stamp.isZero() && (ros::Time::now() - header.stamp).toSec() > g_max_cloud_age)
+  {
+    ROS_WARN("Dropping point cloud %.3f s old", (ros::Time::now() - header.stamp).toSec());
+    g_frames_stale_metric->add();
+    return false;
+  }
 
-  // Transform the point to new frame
-  geometry_msgs::PointStamped g_cube_pt_msg_out;
   try
   {
-    g_listener_.transformPoint("panda_link0",
-                               g_cube_pt_msg,
-                               g_cube_pt_msg_out);
+    tf::StampedTransform transform;
+    g_listener_.waitForTransform("panda_link0", header.frame_id, header.stamp,
+                                 ros::Duration(g_tf_timeout));
+    g_listener_.lookupTransform("panda_link0", header.frame_id, header.stamp, transform);
+
+    Eigen::Affine3d camera_to_world;
+    tf::transformTFToEigen(transform, camera_to_world);
+    g_camera_to_world = Eigen::Isometry3f(camera_to_world.cast<float>().matrix());
+    g_world_to_camera = g_camera_to_world.inverse();
   }
   catch (tf::TransformException &ex)
   {
-    ROS_ERROR("Received a trasnformation exception: %s", ex.what());
+    ROS_ERROR("Skipping point cloud, no camera transform: %s", ex.what());
+    g_frames_transform_metric->add();
+    return false;
   }
 
-  publishPose(g_cube_pt_msg_out);
-
-  g_current_centroid = g_cube_pt_msg_out;
-
-  return g_cube_pt_msg_out;
+  return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::pubFilteredPCMsg(ros::Publisher &pc_pub,
-                                   PointC &pc)
+double Cw3Solution::findFloorDepth()
 {
-  // Publish the data
-  pcl::toROSMsg(pc, g_cloud_filtered_msg);
-  pc_pub.publish(g_cloud_filtered_msg);
 
-  return;
+  /* This function is used to find the depth used by the floor filter to remove the floor*/
+
+  Eigen::Vector3f pt_world(0.0, 0.0, 0.03);
+
+  return (g_world_to_camera * pt_world).z();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void Cw3Solution::publishPose(geometry_msgs::PointStamped &cube_pt_msg)
+template <typename PointType>
+geometry_msgs::PointStamped
+Cw3Solution::findCubePose(const pcl::PointCloud<PointType> &in_cloud)
 {
-  // Create and publish the cube pose (ignore orientation)
 
-  g_pub_pose.publish(cube_pt_msg);
+  Eigen::Vector4f centroid_in;
+  pcl::compute3DCentroid(in_cloud, centroid_in);
+
+  // Transform the point to new frame
+  Eigen::Vector3f centroid_out = g_camera_to_world * centroid_in.head<3>();
 
-  return;
+  geometry_msgs::PointStamped g_cube_pt_msg_out;
+  g_cube_pt_msg_out.header.frame_id = "panda_link0";
+  g_cube_pt_msg_out.header.stamp = g_camera_stamp;
+  g_cube_pt_msg_out.point.x = centroid_out[0];
+  g_cube_pt_msg_out.point.y = centroid_out[1];
+  g_cube_pt_msg_out.point.z = centroid_out[2];
+
+  g_current_centroid = g_cube_pt_msg_out;
+
+  return g_cube_pt_msg_out;
 }
@@ -33,6 +33,8 @@
  */
 
 #include <cw3_team_2/cw3_team_2.h>
+#include <cw3_team_2/job_queue.h>
+#include <cw3_team_2/task_action_server.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 int
@@ -65,6 +67,12 @@ main (int argc, char** argv)
   // Create a Lab object
   Cw3Solution cw3_team_2 (nh);
 
+  // The same tasks as actions, each run on its own thread with feedback and cancel
+  TaskActionServer task_actions (nh, cw3_team_2);
+
+  // Stacking jobs queued back to back, sharing the scan of the front mat
+  JobQueue job_queue (nh, cw3_team_2);
+
   // // Create a ROS subscriber for the input point cloud
   // ros::Subscriber sub_cloud =
   //   nh.subscribe ("/r200/camera/depth_registered/points",
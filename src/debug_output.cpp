@@ -0,0 +1,135 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/debug_output.h>
+#include <cw3_team_2/perception_pipeline.h>
+
+#include <geometry_msgs/PoseArray.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+////////////////////////////////////////////////////////////////////////////////
+DebugOutput::DebugOutput() : leaf_size_(0.0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DebugOutput::advertise(ros::NodeHandle &nh, double rate, double leaf_size)
+{
+  /* Not latched, a late subscriber waits for the next frame rather than
+     getting one left over from the last time anybody listened */
+
+  cloud_pub_ = nh.advertise<sensor_msgs::PointCloud2>("filtered_cloud", 1);
+  detections_pub_ = nh.advertise<geometry_msgs::PoseArray>("cube_pts", 1);
+
+  period_ = ros::WallDuration(rate > 0.0 ? 1.0 / rate : 0.0);
+  leaf_size_ = leaf_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DebugOutput::cloudDue()
+{
+  return due(cloud_pub_, last_cloud_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DebugOutput::detectionsDue()
+{
+  return due(detections_pub_, last_detections_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DebugOutput::due(const ros::Publisher &pub, ros::WallTime &last)
+{
+  if (not pub || pub.getNumSubscribers() == 0)
+    return false;
+
+  ros::WallTime now = ros::WallTime::now();
+  if (now - last < period_)
+    return false;
+
+  last = now;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void DebugOutput::publishCloud(const pcl::PointCloud<PointType> &cloud,
+                               const std::string &frame_id,
+                               const ros::Time &stamp)
+{
+  /* Only runs at the debug rate, so the filter and its output are not kept
+     between frames, and a single thread leaves the cores to the perception */
+
+  if (leaf_size_ > 0.0)
+  {
+    pcl::PointCloud<PointType> decimated;
+    VoxelDownsampler<PointType> grid;
+    grid.setLeafSize(leaf_size_);
+    grid.setThreads(1);
+    grid.filter(cloud, decimated);
+    pcl::toROSMsg(decimated, cloud_msg_);
+  }
+  else
+  {
+    pcl::toROSMsg(cloud, cloud_msg_);
+  }
+
+  cloud_msg_.header.frame_id = frame_id;
+  cloud_msg_.header.stamp = stamp;
+  cloud_pub_.publish(cloud_msg_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DebugOutput::publishDetections(const std::vector<geometry_msgs::PointStamped> &centroids)
+{
+  geometry_msgs::PoseArray msg;
+  if (not centroids.empty())
+    msg.header = centroids[0].header;
+
+  msg.poses.resize(centroids.size());
+  for (size_t i = 0; i < centroids.size(); i++)
+  {
+    msg.poses[i].position = centroids[i].point;
+    msg.poses[i].orientation.w = 1.0;
+  }
+
+  detections_pub_.publish(msg);
+}
+
+// The clouds of both point layouts of the pipeline
+template void DebugOutput::publishCloud<PointT>(const pcl::PointCloud<PointT> &,
+                                                const std::string &, const ros::Time &);
+template void DebugOutput::publishCloud<CompactPointT>(const pcl::PointCloud<CompactPointT> &,
+                                                       const std::string &, const ros::Time &);
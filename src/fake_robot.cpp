@@ -0,0 +1,437 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/fake_robot.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <pcl_conversions/pcl_conversions.h>
+#include <tf_conversions/tf_eigen.h>
+
+namespace
+{
+  /** \brief Rotation of a downward facing end effector about the world z axis */
+  float
+  yawOf(const Eigen::Quaternionf &orientation)
+  {
+    Eigen::Matrix3f rotation = orientation.toRotationMatrix();
+    return std::atan2(rotation(1, 0), rotation(0, 0));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+FakeRobotConfig::FakeRobotConfig() : linear_speed(0.25),
+                                     angular_speed(1.0),
+                                     gripper_speed(0.05),
+                                     settle_time(0.2),
+                                     planning_time_median(0.05),
+                                     planning_time_sigma(0.5),
+                                     planning_failure_rate(0.0),
+                                     finger_offset(0.125),
+                                     grasp_tolerance(0.015),
+                                     camera_offset(0.05f, 0.0f, 0.04f),
+                                     seed(1)
+{
+  camera.width = 320;
+  camera.height = 240;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+FakeRobot::FakeRobot(const FakeRobotConfig &config) : camera_frame_("camera_depth_optical_frame"),
+                                                      base_frame_("panda_link0"),
+                                                      config_(config),
+                                                      rng_(config.seed),
+                                                      planning_time_dist_(std::log(config.planning_time_median),
+                                                                          config.planning_time_sigma),
+                                                      failure_dist_(0.0, 1.0),
+                                                      transformer_(NULL),
+                                                      frame_seq_(0),
+                                                      elapsed_time_(0.0),
+                                                      perception_time_(0.0),
+                                                      planning_failures_(0),
+                                                      requested_frames_(0)
+{
+  resetWorld(std::vector<SyntheticCube>());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::moveArm(const geometry_msgs::Pose &target_pose, MotionType type)
+{
+  /* Jumps to the target after charging the planning and travel time, any
+     carried cube moves with the fingers */
+
+  double planning_time = planning_time_dist_(rng_);
+  planning_times_.push_back(planning_time);
+  elapsed_time_ += planning_time;
+
+  bool success = failure_dist_(rng_) >= config_.planning_failure_rate;
+  if (success)
+  {
+    travelTo(target_pose);
+    elapsed_time_ += config_.settle_time;
+  }
+  else
+  {
+    planning_failures_++;
+  }
+
+  publishFrame();
+
+  return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                               const std::vector<MotionType> &types)
+{
+  /* Every segment is planned before the arm moves, then the arm only comes
+     to rest at the last pose */
+
+  for (size_t i = 0; i < waypoints.size(); i++)
+  {
+    double planning_time = planning_time_dist_(rng_);
+    planning_times_.push_back(planning_time);
+    elapsed_time_ += planning_time;
+
+    if (failure_dist_(rng_) < config_.planning_failure_rate)
+    {
+      planning_failures_++;
+      publishFrame();
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < waypoints.size(); i++)
+    travelTo(waypoints[i]);
+  elapsed_time_ += config_.settle_time;
+
+  publishFrame();
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::travelTo(const geometry_msgs::Pose &target_pose)
+{
+  /* Charges the travel time without settling, any carried cube moves with
+     the fingers */
+
+  Eigen::Vector3f position(target_pose.position.x, target_pose.position.y, target_pose.position.z);
+  Eigen::Quaternionf orientation(target_pose.orientation.w, target_pose.orientation.x,
+                                 target_pose.orientation.y, target_pose.orientation.z);
+  orientation.normalize();
+
+  double travel_time = (position - position_).norm() / config_.linear_speed;
+  double turn_time = orientation.angularDistance(orientation_) / config_.angular_speed;
+  elapsed_time_ += std::max(travel_time, turn_time);
+
+  float yaw_change = yawOf(orientation) - yawOf(orientation_);
+  position_ = position;
+  orientation_ = orientation;
+
+  if (attached_cube_ >= 0)
+  {
+    cubes_[attached_cube_].centre = fingerCentre();
+    cubes_[attached_cube_].yaw += yaw_change;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::currentArmJoints(std::vector<double> &joints)
+{
+  /* The stand-in has no arm model, its only joint is the wrist, turning the
+     downward facing hand about z */
+
+  joints.assign(1, yawOf(orientation_));
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::solveArmIK(const geometry_msgs::Pose &pose,
+                           const std::vector<double> &seed,
+                           std::vector<double> &joints)
+{
+  /* The wrist reaches a yaw by any turn of it, the one closest to the seed
+     within the limits of the Panda wrist is taken */
+
+  const double limit = 2.8973;
+  Eigen::Quaternionf orientation(pose.orientation.w, pose.orientation.x,
+                                 pose.orientation.y, pose.orientation.z);
+  double wrist = yawOf(orientation.normalized());
+  double near = seed.empty() ? 0.0 : seed[0];
+
+  wrist += 2 * M_PI * std::round((near - wrist) / (2 * M_PI));
+  if (wrist > limit)
+    wrist -= 2 * M_PI;
+  if (wrist < -limit)
+    wrist += 2 * M_PI;
+  if (std::fabs(wrist) > limit)
+    return false;
+
+  joints.assign(1, wrist);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::moveGripper(double width, const std::string &object_name)
+{
+  /* Closing on a cube within reach of the fingers grasps it, opening lets
+     go of any carried cube */
+
+  double start_width = gripper_width_;
+
+  if (width < gripper_width_ && attached_cube_ < 0)
+  {
+    Eigen::Vector3f fingers = fingerCentre();
+    for (size_t i = 0; i < cubes_.size(); i++)
+    {
+      if ((cubes_[i].centre - fingers).norm() < config_.grasp_tolerance && width < cubes_[i].size)
+      {
+        attached_cube_ = i;
+        width = cubes_[i].size;
+        break;
+      }
+    }
+  }
+  else if (width > gripper_width_ && attached_cube_ >= 0)
+  {
+    settleCube(cubes_[attached_cube_]);
+    attached_cube_ = -1;
+  }
+
+  gripper_width_ = width;
+  elapsed_time_ += std::fabs(gripper_width_ - start_width) / config_.gripper_speed + config_.settle_time;
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool FakeRobot::fingerState(double &width, double &effort)
+{
+  /* Fingers closed on a cube stop at its size, there is no force model */
+
+  width = gripper_width_;
+  effort = std::numeric_limits<double>::quiet_NaN();
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::applyCollisionObjects(const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  /* The stand-in does no collision checking, so the planning scene is ignored */
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::warmUp(const std::vector<geometry_msgs::Pose> &poses,
+                       const std::vector<MotionType> &types)
+{
+  /* The planner model of the stand-in has nothing to load */
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::requestFrame()
+{
+  /* The camera only renders after a motion, or when asked like here */
+
+  requested_frames_++;
+  publishFrame();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::applyAttachedCollisionObjects(const std::vector<moveit_msgs::AttachedCollisionObject> &objects)
+{
+  /* The stand-in does no collision checking, so the planning scene is ignored */
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::resetWorld(const std::vector<SyntheticCube> &cubes)
+{
+  cubes_ = cubes;
+  attached_cube_ = -1;
+  gripper_width_ = 0.08;
+
+  // ready pose above the front of the mat, looking down
+  position_ = Eigen::Vector3f(0.3f, 0.0f, 0.5f);
+  orientation_ = Eigen::Quaternionf(0.0f, -1.0f, 0.0f, 0.0f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::setCloudCallback(const CloudCallback &callback)
+{
+  cloud_callback_ = callback;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::setTransformer(tf::Transformer *transformer)
+{
+  transformer_ = transformer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::publishFrame()
+{
+  /* Publishes the camera transform first, so the callback can look it up */
+
+  ros::Time stamp = ros::Time::now();
+  Eigen::Affine3f camera_to_world = cameraPose();
+
+  if (transformer_ != NULL)
+  {
+    tf::Transform transform;
+    tf::transformEigenToTF(camera_to_world.cast<double>(), transform);
+    transformer_->setTransform(tf::StampedTransform(transform, stamp, base_frame_, camera_frame_), "fake_robot");
+  }
+
+  if (cloud_callback_.empty())
+    return;
+
+  PointC cloud;
+  SyntheticSceneConfig camera = config_.camera;
+  camera.seed = config_.seed + (frame_seq_++);
+  renderScene(cubes_, camera_to_world, camera, cloud);
+
+  sensor_msgs::PointCloud2Ptr msg(new sensor_msgs::PointCloud2);
+  pcl::toROSMsg(cloud, *msg);
+  msg->header.frame_id = camera_frame_;
+  msg->header.stamp = stamp;
+  msg->header.seq = frame_seq_;
+
+  ros::WallTime start = ros::WallTime::now();
+  cloud_callback_(msg);
+  perception_time_ += (ros::WallTime::now() - start).toSec();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Eigen::Affine3f FakeRobot::cameraPose() const
+{
+  Eigen::Affine3f camera_to_world = Eigen::Affine3f::Identity();
+  camera_to_world.translate(position_);
+  camera_to_world.rotate(orientation_);
+  camera_to_world.translate(config_.camera_offset);
+
+  return camera_to_world;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const std::vector<SyntheticCube> &FakeRobot::cubes() const
+{
+  return cubes_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+double FakeRobot::elapsedTime() const
+{
+  return elapsed_time_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+double FakeRobot::perceptionTime() const
+{
+  return perception_time_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+const std::vector<double> &FakeRobot::planningTimes() const
+{
+  return planning_times_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int FakeRobot::planningFailures() const
+{
+  return planning_failures_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+int FakeRobot::requestedFrames() const
+{
+  return requested_frames_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+Eigen::Vector3f FakeRobot::fingerCentre() const
+{
+  // the fingers converge along the z axis of the end effector
+  return position_ + orientation_ * Eigen::Vector3f(0.0f, 0.0f, config_.finger_offset);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void FakeRobot::settleCube(SyntheticCube &cube) const
+{
+  /* Drops the cube straight down onto the highest cube below it */
+
+  float support = 0.0f;
+  for (size_t i = 0; i < cubes_.size(); i++)
+  {
+    const SyntheticCube &other = cubes_[i];
+    if (&other == &cube)
+      continue;
+
+    float dx = other.centre.x() - cube.centre.x();
+    float dy = other.centre.y() - cube.centre.y();
+    bool below = other.centre.z() < cube.centre.z();
+    if (below && std::sqrt(dx * dx + dy * dy) < 0.75f * cube.size)
+      support = std::max(support, other.centre.z() + other.size / 2.0f);
+  }
+
+  cube.centre.z() = support + cube.size / 2.0f;
+}
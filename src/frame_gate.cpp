@@ -0,0 +1,109 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/frame_gate.h>
+
+#include <cmath>
+
+////////////////////////////////////////////////////////////////////////////////
+FrameGate::FrameGate(double velocity_threshold, double settle_window)
+    : velocity_threshold_(velocity_threshold),
+      settle_window_(settle_window),
+      moving_(false),
+      has_joint_states_(false),
+      rejected_(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void FrameGate::addJointState(const sensor_msgs::JointState &msg)
+{
+  /* Finds the fastest arm joint, from the reported velocities when there are
+     some and from the change in position otherwise */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  bool use_velocity = (msg.velocity.size() == msg.name.size());
+  double dt = (msg.header.stamp - last_stamp_).toSec();
+  bool use_position = (not use_velocity && last_position_.size() == msg.position.size() && dt > 0.0);
+
+  double max_speed = 0.0;
+  for (size_t i = 0; i < msg.name.size() && i < msg.position.size(); i++)
+  {
+    if (msg.name[i].find("finger") != std::string::npos)
+      continue;
+
+    double speed = 0.0;
+    if (use_velocity)
+      speed = std::fabs(msg.velocity[i]);
+    else if (use_position)
+      speed = std::fabs(msg.position[i] - last_position_[i]) / dt;
+
+    if (speed > max_speed)
+      max_speed = speed;
+  }
+
+  last_position_ = msg.position;
+  last_stamp_ = msg.header.stamp;
+
+  // The first message has nothing to compare positions with, treat it as motion
+  moving_ = (max_speed >= velocity_threshold_) || (not use_velocity && not use_position);
+  if (moving_)
+    last_motion_ = msg.header.stamp;
+
+  has_joint_states_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void FrameGate::setEarliestStamp(const ros::Time &stamp)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  earliest_ = stamp;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool FrameGate::accept(const ros::Time &stamp)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  bool ok = (stamp >= earliest_);
+  if (ok && has_joint_states_)
+    ok = (not moving_) && ((stamp - last_motion_).toSec() >= settle_window_);
+
+  if (not ok)
+    rejected_++;
+
+  return ok;
+}
@@ -0,0 +1,136 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/job_queue.h>
+
+////////////////////////////////////////////////////////////////////////////////
+JobQueue::JobQueue(ros::NodeHandle &nh, Cw3Solution &solution)
+    : solution_(solution),
+      next_id_(1),
+      stopping_(false)
+{
+  queue_srv_ = nh.advertiseService("/stack_job", &JobQueue::queueCallback, this);
+  worker_ = boost::thread(boost::bind(&JobQueue::run, this));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+JobQueue::~JobQueue()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    stopping_ = true;
+    for (size_t i = 0; i < jobs_.size(); i++)
+      solution_.g_world_model.release(jobs_[i].id);
+    jobs_.clear();
+  }
+  cond_.notify_all();
+  solution_.cancelTask();
+  worker_.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t JobQueue::pending()
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  return jobs_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool JobQueue::queueCallback(cw3_world_spawner::Task2Service::Request &request,
+                             cw3_world_spawner::Task2Service::Response &response)
+{
+  Job job;
+  job.request = request;
+
+  // The claim is made under the queue lock, so the jobs claim in queue order
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    job.id = next_id_++;
+    if (not solution_.claimStackJob(job.id, job.request))
+    {
+      ROS_ERROR("Stack job %d rejected, not enough free cubes of the requested colours", job.id);
+      return false;
+    }
+    jobs_.push_back(job);
+    ROS_INFO("Stack job %d queued, %zu waiting", job.id, jobs_.size());
+  }
+  cond_.notify_one();
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void JobQueue::run()
+{
+  /* Jobs wait for tasks started by the services or the action servers, the
+     solution runs a single task at a time */
+
+  while (true)
+  {
+    Job job;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (jobs_.empty() && not stopping_)
+        cond_.wait(lock);
+      if (stopping_)
+        return;
+      job = jobs_.front();
+      jobs_.pop_front();
+    }
+
+    // The lock is taken here, a task started in between can not fail the job
+    boost::unique_lock<boost::mutex> task_lock;
+    while (not solution_.beginTask(task_lock))
+    {
+      if (not ros::ok())
+      {
+        solution_.g_world_model.release(job.id);
+        return;
+      }
+      ros::WallDuration(0.05).sleep();
+    }
+
+    ros::WallTime start = ros::WallTime::now();
+    bool success = solution_.runStackJob(job.id, job.request);
+
+    // Whatever the job still holds or claims goes back, also when it failed
+    solution_.g_world_model.release(job.id);
+
+    if (success)
+      ROS_INFO("Stack job %d done in %.1f s", job.id, (ros::WallTime::now() - start).toSec());
+    else
+      ROS_ERROR("Stack job %d failed", job.id);
+  }
+}
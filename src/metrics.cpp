@@ -0,0 +1,398 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/metrics.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+  /** \brief Buckets of the duration histograms, s, from a cloud stage to a
+    * whole pick */
+  const double kLatencyBounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                   0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0};
+
+  /** \brief How often the server checks whether it should stop, ms */
+  const int kPollTimeout = 200;
+
+  std::string
+  number (double value)
+  {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+  }
+
+  std::string
+  number (uint64_t value)
+  {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+    return text;
+  }
+
+  /** \brief A metric name with its labels and an optional extra label */
+  std::string
+  series (const std::string &name, const std::string &labels, const std::string &extra = "")
+  {
+    if (labels.empty() && extra.empty())
+      return name;
+    if (labels.empty())
+      return name + "{" + extra + "}";
+    if (extra.empty())
+      return name + "{" + labels + "}";
+    return name + "{" + labels + "," + extra + "}";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds)
+    : bounds_(bounds),
+      counts_(bounds.size() + 1),
+      sum_(0.0)
+{
+  for (size_t i = 0; i < counts_.size(); i++)
+    counts_[i].store(0, std::memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void MetricHistogram::observe(double value)
+{
+  /* Only the bucket of the value is counted, render adds them up. There is
+     no atomic add for doubles in C++11, so the sum is a compare and swap
+     loop, which only retries when two threads observe at the same time */
+
+  size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+
+  double sum = sum_.load(std::memory_order_relaxed);
+  while (not sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed))
+  {
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricsRegistry &MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricsRegistry::Entry *MetricsRegistry::find(const std::string &name,
+                                              const std::string &labels,
+                                              MetricKind kind)
+{
+  for (size_t i = 0; i < entries_.size(); i++)
+  {
+    if (entries_[i].name == name && entries_[i].labels == labels && entries_[i].kind == kind)
+      return &entries_[i];
+  }
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricCounter &MetricsRegistry::counter(const std::string &name,
+                                        const std::string &help,
+                                        const std::string &labels)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  Entry *entry = find(name, labels, KIND_COUNTER);
+  if (entry)
+    return *entry->counter;
+
+  Entry added;
+  added.name = name;
+  added.help = help;
+  added.labels = labels;
+  added.kind = KIND_COUNTER;
+  added.counter.reset(new MetricCounter);
+  entries_.push_back(added);
+  return *added.counter;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricGauge &MetricsRegistry::gauge(const std::string &name,
+                                    const std::string &help,
+                                    const std::string &labels)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  Entry *entry = find(name, labels, KIND_GAUGE);
+  if (entry)
+    return *entry->gauge;
+
+  Entry added;
+  added.name = name;
+  added.help = help;
+  added.labels = labels;
+  added.kind = KIND_GAUGE;
+  added.gauge.reset(new MetricGauge);
+  entries_.push_back(added);
+  return *added.gauge;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricHistogram &MetricsRegistry::histogram(const std::string &name,
+                                            const std::string &help,
+                                            const std::string &labels)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  Entry *entry = find(name, labels, KIND_HISTOGRAM);
+  if (entry)
+    return *entry->histogram;
+
+  Entry added;
+  added.name = name;
+  added.help = help;
+  added.labels = labels;
+  added.kind = KIND_HISTOGRAM;
+  added.histogram.reset(new MetricHistogram(std::vector<double>(
+      kLatencyBounds, kLatencyBounds + sizeof(kLatencyBounds) / sizeof(kLatencyBounds[0]))));
+  entries_.push_back(added);
+  return *added.histogram;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+std::string MetricsRegistry::render() const
+{
+  /* The text format wants the series of a family together under a single
+     HELP and TYPE, so entries are grouped by name in the order the names
+     were first registered. Values are read one at a time while updates go
+     on, a histogram count is the sum of the buckets read so it always
+     matches its +Inf bucket */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  std::string text;
+  std::vector<bool> done(entries_.size(), false);
+  for (size_t i = 0; i < entries_.size(); i++)
+  {
+    if (done[i])
+      continue;
+
+    const Entry &first = entries_[i];
+    const char *type = first.kind == KIND_COUNTER ? "counter"
+                     : first.kind == KIND_GAUGE ? "gauge" : "histogram";
+    text += "# HELP " + first.name + " " + first.help + "\n";
+    text += "# TYPE " + first.name + " " + type + "\n";
+
+    for (size_t j = i; j < entries_.size(); j++)
+    {
+      const Entry &entry = entries_[j];
+      if (done[j] || entry.name != first.name || entry.kind != first.kind)
+        continue;
+      done[j] = true;
+
+      if (entry.kind == KIND_COUNTER)
+      {
+        text += series(entry.name, entry.labels) + " " + number(entry.counter->value()) + "\n";
+      }
+      else if (entry.kind == KIND_GAUGE)
+      {
+        text += series(entry.name, entry.labels) + " " + number(entry.gauge->value()) + "\n";
+      }
+      else
+      {
+        const MetricHistogram &histogram = *entry.histogram;
+        uint64_t total = 0;
+        for (size_t b = 0; b < histogram.bounds().size(); b++)
+        {
+          total += histogram.bucketCount(b);
+          text += series(entry.name + "_bucket", entry.labels,
+                         "le=\"" + number(histogram.bounds()[b]) + "\"")
+                + " " + number(total) + "\n";
+        }
+        total += histogram.bucketCount(histogram.bounds().size());
+        text += series(entry.name + "_bucket", entry.labels, "le=\"+Inf\"")
+              + " " + number(total) + "\n";
+        text += series(entry.name + "_sum", entry.labels) + " " + number(histogram.sum()) + "\n";
+        text += series(entry.name + "_count", entry.labels) + " " + number(total) + "\n";
+      }
+    }
+  }
+
+  return text;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricsServer::MetricsServer(const MetricsRegistry &registry)
+    : registry_(registry),
+      listen_fd_(-1),
+      stop_(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+MetricsServer::~MetricsServer()
+{
+  stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool MetricsServer::start(int port)
+{
+  /* Bound to the loopback address only, the endpoint has no authentication
+     and is meant for a scraper on the same machine */
+
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0)
+    return false;
+
+  int reuse = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+      || listen(listen_fd_, 4) != 0)
+  {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+
+  stop_ = false;
+  thread_ = boost::thread(&MetricsServer::serve, this);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void MetricsServer::stop()
+{
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+
+  if (listen_fd_ >= 0)
+  {
+    close(listen_fd_);
+    listen_fd_ = -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void MetricsServer::serve()
+{
+  /* Scrapes come every few seconds, so connections are answered one at a
+     time on this thread. The poll timeout bounds how long stop waits */
+
+  while (not stop_)
+  {
+    pollfd listen_poll;
+    listen_poll.fd = listen_fd_;
+    listen_poll.events = POLLIN;
+    listen_poll.revents = 0;
+
+    int ready = poll(&listen_poll, 1, kPollTimeout);
+    if (ready <= 0)
+      continue;
+
+    int client = accept(listen_fd_, NULL, NULL);
+    if (client < 0)
+      continue;
+
+    answer(client);
+    close(client);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void MetricsServer::answer(int client)
+{
+  /* Only the request line matters, the headers are read with it and
+     ignored. A client that sends nothing within the timeout is dropped so it
+     cannot hold up the next scrape */
+
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n") == std::string::npos && request.size() < 8192)
+  {
+    pollfd client_poll;
+    client_poll.fd = client;
+    client_poll.events = POLLIN;
+    client_poll.revents = 0;
+    if (poll(&client_poll, 1, kPollTimeout * 5) <= 0)
+      return;
+
+    ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      return;
+    request.append(buffer, n);
+  }
+
+  std::string status, body;
+  if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0)
+  {
+    status = "200 OK";
+    body = registry_.render();
+  }
+  else
+  {
+    status = "404 Not Found";
+    body = "Only /metrics is served\n";
+  }
+
+  std::string response = "HTTP/1.0 " + status + "\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + number(static_cast<uint64_t>(body.size())) + "\r\n"
+                         "Connection: close\r\n\r\n" + body;
+
+  size_t sent = 0;
+  while (sent < response.size())
+  {
+    ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    sent += n;
+  }
+}
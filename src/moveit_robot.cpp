@@ -0,0 +1,456 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/moveit_robot.h>
+
+#include <cmath>
+#include <limits>
+
+#include <moveit/robot_state/conversions.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/trajectory_processing/time_optimal_trajectory_generation.h>
+
+namespace
+{
+  /** \brief Label value of a motion type in the timing metrics */
+  const char *kMotionLabels[] = {"motion=\"scan\"", "motion=\"approach\"", "motion=\"transfer\""};
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MoveItRobot::MoveItRobot() : warm_up_stop_(false)
+{
+  /* Racing is opt-in, planning through move_group stays the default */
+
+  ros::NodeHandle nh("~");
+  bool racing;
+  nh.param("planner_racing", racing, false);
+  nh.param("blend_tolerance", blend_tolerance_, 0.05);
+
+  MetricsRegistry &metrics = MetricsRegistry::instance();
+  for (int type = MOTION_SCAN; type <= MOTION_TRANSFER; type++)
+  {
+    plan_seconds_[type] = &metrics.histogram("cw3_plan_seconds", "Time to plan an arm motion", kMotionLabels[type]);
+    execute_seconds_[type] = &metrics.histogram("cw3_execute_seconds", "Time to execute an arm motion", kMotionLabels[type]);
+  }
+  through_plan_seconds_ = &metrics.histogram("cw3_plan_seconds", "Time to plan an arm motion", "motion=\"joined\"");
+  through_execute_seconds_ = &metrics.histogram("cw3_execute_seconds", "Time to execute an arm motion", "motion=\"joined\"");
+  gripper_seconds_ = &metrics.histogram("cw3_gripper_seconds", "Time to plan and move the gripper");
+
+  // Each interface blocks until move_group answers it, waiting for all of
+  // them at once takes as long as the slowest instead of their sum
+  ros::WallTime start = ros::WallTime::now();
+  boost::thread_group connecting;
+  connecting.create_thread([this]()
+  {
+    arm_group_.reset(new moveit::planning_interface::MoveGroupInterface("panda_arm"));
+  });
+  connecting.create_thread([this]()
+  {
+    hand_group_.reset(new moveit::planning_interface::MoveGroupInterface("hand"));
+  });
+  connecting.create_thread([this]()
+  {
+    planning_scene_interface_.reset(new moveit::planning_interface::PlanningSceneInterface);
+  });
+  connecting.create_thread([this]()
+  {
+    // The scene and the arm state as move_group sees them
+    scene_monitor_.reset(new planning_scene_monitor::PlanningSceneMonitor("robot_description"));
+    if (scene_monitor_->getPlanningScene())
+    {
+      scene_monitor_->startSceneMonitor("/move_group/monitored_planning_scene");
+      scene_monitor_->startStateMonitor();
+      scene_monitor_->requestPlanningSceneState("/get_planning_scene");
+    }
+    else
+    {
+      ROS_WARN("No planning scene, motions are not blended");
+      scene_monitor_.reset();
+    }
+  });
+  connecting.join_all();
+  ROS_INFO("Connected to move_group in %.2f s", (ros::WallTime::now() - start).toSec());
+
+  if (racing)
+  {
+    planner_race_.reset(new PlannerRace(nh, arm_group_->getName(), scene_monitor_));
+    if (not planner_race_->ready())
+      ROS_WARN("Planner racing unavailable, planning through move_group");
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MoveItRobot::~MoveItRobot()
+{
+  stopWarmUp();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::moveArm(const geometry_msgs::Pose &target_pose, MotionType type)
+{
+  /* This function moves the move_group to the target position */
+
+  stopWarmUp();
+
+  ros::WallTime start = ros::WallTime::now();
+  if (planner_race_ && planner_race_->ready())
+  {
+    moveit::planning_interface::MoveGroupInterface::Plan race_plan;
+    if (planner_race_->plan(target_pose, arm_group_->getEndEffectorLink(),
+                            arm_group_->getGoalPositionTolerance(),
+                            arm_group_->getGoalOrientationTolerance(),
+                            type, NULL, race_plan))
+    {
+      plan_seconds_[type]->observe((ros::WallTime::now() - start).toSec());
+      start = ros::WallTime::now();
+      bool executed = (arm_group_->execute(race_plan) ==
+                       moveit::planning_interface::MoveItErrorCode::SUCCESS);
+      execute_seconds_[type]->observe((ros::WallTime::now() - start).toSec());
+      return executed;
+    }
+
+    ROS_WARN("Planner race failed, planning through move_group");
+  }
+
+  // setup the target pose
+  ROS_INFO("Setting pose target");
+  arm_group_->setPoseTarget(target_pose);
+
+  // create a movement plan for the arm
+  ROS_INFO("Attempting to plan the path");
+  moveit::planning_interface::MoveGroupInterface::Plan my_plan;
+  bool success = (arm_group_->plan(my_plan) ==
+                  moveit::planning_interface::MoveItErrorCode::SUCCESS);
+  plan_seconds_[type]->observe((ros::WallTime::now() - start).toSec());
+
+  ROS_INFO("Visualising plan %s", success ? "" : "FAILED");
+
+  if (not success)
+    return false;
+
+  // execute the planned path, move() would plan it all over again
+  start = ros::WallTime::now();
+  success = (arm_group_->execute(my_plan) ==
+             moveit::planning_interface::MoveItErrorCode::SUCCESS);
+  execute_seconds_[type]->observe((ros::WallTime::now() - start).toSec());
+
+  return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                                 const std::vector<MotionType> &types)
+{
+  /* Plans each segment from the end of the previous one and joins them into
+     one trajectory. Retiming the joined path with blends at the via-points
+     keeps the arm moving through them, the blended path is only used if it
+     stays clear of the planning scene */
+
+  stopWarmUp();
+
+  if (not scene_monitor_)
+  {
+    bool success = true;
+    for (size_t i = 0; i < waypoints.size() && success; i++)
+      success = moveArm(waypoints[i], types[i]);
+    return success;
+  }
+
+  ros::WallTime planning = ros::WallTime::now();
+  robot_state::RobotStatePtr start = arm_group_->getCurrentState(1.0);
+  if (not start)
+    return false;
+
+  moveit::planning_interface::MoveGroupInterface::Plan joined_plan;
+  moveit::core::robotStateToRobotStateMsg(*start, joined_plan.start_state_);
+
+  robot_trajectory::RobotTrajectory joined(arm_group_->getRobotModel(), arm_group_->getName());
+  for (size_t i = 0; i < waypoints.size(); i++)
+  {
+    moveit::planning_interface::MoveGroupInterface::Plan segment;
+    if (not planSegment(waypoints[i], types[i], *start, segment))
+    {
+      ROS_ERROR("Planning segment %zu of %zu failed", i + 1, waypoints.size());
+      return false;
+    }
+
+    robot_trajectory::RobotTrajectory part(arm_group_->getRobotModel(), arm_group_->getName());
+    part.setRobotTrajectoryMsg(*start, segment.trajectory_);
+
+    // The first point of a segment repeats the last point of the previous one
+    for (size_t k = (i == 0) ? 0 : 1; k < part.getWayPointCount(); k++)
+      joined.addSuffixWayPoint(part.getWayPoint(k), 0.0);
+
+    *start = part.getLastWayPoint();
+  }
+
+  bool blended = false;
+  trajectory_processing::TimeOptimalTrajectoryGeneration blending(blend_tolerance_, 0.01);
+  robot_trajectory::RobotTrajectory candidate(joined);
+  if (blending.computeTimeStamps(candidate))
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(scene_monitor_);
+    blended = scene->isPathValid(candidate, arm_group_->getName());
+  }
+
+  if (blended)
+  {
+    joined.swap(candidate);
+  }
+  else
+  {
+    // Through the planned waypoints, which the planners checked
+    ROS_WARN("Blended motion not collision free, following the planned waypoints");
+    trajectory_processing::IterativeParabolicTimeParameterization time_parameterization;
+    time_parameterization.computeTimeStamps(joined);
+  }
+
+  joined.getRobotTrajectoryMsg(joined_plan.trajectory_);
+  through_plan_seconds_->observe((ros::WallTime::now() - planning).toSec());
+
+  ros::WallTime executing = ros::WallTime::now();
+  bool executed = (arm_group_->execute(joined_plan) ==
+                   moveit::planning_interface::MoveItErrorCode::SUCCESS);
+  through_execute_seconds_->observe((ros::WallTime::now() - executing).toSec());
+
+  return executed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::planSegment(const geometry_msgs::Pose &target_pose,
+                              MotionType type,
+                              const moveit::core::RobotState &start_state,
+                              moveit::planning_interface::MoveGroupInterface::Plan &plan)
+{
+  /* Plans one segment of a joined motion, starting where the previous
+     segment ends rather than at the current state */
+
+  if (planner_race_ && planner_race_->ready())
+  {
+    if (planner_race_->plan(target_pose, arm_group_->getEndEffectorLink(),
+                            arm_group_->getGoalPositionTolerance(),
+                            arm_group_->getGoalOrientationTolerance(),
+                            type, &start_state, plan))
+      return true;
+
+    ROS_WARN("Planner race failed, planning through move_group");
+  }
+
+  arm_group_->setStartState(start_state);
+  arm_group_->setPoseTarget(target_pose);
+  bool success = (arm_group_->plan(plan) ==
+                  moveit::planning_interface::MoveItErrorCode::SUCCESS);
+  arm_group_->setStartStateToCurrentState();
+
+  return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::currentArmJoints(std::vector<double> &joints)
+{
+  // MoveGroupInterface is not thread safe, the warm-up may be using it
+  stopWarmUp();
+
+  robot_state::RobotStatePtr state = arm_group_->getCurrentState(1.0);
+  if (not state)
+    return false;
+
+  state->copyJointGroupPositions(arm_group_->getName(), joints);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::solveArmIK(const geometry_msgs::Pose &pose,
+                             const std::vector<double> &seed,
+                             std::vector<double> &joints)
+{
+  /* The solver starts from the seed, so the solution is the one closest to
+     it rather than an arbitrary branch */
+
+  stopWarmUp();
+
+  robot_state::RobotState state(arm_group_->getRobotModel());
+  const robot_state::JointModelGroup *group = state.getJointModelGroup(arm_group_->getName());
+
+  state.setToDefaultValues();
+  if (seed.size() == group->getVariableCount())
+    state.setJointGroupPositions(group, seed);
+
+  if (not state.setFromIK(group, pose, arm_group_->getEndEffectorLink(), 0.02))
+    return false;
+
+  state.copyJointGroupPositions(group, joints);
+  return state.satisfiesBounds(group);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::moveGripper(double width, const std::string &object_name)
+{
+  /* this function moves the gripper fingers to a new position. Joints are:
+      - panda_finger_joint1
+      - panda_finger_joint2
+  */
+
+  stopWarmUp();
+  ros::WallTime start = ros::WallTime::now();
+
+  // calculate the joint targets as half each of the requested distance
+  double eachJoint = width / 2.0;
+
+  // create a vector to hold the joint target for each joint
+  std::vector<double> gripperJointTargets(2);
+  gripperJointTargets[0] = eachJoint;
+  gripperJointTargets[1] = eachJoint;
+
+  // apply the joint target
+  hand_group_->setJointValueTarget(gripperJointTargets);
+  hand_group_->planGraspsAndPick(object_name);
+
+  // move the robot hand
+  ROS_INFO("Attempting to plan the path");
+  moveit::planning_interface::MoveGroupInterface::Plan my_plan;
+  bool success = (hand_group_->plan(my_plan) ==
+                  moveit::planning_interface::MoveItErrorCode::SUCCESS);
+
+  ROS_INFO("Visualising plan %s", success ? "" : "FAILED");
+
+  // Fingers stopped by a cube end short of the target, so only the plan
+  // decides the result
+  if (success)
+    hand_group_->execute(my_plan);
+  gripper_seconds_->observe((ros::WallTime::now() - start).toSec());
+
+  return success;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MoveItRobot::fingerState(double &width, double &effort)
+{
+  /* Reads the finger joints from the state monitor of the hand group, which
+     follows /joint_states and keeps the efforts when the controllers send them */
+
+  robot_state::RobotStatePtr state = hand_group_->getCurrentState(1.0);
+  if (not state)
+    return false;
+
+  width = state->getVariablePosition("panda_finger_joint1") +
+          state->getVariablePosition("panda_finger_joint2");
+
+  if (state->hasEffort())
+    effort = std::fabs(state->getVariableEffort("panda_finger_joint1")) +
+             std::fabs(state->getVariableEffort("panda_finger_joint2"));
+  else
+    effort = std::numeric_limits<double>::quiet_NaN();
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MoveItRobot::applyCollisionObjects(const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  planning_scene_interface_->applyCollisionObjects(objects);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MoveItRobot::applyAttachedCollisionObjects(const std::vector<moveit_msgs::AttachedCollisionObject> &objects)
+{
+  planning_scene_interface_->applyAttachedCollisionObjects(objects);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MoveItRobot::warmUp(const std::vector<geometry_msgs::Pose> &poses,
+                         const std::vector<MotionType> &types)
+{
+  stopWarmUp();
+
+  warm_up_stop_ = false;
+  warm_up_thread_ = boost::thread(&MoveItRobot::warmUpPlans, this, poses, types);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MoveItRobot::warmUpPlans(std::vector<geometry_msgs::Pose> poses,
+                              std::vector<MotionType> types)
+{
+  /* The first plan of a planner loads its plugin, the kinematics solver and
+     the collision checker of the scene. The plans are thrown away, the arm
+     never moves */
+
+  for (size_t i = 0; i < poses.size() && not warm_up_stop_; i++)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    moveit::planning_interface::MoveGroupInterface::Plan plan;
+    bool success;
+
+    // Every planner of the race is loaded by one race
+    if (planner_race_ && planner_race_->ready())
+    {
+      success = planner_race_->plan(poses[i], arm_group_->getEndEffectorLink(),
+                                    arm_group_->getGoalPositionTolerance(),
+                                    arm_group_->getGoalOrientationTolerance(),
+                                    types[i], NULL, plan);
+    }
+    else
+    {
+      arm_group_->setPoseTarget(poses[i]);
+      success = (arm_group_->plan(plan) ==
+                 moveit::planning_interface::MoveItErrorCode::SUCCESS);
+    }
+
+    ROS_INFO("Warm-up plan %zu of %zu %s in %.2f s", i + 1, poses.size(),
+             success ? "found" : "failed", (ros::WallTime::now() - start).toSec());
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MoveItRobot::stopWarmUp()
+{
+  warm_up_stop_ = true;
+  if (warm_up_thread_.joinable())
+    warm_up_thread_.join();
+}
@@ -0,0 +1,377 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/occupancy_map.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include <shape_msgs/SolidPrimitive.h>
+
+namespace
+{
+  /** \brief Voxel coordinates are offset into 21 unsigned bits each */
+  const int kKeyOffset = 1 << 20;
+  const uint64_t kKeyMask = (1 << 21) - 1;
+
+  void
+  unpack(uint64_t key, int &x, int &y, int &z)
+  {
+    x = static_cast<int>((key >> 42) & kKeyMask) - kKeyOffset;
+    y = static_cast<int>((key >> 21) & kKeyMask) - kKeyOffset;
+    z = static_cast<int>(key & kKeyMask) - kKeyOffset;
+  }
+
+  /** \brief Floor division, tiles of negative coordinates round down */
+  int
+  floorDiv(int a, int b)
+  {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+OccupancyMap::OccupancyMap(double resolution, int tile_size, double max_height)
+    : g_hit(0.85f),
+      g_miss(-0.4f),
+      g_min_log_odds(-2.0f),
+      g_max_log_odds(3.5f),
+      g_tan_half_fov_x(0.9 * std::tan(0.5 * 1.0472)),
+      g_tan_half_fov_y(0.9 * std::tan(0.5 * 1.0472) * 3.0 / 4.0),
+      resolution_(resolution),
+      tile_size_(tile_size),
+      max_z_(static_cast<int>(max_height / resolution))
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t OccupancyMap::key(int x, int y, int z)
+{
+  return (static_cast<uint64_t>(x + kKeyOffset) << 42) |
+         (static_cast<uint64_t>(y + kKeyOffset) << 21) |
+         static_cast<uint64_t>(z + kKeyOffset);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::voxelOf(const Eigen::Vector3f &pt, int &x, int &y, int &z) const
+{
+  x = static_cast<int>(std::floor(pt.x() / resolution_));
+  y = static_cast<int>(std::floor(pt.y() / resolution_));
+  z = static_cast<int>(std::floor(pt.z() / resolution_));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::clear()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  voxels_.clear();
+  carved_.clear();
+
+  // Exported tiles stay listed so the next export removes them
+  for (boost::unordered_map<uint64_t, Tile>::iterator it = tiles_.begin(); it != tiles_.end(); ++it)
+    it->second.dirty = it->second.exported;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::hit(int x, int y, int z)
+{
+  boost::unordered_map<uint64_t, float>::iterator it = voxels_.insert(std::make_pair(key(x, y, z), 0.0f)).first;
+
+  bool was_occupied = (it->second > 0.0f);
+  it->second = std::min(g_max_log_odds, it->second + g_hit);
+
+  if (was_occupied != (it->second > 0.0f))
+    tiles_[key(floorDiv(x, tile_size_), floorDiv(y, tile_size_), 0)].dirty = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::occluded(const Eigen::Vector3f &origin, int vx, int vy, int vz) const
+{
+  /* Walks the voxels from the camera to a voxel centre (Amanatides and Woo)
+     and checks if any of them was hit by the cloud being integrated */
+
+  Eigen::Vector3f target((vx + 0.5f) * resolution_, (vy + 0.5f) * resolution_, (vz + 0.5f) * resolution_);
+  Eigen::Vector3f dir = target - origin;
+
+  int v[3];
+  voxelOf(origin, v[0], v[1], v[2]);
+  int step[3];
+  float t_max[3], t_delta[3];
+
+  for (int a = 0; a < 3; a++)
+  {
+    step[a] = (dir[a] > 0.0f) ? 1 : -1;
+    if (std::fabs(dir[a]) < 1e-9f)
+    {
+      t_max[a] = t_delta[a] = 2.0f;
+      continue;
+    }
+    float boundary = (v[a] + (step[a] > 0 ? 1 : 0)) * resolution_;
+    t_max[a] = (boundary - origin[a]) / dir[a];
+    t_delta[a] = resolution_ / std::fabs(dir[a]);
+  }
+
+  // t runs from 0 at the camera to 1 at the voxel centre
+  while (true)
+  {
+    int a = (t_max[0] < t_max[1]) ? ((t_max[0] < t_max[2]) ? 0 : 2) : ((t_max[1] < t_max[2]) ? 1 : 2);
+    if (t_max[a] >= 1.0f)
+      return false;
+    v[a] += step[a];
+    t_max[a] += t_delta[a];
+
+    if (v[0] == vx && v[1] == vy && v[2] == vz)
+      return false;
+    if (v[2] < 0 || v[2] > max_z_)
+      continue;
+    if (std::binary_search(hits_.begin(), hits_.end(), key(v[0], v[1], v[2])))
+      return true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool OccupancyMap::carved(const Eigen::Vector3f &pt) const
+{
+  for (size_t i = 0; i < carved_.size(); i++)
+  {
+    if ((pt.array() >= carved_[i].first.array()).all() && (pt.array() <= carved_[i].second.array()).all())
+      return true;
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void OccupancyMap::integrate(const pcl::PointCloud<PointType> &cloud, const Eigen::Isometry3f &camera_to_world)
+{
+  /* Points are reduced to the distinct voxels they hit, so each voxel gets
+     one update however many points fall in it */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  hits_.clear();
+  int x, y, z;
+  for (size_t i = 0; i < cloud.size(); i++)
+  {
+    Eigen::Vector3f pt = camera_to_world * cloud[i].getVector3fMap();
+    voxelOf(pt, x, y, z);
+    if (z < 0 || z > max_z_ || carved(pt))
+      continue;
+    hits_.push_back(key(x, y, z));
+  }
+  std::sort(hits_.begin(), hits_.end());
+  hits_.erase(std::unique(hits_.begin(), hits_.end()), hits_.end());
+
+  // Known voxels in plain view that no point fell in are free. Points below
+  // the floor cut never reach the map, so rays to the hits alone would never
+  // clear a cube that was taken away
+  Eigen::Isometry3f world_to_camera = camera_to_world.inverse();
+  Eigen::Vector3f origin = camera_to_world.translation();
+  boost::unordered_map<uint64_t, float>::iterator it = voxels_.begin();
+  while (it != voxels_.end())
+  {
+    if (std::binary_search(hits_.begin(), hits_.end(), it->first))
+    {
+      ++it;
+      continue;
+    }
+
+    unpack(it->first, x, y, z);
+    Eigen::Vector3f centre((x + 0.5f) * resolution_, (y + 0.5f) * resolution_, (z + 0.5f) * resolution_);
+    Eigen::Vector3f pc = world_to_camera * centre;
+    bool in_view = (pc.z() > 0.0f) && (std::fabs(pc.x()) < g_tan_half_fov_x * pc.z()) &&
+                   (std::fabs(pc.y()) < g_tan_half_fov_y * pc.z());
+
+    if (in_view && not occluded(origin, x, y, z))
+    {
+      bool was_occupied = (it->second > 0.0f);
+      it->second = std::max(g_min_log_odds, it->second + g_miss);
+      if (was_occupied && it->second <= 0.0f)
+        tiles_[key(floorDiv(x, tile_size_), floorDiv(y, tile_size_), 0)].dirty = true;
+
+      // Voxels known to be free are not kept
+      if (it->second <= g_min_log_odds)
+      {
+        it = voxels_.erase(it);
+        continue;
+      }
+    }
+    ++it;
+  }
+
+  for (size_t i = 0; i < hits_.size(); i++)
+  {
+    unpack(hits_[i], x, y, z);
+    hit(x, y, z);
+  }
+}
+
+template void OccupancyMap::integrate(const PointC &, const Eigen::Isometry3f &);
+template void OccupancyMap::integrate(const pcl::PointCloud<CompactPointT> &, const Eigen::Isometry3f &);
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::carve(const Eigen::Vector3f &min_pt, const Eigen::Vector3f &max_pt)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  carved_.push_back(std::make_pair(min_pt, max_pt));
+
+  int x0, y0, z0, x1, y1, z1;
+  voxelOf(min_pt, x0, y0, z0);
+  voxelOf(max_pt, x1, y1, z1);
+  for (int x = x0; x <= x1; x++)
+    for (int y = y0; y <= y1; y++)
+      for (int z = std::max(z0, 0); z <= std::min(z1, max_z_); z++)
+      {
+        boost::unordered_map<uint64_t, float>::iterator it = voxels_.find(key(x, y, z));
+        if (it == voxels_.end())
+          continue;
+        if (it->second > 0.0f)
+          tiles_[key(floorDiv(x, tile_size_), floorDiv(y, tile_size_), 0)].dirty = true;
+        voxels_.erase(it);
+      }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void OccupancyMap::exportDirty(const std::string &frame_id,
+                               std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  /* Rebuilds the boxes of each changed tile from its column heights */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  objects.clear();
+  std::vector<int> top(tile_size_ * tile_size_);
+
+  for (boost::unordered_map<uint64_t, Tile>::iterator it = tiles_.begin(); it != tiles_.end(); ++it)
+  {
+    Tile &tile = it->second;
+    if (not tile.dirty)
+      continue;
+    tile.dirty = false;
+
+    int tx, ty, tz;
+    unpack(it->first, tx, ty, tz);
+
+    // Height of each column in voxels, 0 when the column is empty
+    bool empty = true;
+    for (int j = 0; j < tile_size_; j++)
+      for (int i = 0; i < tile_size_; i++)
+      {
+        int x = tx * tile_size_ + i;
+        int y = ty * tile_size_ + j;
+        int &h = top[j * tile_size_ + i];
+        h = 0;
+        for (int z = max_z_; z >= 0; z--)
+        {
+          boost::unordered_map<uint64_t, float>::const_iterator v = voxels_.find(key(x, y, z));
+          if (v != voxels_.end() && v->second > 0.0f)
+          {
+            h = z + 1;
+            empty = false;
+            break;
+          }
+        }
+      }
+
+    std::ostringstream id;
+    id << "occupancy_" << tx << "_" << ty;
+
+    moveit_msgs::CollisionObject object;
+    object.id = id.str();
+    object.header.frame_id = frame_id;
+
+    if (empty)
+    {
+      if (not tile.exported)
+        continue;
+      object.operation = object.REMOVE;
+      tile.exported = false;
+      objects.push_back(object);
+      continue;
+    }
+
+    // Runs of equal height along x become one box each
+    for (int j = 0; j < tile_size_; j++)
+    {
+      int i = 0;
+      while (i < tile_size_)
+      {
+        int h = top[j * tile_size_ + i];
+        int run = 1;
+        while (i + run < tile_size_ && top[j * tile_size_ + i + run] == h)
+          run++;
+
+        if (h > 0)
+        {
+          shape_msgs::SolidPrimitive box;
+          box.type = box.BOX;
+          box.dimensions.resize(3);
+          box.dimensions[0] = run * resolution_;
+          box.dimensions[1] = resolution_;
+          box.dimensions[2] = h * resolution_;
+
+          geometry_msgs::Pose pose;
+          pose.position.x = (tx * tile_size_ + i + 0.5 * run) * resolution_;
+          pose.position.y = (ty * tile_size_ + j + 0.5) * resolution_;
+          pose.position.z = 0.5 * h * resolution_;
+          pose.orientation.w = 1.0;
+
+          object.primitives.push_back(box);
+          object.primitive_poses.push_back(pose);
+        }
+        i += run;
+      }
+    }
+
+    // ADD replaces the previous boxes of the tile
+    object.operation = object.ADD;
+    tile.exported = true;
+    objects.push_back(object);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t OccupancyMap::occupiedCount() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  size_t count = 0;
+  for (boost::unordered_map<uint64_t, float>::const_iterator it = voxels_.begin(); it != voxels_.end(); ++it)
+    count += (it->second > 0.0f);
+  return count;
+}
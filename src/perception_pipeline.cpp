@@ -0,0 +1,483 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cw3_team_2/perception_pipeline.h>
+
+#include <algorithm>
+
+namespace
+{
+  /** \brief Packed rgba of a point of the full layout */
+  inline uint32_t
+  pointColour(const pcl::PointXYZRGBA &pt)
+  {
+    return pt.rgba;
+  }
+
+  /** \brief The compact layout carries no colour */
+  inline uint32_t
+  pointColour(const pcl::PointXYZ &)
+  {
+    return 0;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+ClusterBuffers<PointType>::ClusterBuffers() : camera(new Cloud),
+                                              world(new Cloud)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+FrameArena<PointType>::FrameArena() : cluster_count_(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void FrameArena<PointType>::reset()
+{
+  cluster_count_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+ClusterBuffers<PointType> &FrameArena<PointType>::acquireCluster()
+{
+  if (cluster_count_ == clusters_.size())
+    clusters_.push_back(boost::shared_ptr<ClusterBuffers<PointType> >(new ClusterBuffers<PointType>));
+
+  return *clusters_[cluster_count_++];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void FrameArena<PointType>::releaseCluster()
+{
+  cluster_count_--;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+  template <typename PointType>
+  bool
+  largerCluster(const boost::shared_ptr<ClusterBuffers<PointType> > &a,
+                const boost::shared_ptr<ClusterBuffers<PointType> > &b)
+  {
+    return a->indices.indices.size() > b->indices.indices.size();
+  }
+}
+
+template <typename PointType>
+void FrameArena<PointType>::sortClusters()
+{
+  /* Only the slot pointers move, the buffers stay where they are */
+  std::sort(clusters_.begin(), clusters_.begin() + cluster_count_, largerCluster<PointType>);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+PerceptionPipelineBase::PerceptionPipelineBase()
+{
+  // Initialize public variables
+  g_vg_leaf_sz = 0.01;
+  g_k_nn = 50;
+  g_cluster_tolerance = 0.02; // 2cm
+  // Minimum set so that half cut cubes are not classified as clusters
+  g_min_cluster_size = 200;
+  g_max_cluster_size = 300000;
+  g_cf_red = 25.5;
+  g_cf_blue = 204;
+  g_cf_green = 25.5;
+  g_roi_enabled = false;
+  g_compact_colours = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PerceptionPipelineBase::setRoi(const Eigen::AlignedBox3f &roi)
+{
+  g_roi = roi;
+  g_roi_enabled = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void PerceptionPipelineBase::clearRoi()
+{
+  g_roi_enabled = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+PerceptionPipeline<PointType>::PerceptionPipeline() : g_cloud_filtered(new Cloud),                        // filtered point cloud
+                                                      g_cloud_filtered2(new Cloud),                       // filtered point cloud
+                                                      g_cloud_plane(new Cloud),                           // plane point cloud
+                                                      g_tree_ptr(new pcl::search::KdTree<PointType>()),   // KdTree
+                                                      g_cloud_normals(new pcl::PointCloud<pcl::Normal>),  // segmentation
+                                                      g_cloud_normals2(new pcl::PointCloud<pcl::Normal>), // segmentation
+                                                      g_inliers_plane(new pcl::PointIndices),             // plane seg
+                                                      g_coeff_plane(new pcl::ModelCoefficients)           // plane coeff
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::filterAndSegment(CloudPtr &in_cloud_ptr, double floor_z)
+{
+  // Perform the filtering
+  applyFF(in_cloud_ptr, g_cloud_filtered, floor_z); // floor filtering
+  g_compact_colours = false;
+
+  // Segment plane and cube
+  segment();
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+bool PerceptionPipeline<PointType>::ingest(const sensor_msgs::PointCloud2 &msg, double floor_z)
+{
+  /* Only the points above the floor are copied out of the message, and only
+     once, instead of converting the whole frame twice and filtering after */
+
+  bool ok = ingestCloud(msg, floor_z, g_cloud_compact, g_roi_enabled ? &g_roi : NULL);
+  compactToCloud(g_cloud_compact, *g_cloud_filtered);
+  g_cloud_filtered->header.frame_id = msg.header.frame_id;
+  g_compact_colours = true;
+
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::segment()
+{
+  findNormals(g_cloud_filtered);
+  segPlane(g_cloud_filtered);
+  segClusters(g_cloud_filtered);
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::segmentRoi(const Eigen::Isometry3f &camera_to_world,
+                                               const Eigen::AlignedBox3f &world_roi)
+{
+  /* The camera frame ROI of ingest bounds the world box loosely, the points
+     outside the box itself, the floor among them, are dropped here and the
+     rest is one cluster. No normals, plane or KD-tree are computed */
+
+  g_arena.reset();
+
+  ClusterBuffers<PointType> &cluster = g_arena.acquireCluster();
+  std::vector<int> &indices = cluster.indices.indices;
+  indices.clear();
+
+  for (int i = 0; i < g_cloud_filtered->size(); i++)
+  {
+    if (world_roi.contains(camera_to_world * (*g_cloud_filtered)[i].getVector3fMap()))
+      indices.push_back(i);
+  }
+
+  if (indices.size() < g_min_cluster_size)
+  {
+    g_arena.releaseCluster();
+    return;
+  }
+
+  cluster.indices.header = g_cloud_filtered->header;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::applyVX(CloudPtr &in_cloud_ptr,
+                                            CloudPtr &out_cloud_ptr)
+{
+  /*this is used to downsample a point cloud using a voxel grid filter*/
+  g_vx.setLeafSize(g_vg_leaf_sz);
+  g_vx.filter(*in_cloud_ptr, *out_cloud_ptr);
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::applyFF(CloudPtr &in_cloud_ptr,
+                                            CloudPtr &out_cloud_ptr,
+                                            double floor_z)
+{
+  /* This function is used to apply a depth filter to a point cloud to remove the floor*/
+
+  // determines if a point meets this condition
+  typename pcl::ConditionAnd<PointType>::Ptr range_condition(new pcl::ConditionAnd<PointType>());
+
+  typename pcl::FieldComparison<PointType>::ConstPtr ub(new pcl::FieldComparison<PointType>("z", pcl::ComparisonOps::LT, floor_z));
+  range_condition->addComparison(ub);
+
+  g_ff.setCondition(range_condition);
+  g_ff.setInputCloud(in_cloud_ptr);
+  g_ff.filter(*out_cloud_ptr);
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::findNormals(CloudPtr &in_cloud_ptr)
+{
+  // Estimate point normals
+  g_ne.setInputCloud(in_cloud_ptr);
+  g_ne.setSearchMethod(g_tree_ptr);
+  g_ne.setKSearch(g_k_nn);
+  g_ne.compute(*g_cloud_normals);
+
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::segPlane(CloudPtr &in_cloud_ptr)
+{
+  // Create the segmentation object for the planar model
+  // and set all the params
+  g_seg.setOptimizeCoefficients(true);
+  g_seg.setModelType(pcl::SACMODEL_NORMAL_PLANE);
+  g_seg.setNormalDistanceWeight(0.1);
+  g_seg.setMethodType(pcl::SAC_RANSAC);
+  g_seg.setMaxIterations(100);
+  g_seg.setDistanceThreshold(0.03);
+  g_seg.setInputCloud(in_cloud_ptr);
+  g_seg.setInputNormals(g_cloud_normals);
+
+  // Obtain the plane inliers and coefficients
+  g_seg.segment(*g_inliers_plane, *g_coeff_plane);
+
+  extractInlier(in_cloud_ptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::segClusters(CloudPtr &in_cloud_ptr)
+{
+
+  /* This function is used to extract euclidean clusters, it grows clusters
+     the same way as pcl::EuclideanClusterExtraction but keeps every index
+     list and search buffer in g_arena */
+
+  // The clusters of the last frame are dropped, their buffers are kept
+  g_arena.reset();
+  g_tree_ptr->setInputCloud(in_cloud_ptr);
+
+  std::vector<char> &processed = g_arena.processed;
+  processed.assign(in_cloud_ptr->size(), 0);
+
+  for (int i = 0; i < in_cloud_ptr->size(); i++)
+  {
+    if (processed[i])
+      continue;
+
+    // The cluster is grown in place in the index list of a free slot
+    ClusterBuffers<PointType> &cluster = g_arena.acquireCluster();
+    std::vector<int> &seed_queue = cluster.indices.indices;
+    seed_queue.clear();
+    seed_queue.push_back(i);
+    processed[i] = 1;
+
+    for (size_t sq_idx = 0; sq_idx < seed_queue.size(); sq_idx++)
+    {
+      if (not g_tree_ptr->radiusSearch(seed_queue[sq_idx], g_cluster_tolerance,
+                                       g_arena.nn_indices, g_arena.nn_distances))
+        continue;
+
+      for (size_t j = 0; j < g_arena.nn_indices.size(); j++)
+      {
+        int idx = g_arena.nn_indices[j];
+        if (processed[idx])
+          continue;
+        seed_queue.push_back(idx);
+        processed[idx] = 1;
+      }
+    }
+
+    if (seed_queue.size() < g_min_cluster_size || seed_queue.size() > g_max_cluster_size)
+    {
+      g_arena.releaseCluster();
+      continue;
+    }
+
+    std::sort(seed_queue.begin(), seed_queue.end());
+    cluster.indices.header = in_cloud_ptr->header;
+  }
+
+  g_arena.sortClusters();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::extractInlier(CloudPtr &in_cloud_ptr)
+{
+  /* A function to extract the inliers from the input cloud */
+
+  // Extract the planar inliers from the input cloud
+  g_extract_pc.setInputCloud(in_cloud_ptr);
+  g_extract_pc.setIndices(g_inliers_plane);
+  g_extract_pc.setNegative(false);
+
+  // Write the planar inliers to disk
+  g_extract_pc.filter(*g_cloud_plane);
+
+  // Remove the planar inliers, extract the rest
+  g_extract_pc.setNegative(true);
+  g_extract_pc.filter(*g_cloud_filtered2);
+  g_extract_normals.setNegative(true);
+  g_extract_normals.setInputCloud(g_cloud_normals);
+  g_extract_normals.setIndices(g_inliers_plane);
+  g_extract_normals.filter(*g_cloud_normals2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::extractCluster(const pcl::PointIndices &indices,
+                                                   Cloud &cluster,
+                                                   std::vector<uint32_t> &rgba) const
+{
+  /* Copies the points of a cluster found by segClusters into its own cloud,
+     the colours from the ingest buffer when the filtered cloud came from it */
+
+  cluster.clear();
+  rgba.clear();
+  for (const auto &idx : indices.indices)
+  {
+    cluster.push_back((*g_cloud_filtered)[idx]);
+    rgba.push_back(g_compact_colours ? g_cloud_compact[idx].rgba : pointColour((*g_cloud_filtered)[idx]));
+  }
+  cluster.width = cluster.size();
+  cluster.height = 1;
+  cluster.is_dense = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void PerceptionPipeline<PointType>::computeClusterStats(const Cloud &cluster_world,
+                                                        const std::vector<uint32_t> &rgba,
+                                                        int stack_layers,
+                                                        bool accumulate_colour,
+                                                        ClusterStats &stats) const
+{
+  /* Computes the bounds of a cluster in the world frame, the points used to find
+     its orientation, and the sums of the rgb values and the colour classes of
+     the cluster and of each layer of a stack */
+
+  // finding min and max depth points of the cluster
+  Eigen::Vector4f min_pt, max_pt;
+  pcl::getMinMax3D(cluster_world, min_pt, max_pt);
+  stats.min_pt.getVector3fMap() = min_pt.head<3>();
+  stats.max_pt.getVector3fMap() = max_pt.head<3>();
+
+  // Initialising variables
+  stats.max_x_y = 0.0;
+  stats.max_y_x = 0.0;
+  stats.r = 0.0;
+  stats.g = 0.0;
+  stats.b = 0.0;
+  stats.color_count = 0;
+  stats.hist.clear();
+  stats.layer_r.assign(stack_layers, 0.0);
+  stats.layer_g.assign(stack_layers, 0.0);
+  stats.layer_b.assign(stack_layers, 0.0);
+  stats.layer_count.assign(stack_layers, 0);
+  stats.layer_hist.assign(stack_layers, ColourHistogram());
+
+  // Iterate through every point in a cluster
+  for (int nIndex = 0; nIndex < cluster_world.size(); nIndex++)
+  {
+    const PointType &pt_world = cluster_world[nIndex];
+
+    // Packed as in pcl::PointXYZRGBA
+    uint8_t r = (rgba[nIndex] >> 16) & 0xff;
+    uint8_t g = (rgba[nIndex] >> 8) & 0xff;
+    uint8_t b = rgba[nIndex] & 0xff;
+
+    if (pt_world.x == stats.max_pt.x) // Finding the y coordinate that corresoponds with the max depth points x coordiante
+    {
+      stats.max_x_y = pt_world.y;
+    }
+    if (pt_world.y == stats.max_pt.y) // Finding the x coordinate that corresoponds with the max depth points y coordiante
+    {
+      stats.max_y_x = pt_world.x;
+    }
+
+    // Only looked up when the colour is used
+    int colour_class = COLOUR_UNKNOWN;
+    if (accumulate_colour || stack_layers > 0)
+      colour_class = g_colour_table.lookup(r, g, b);
+
+    for (int i = 0; i < stack_layers; i++)
+    {
+      // Lower and upper bound of the cube at layer i
+      double layer_lb = 0.03 + (i * 0.04);
+      double layer_ub = (i + 1) * 0.04;
+
+      if ((pt_world.z < layer_ub) && (pt_world.z > layer_lb))
+      { // Find the colours of the cubes on the stack by adding the RGB values of all the points in the cluster
+        stats.layer_r[i] += r;
+        stats.layer_g[i] += g;
+        stats.layer_b[i] += b;
+        stats.layer_count[i] += 1;
+        stats.layer_hist[i].counts[colour_class]++;
+      }
+    }
+
+    if (accumulate_colour) // Find the colours of the cubes on the floor by adding the RGB values of all the points in the cluster
+    {
+      stats.r += r;
+      stats.g += g;
+      stats.b += b;
+      stats.color_count += 1;
+      stats.hist.counts[colour_class]++;
+    }
+  }
+}
+
+// Both point layouts are compiled here, PCL has both precompiled
+template struct ClusterBuffers<PointT>;
+template class FrameArena<PointT>;
+template class PerceptionPipeline<PointT>;
+
+template struct ClusterBuffers<CompactPointT>;
+template class FrameArena<CompactPointT>;
+template class PerceptionPipeline<CompactPointT>;
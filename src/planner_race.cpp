@@ -0,0 +1,264 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/planner_race.h>
+
+#include <limits>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/robot_state/conversions.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+
+////////////////////////////////////////////////////////////////////////////////
+PlannerRace::PlannerRace(ros::NodeHandle &nh,
+                         const std::string &group_name,
+                         const planning_scene_monitor::PlanningSceneMonitorPtr &scene_monitor)
+    : group_name_(group_name),
+      scene_monitor_(scene_monitor)
+{
+  /* Short moves rarely fail, two runs of one planner cut the slow tail.
+     The long transfer moves try several planners and keep the shortest path */
+
+  RaceConfig quick;
+  quick.planners.push_back("RRTConnectkConfigDefault");
+  quick.attempts = 2;
+  quick.deadline = 1.0;
+  quick.first_valid = true;
+
+  RaceConfig transfer;
+  transfer.planners.push_back("RRTConnectkConfigDefault");
+  transfer.planners.push_back("BKPIECEkConfigDefault");
+  transfer.planners.push_back("KPIECEkConfigDefault");
+  transfer.planners.push_back("PRMkConfigDefault");
+  transfer.attempts = 1;
+  transfer.deadline = 3.0;
+  transfer.first_valid = false;
+
+  ros::NodeHandle race_nh(nh, "planner_race");
+  configs_[MOTION_SCAN] = loadConfig(race_nh, "scan", quick);
+  configs_[MOTION_APPROACH] = loadConfig(race_nh, "approach", quick);
+  configs_[MOTION_TRANSFER] = loadConfig(race_nh, "transfer", transfer);
+
+  if (not scene_monitor_ || not scene_monitor_->getPlanningScene())
+  {
+    ROS_ERROR("Planner race: no planning scene");
+    return;
+  }
+
+  // The same planner plugin and planner configurations as move_group
+  ros::NodeHandle move_group_nh("/move_group");
+  std::string plugin_name;
+  if (not move_group_nh.getParam("planning_plugin", plugin_name))
+  {
+    ROS_ERROR("Planner race: /move_group/planning_plugin not set");
+    return;
+  }
+
+  try
+  {
+    loader_.reset(new pluginlib::ClassLoader<planning_interface::PlannerManager>("moveit_core", "planning_interface::PlannerManager"));
+    planning_interface::PlannerManagerPtr planner(loader_->createUnmanagedInstance(plugin_name));
+    if (not planner->initialize(scene_monitor_->getRobotModel(), move_group_nh.getNamespace()))
+    {
+      ROS_ERROR("Planner race: could not initialise %s", plugin_name.c_str());
+      return;
+    }
+    planner_ = planner;
+  }
+  catch (pluginlib::PluginlibException &ex)
+  {
+    ROS_ERROR("Planner race: could not load %s: %s", plugin_name.c_str(), ex.what());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool PlannerRace::plan(const geometry_msgs::Pose &target_pose,
+                       const std::string &end_effector_link,
+                       double position_tolerance,
+                       double orientation_tolerance,
+                       MotionType type,
+                       const moveit::core::RobotState *start_state,
+                       moveit::planning_interface::MoveGroupInterface::Plan &plan)
+{
+  /* Each candidate runs in its own planning context on its own thread. The
+     race ends at the first valid path, or at the deadline or once every
+     candidate finished when the shortest path is wanted */
+
+  const RaceConfig &config = configs_[type];
+  ros::WallTime start = ros::WallTime::now();
+
+  // One copy of the scene for every candidate, taken at the current arm state
+  // unless the motion follows another one not executed yet
+  if (not start_state)
+    scene_monitor_->waitForCurrentRobotState(ros::Time::now(), 1.0);
+  planning_scene::PlanningScenePtr scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO locked(scene_monitor_);
+    scene = planning_scene::PlanningScene::clone(locked);
+  }
+  if (start_state)
+    scene->setCurrentState(*start_state);
+
+  planning_interface::MotionPlanRequest request;
+  request.group_name = group_name_;
+  request.allowed_planning_time = config.deadline;
+  request.num_planning_attempts = 1;
+  moveit::core::robotStateToRobotStateMsg(scene->getCurrentState(), request.start_state);
+
+  geometry_msgs::PoseStamped target;
+  target.header.frame_id = scene->getPlanningFrame();
+  target.pose = target_pose;
+  request.goal_constraints.push_back(
+      kinematic_constraints::constructGoalConstraints(end_effector_link, target, position_tolerance, orientation_tolerance));
+
+  std::vector<planning_interface::PlanningContextPtr> contexts;
+  for (size_t p = 0; p < config.planners.size(); p++)
+  {
+    request.planner_id = config.planners[p];
+    for (int a = 0; a < config.attempts; a++)
+    {
+      moveit_msgs::MoveItErrorCodes error;
+      planning_interface::PlanningContextPtr context = planner_->getPlanningContext(scene, request, error);
+      if (context)
+        contexts.push_back(context);
+      else
+        ROS_WARN("Planner race: no context for %s", config.planners[p].c_str());
+    }
+  }
+
+  if (contexts.empty())
+    return false;
+
+  std::vector<planning_interface::MotionPlanResponse> responses(contexts.size());
+  boost::mutex mutex;
+  boost::condition_variable finished;
+  size_t done = 0;
+  int first = -1;
+
+  boost::thread_group threads;
+  for (size_t i = 0; i < contexts.size(); i++)
+  {
+    threads.create_thread([&, i]()
+    {
+      bool solved = contexts[i]->solve(responses[i]) && responses[i].trajectory_;
+
+      boost::lock_guard<boost::mutex> lock(mutex);
+      done++;
+      if (solved && first < 0)
+        first = i;
+      finished.notify_all();
+    });
+  }
+
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(config.deadline * 1000);
+    while (done < contexts.size() && not (config.first_valid && first >= 0))
+    {
+      if (not finished.timed_wait(lock, deadline))
+        break;
+    }
+  }
+
+  // Stop the candidates still planning, a terminated planner returns at once
+  for (size_t i = 0; i < contexts.size(); i++)
+    contexts[i]->terminate();
+  threads.join_all();
+
+  // The first path, or the shortest in joint space
+  int winner = -1;
+  if (config.first_valid)
+  {
+    winner = first;
+  }
+  else
+  {
+    const robot_model::JointModelGroup *group = scene->getRobotModel()->getJointModelGroup(group_name_);
+    double best = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < responses.size(); i++)
+    {
+      if (responses[i].error_code_.val != moveit_msgs::MoveItErrorCodes::SUCCESS || not responses[i].trajectory_)
+        continue;
+
+      const robot_trajectory::RobotTrajectory &trajectory = *responses[i].trajectory_;
+      double length = 0.0;
+      for (size_t k = 1; k < trajectory.getWayPointCount(); k++)
+        length += trajectory.getWayPoint(k).distance(trajectory.getWayPoint(k - 1), group);
+
+      if (length < best)
+      {
+        best = length;
+        winner = i;
+      }
+    }
+  }
+
+  if (winner < 0)
+  {
+    ROS_WARN("Planner race: no path within %.1f s", config.deadline);
+    return false;
+  }
+
+  robot_trajectory::RobotTrajectory &trajectory = *responses[winner].trajectory_;
+  trajectory_processing::IterativeParabolicTimeParameterization time_parameterization;
+  time_parameterization.computeTimeStamps(trajectory);
+
+  plan.start_state_ = request.start_state;
+  trajectory.getRobotTrajectoryMsg(plan.trajectory_);
+  plan.planning_time_ = (ros::WallTime::now() - start).toSec();
+
+  ROS_INFO("Planner race: %s won among %zu candidates in %.3f s",
+           contexts[winner]->getMotionPlanRequest().planner_id.c_str(), contexts.size(), plan.planning_time_);
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+RaceConfig PlannerRace::loadConfig(ros::NodeHandle &nh, const std::string &name, const RaceConfig &defaults)
+{
+  RaceConfig config = defaults;
+  nh.param(name + "/planners", config.planners, defaults.planners);
+  nh.param(name + "/attempts", config.attempts, defaults.attempts);
+  nh.param(name + "/deadline", config.deadline, defaults.deadline);
+  nh.param(name + "/first_valid", config.first_valid, defaults.first_valid);
+
+  if (config.attempts < 1)
+    config.attempts = 1;
+
+  return config;
+}
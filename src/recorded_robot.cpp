@@ -0,0 +1,223 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/recorded_robot.h>
+
+#include <ros/console.h>
+
+////////////////////////////////////////////////////////////////////////////////
+RecordingRobot::RecordingRobot(const boost::shared_ptr<RobotInterface> &robot,
+                               const boost::shared_ptr<TaskLogWriter> &log)
+    : robot_(robot),
+      log_(log)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::moveArm(const geometry_msgs::Pose &target_pose, MotionType type)
+{
+  bool success = robot_->moveArm(target_pose, type);
+  log_->writeRobot(CALL_MOVE_ARM, success, std::vector<double>());
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                                    const std::vector<MotionType> &types)
+{
+  bool success = robot_->moveArmThrough(waypoints, types);
+  log_->writeRobot(CALL_MOVE_ARM_THROUGH, success, std::vector<double>());
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::currentArmJoints(std::vector<double> &joints)
+{
+  bool success = robot_->currentArmJoints(joints);
+  log_->writeRobot(CALL_ARM_JOINTS, success, joints);
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::solveArmIK(const geometry_msgs::Pose &pose,
+                                const std::vector<double> &seed,
+                                std::vector<double> &joints)
+{
+  bool success = robot_->solveArmIK(pose, seed, joints);
+  log_->writeRobot(CALL_ARM_IK, success, joints);
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::moveGripper(double width, const std::string &object_name)
+{
+  bool success = robot_->moveGripper(width, object_name);
+  log_->writeRobot(CALL_MOVE_GRIPPER, success, std::vector<double>());
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool RecordingRobot::fingerState(double &width, double &effort)
+{
+  bool success = robot_->fingerState(width, effort);
+  std::vector<double> values(2);
+  values[0] = width;
+  values[1] = effort;
+  log_->writeRobot(CALL_FINGER_STATE, success, values);
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecordingRobot::applyCollisionObjects(const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  robot_->applyCollisionObjects(objects);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecordingRobot::applyAttachedCollisionObjects(const std::vector<moveit_msgs::AttachedCollisionObject> &objects)
+{
+  robot_->applyAttachedCollisionObjects(objects);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecordingRobot::warmUp(const std::vector<geometry_msgs::Pose> &poses,
+                            const std::vector<MotionType> &types)
+{
+  robot_->warmUp(poses, types);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void RecordingRobot::requestFrame()
+{
+  robot_->requestFrame();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ReplayRobot::ReplayRobot(const boost::shared_ptr<TaskLogReader> &log)
+    : log_(log),
+      diverged_(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::replay(RobotCall call, std::vector<double> &values)
+{
+  if (diverged_)
+    return false;
+
+  bool success;
+  if (not log_->readRobot(call, success, values))
+  {
+    ROS_ERROR("Replay diverged at record %zu, robot call %d is not the one logged",
+              log_->position(), static_cast<int>(call));
+    diverged_ = true;
+    return false;
+  }
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::moveArm(const geometry_msgs::Pose &target_pose, MotionType type)
+{
+  std::vector<double> values;
+  return replay(CALL_MOVE_ARM, values);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::moveArmThrough(const std::vector<geometry_msgs::Pose> &waypoints,
+                                 const std::vector<MotionType> &types)
+{
+  std::vector<double> values;
+  return replay(CALL_MOVE_ARM_THROUGH, values);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::currentArmJoints(std::vector<double> &joints)
+{
+  return replay(CALL_ARM_JOINTS, joints);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::solveArmIK(const geometry_msgs::Pose &pose,
+                             const std::vector<double> &seed,
+                             std::vector<double> &joints)
+{
+  return replay(CALL_ARM_IK, joints);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::moveGripper(double width, const std::string &object_name)
+{
+  std::vector<double> values;
+  return replay(CALL_MOVE_GRIPPER, values);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ReplayRobot::fingerState(double &width, double &effort)
+{
+  std::vector<double> values;
+  bool success = replay(CALL_FINGER_STATE, values);
+  if (values.size() == 2)
+  {
+    width = values[0];
+    effort = values[1];
+  }
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReplayRobot::applyCollisionObjects(const std::vector<moveit_msgs::CollisionObject> &objects)
+{
+  /* The logged plans already account for the planning scene of the run */
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReplayRobot::applyAttachedCollisionObjects(const std::vector<moveit_msgs::AttachedCollisionObject> &objects)
+{
+  /* The logged plans already account for the planning scene of the run */
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReplayRobot::warmUp(const std::vector<geometry_msgs::Pose> &poses,
+                         const std::vector<MotionType> &types)
+{
+  /* Nothing is planned during a replay */
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ReplayRobot::requestFrame()
+{
+  /* The clouds of a replay come from the log */
+}
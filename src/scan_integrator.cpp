@@ -0,0 +1,161 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/scan_integrator.h>
+
+#include <cmath>
+
+////////////////////////////////////////////////////////////////////////////////
+ScanIntegrator::ScanIntegrator(double match_distance, double tolerance)
+    : match_distance_(match_distance),
+      tolerance_(tolerance),
+      num_tracks_(0),
+      frames_(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanIntegrator::reset()
+{
+  num_tracks_ = 0;
+  frames_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanIntegrator::addFrame(const std::vector<ScanDetection> &detections)
+{
+  /* Matches each cluster to the nearest tracked centroid, clusters with no
+     track close enough start a new one */
+
+  frames_++;
+
+  for (size_t i = 0; i < detections.size(); i++)
+  {
+    const ScanDetection &det = detections[i];
+
+    int best = -1;
+    double best_distance = match_distance_;
+    for (int t = 0; t < num_tracks_; t++)
+    {
+      double distance = std::hypot(det.centroid.point.x - tracks_[t].x.mean,
+                                   det.centroid.point.y - tracks_[t].y.mean);
+      if (distance < best_distance)
+      {
+        best = t;
+        best_distance = distance;
+      }
+    }
+
+    if (best < 0)
+    {
+      if (num_tracks_ == kMaxTracks)
+        continue;
+      best = num_tracks_++;
+      tracks_[best] = Track();
+      tracks_[best].first = det;
+      tracks_[best].r = tracks_[best].g = tracks_[best].b = 0.0;
+      tracks_[best].color_count = 0;
+      tracks_[best].colour_hist.clear();
+    }
+
+    Track &track = tracks_[best];
+    track.x.add(det.centroid.point.x);
+    track.y.add(det.centroid.point.y);
+    track.z.add(det.centroid.point.z);
+    track.max_x.add(det.max.x);
+    track.max_y.add(det.max.y);
+    track.max_z.add(det.max.z);
+    track.min_x.add(det.min.x);
+    track.min_y.add(det.min.y);
+    track.min_z.add(det.min.z);
+    track.max_y_x.add(det.max_y_x);
+    track.max_x_y.add(det.max_x_y);
+    track.r += det.color.r;
+    track.g += det.color.g;
+    track.b += det.color.b;
+    track.color_count += det.color_count;
+    track.colour_hist.add(det.colour_hist);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScanIntegrator::converged() const
+{
+  double tolerance_sq = tolerance_ * tolerance_;
+  for (int t = 0; t < num_tracks_; t++)
+  {
+    const Track &track = tracks_[t];
+    if (track.x.n < 2)
+      continue;
+    if (track.x.meanVariance() > tolerance_sq || track.y.meanVariance() > tolerance_sq ||
+        track.z.meanVariance() > tolerance_sq)
+      return false;
+  }
+
+  return frames_ > 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanIntegrator::result(std::vector<ScanDetection> &out) const
+{
+  out.clear();
+  for (int t = 0; t < num_tracks_; t++)
+  {
+    const Track &track = tracks_[t];
+
+    // Clusters seen in few frames are noise or a partial view
+    if (2 * track.x.n < frames_)
+      continue;
+
+    ScanDetection det = track.first;
+    det.centroid.point.x = track.x.mean;
+    det.centroid.point.y = track.y.mean;
+    det.centroid.point.z = track.z.mean;
+    det.max.x = track.max_x.mean;
+    det.max.y = track.max_y.mean;
+    det.max.z = track.max_z.mean;
+    det.min.x = track.min_x.mean;
+    det.min.y = track.min_y.mean;
+    det.min.z = track.min_z.mean;
+    det.max_y_x = track.max_y_x.mean;
+    det.max_x_y = track.max_x_y.mean;
+    det.color.r = track.r;
+    det.color.g = track.g;
+    det.color.b = track.b;
+    det.color_count = track.color_count;
+    det.colour_hist = track.colour_hist;
+    out.push_back(det);
+  }
+}
@@ -0,0 +1,292 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/synthetic_scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+const uint8_t kCubeColours[kNumCubeColours][3] = {{204, 26, 26}, {26, 26, 204}, {204, 26, 204}};
+const uint8_t kObstacleColour[3] = {20, 20, 20};
+
+namespace
+{
+  /** \brief Colours of the checkered mat tiles */
+  const uint8_t kMatColours[2][3] = {{60, 110, 60}, {90, 140, 90}};
+
+  /** \brief Edge length of a mat tile */
+  const float kMatTileSize = 0.1f;
+
+  /** \brief Minimum distance between the centres of two objects on the mat */
+  const float kMinSpacing = 0.08f;
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool
+  intersectCube(const SyntheticCube &cube, const Eigen::Vector3f &origin,
+                const Eigen::Vector3f &dir, float &t)
+  {
+    /* Slab test of a ray against a cube rotated about z, t is in units of dir */
+
+    Eigen::AngleAxisf to_cube(-cube.yaw, Eigen::Vector3f::UnitZ());
+    Eigen::Vector3f o = to_cube * (origin - cube.centre);
+    Eigen::Vector3f d = to_cube * dir;
+    float half = cube.size / 2.0f;
+
+    float t_near = -std::numeric_limits<float>::infinity();
+    float t_far = std::numeric_limits<float>::infinity();
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (std::fabs(d[axis]) < 1e-9f)
+      {
+        if (std::fabs(o[axis]) > half)
+          return false;
+        continue;
+      }
+      float t1 = (-half - o[axis]) / d[axis];
+      float t2 = (half - o[axis]) / d[axis];
+      if (t1 > t2)
+        std::swap(t1, t2);
+      t_near = std::max(t_near, t1);
+      t_far = std::min(t_far, t2);
+      if (t_near > t_far)
+        return false;
+    }
+    if (t_far < 0.0f)
+      return false;
+
+    t = (t_near > 0.0f) ? t_near : t_far;
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////
+  bool
+  findFreeSpot(std::mt19937 &rng, float half_x, float half_y,
+               const Eigen::Vector3f &camera_position,
+               const std::vector<SyntheticCube> &cubes, Eigen::Vector3f &spot)
+  {
+    /* Rejection sample a spot on the mat that keeps clear of every placed cube */
+
+    std::uniform_real_distribution<float> dist_x(-half_x, half_x);
+    std::uniform_real_distribution<float> dist_y(-half_y, half_y);
+
+    for (int attempt = 0; attempt < 1000; attempt++)
+    {
+      spot = Eigen::Vector3f(camera_position.x() + dist_x(rng),
+                             camera_position.y() + dist_y(rng), 0.0f);
+      bool free = true;
+      for (size_t i = 0; i < cubes.size() && free; i++)
+      {
+        float dx = cubes[i].centre.x() - spot.x();
+        float dy = cubes[i].centre.y() - spot.y();
+        free = (dx * dx + dy * dy) >= (kMinSpacing * kMinSpacing);
+      }
+      if (free)
+        return true;
+    }
+    return false;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+SyntheticSceneConfig::SyntheticSceneConfig() : width(640),
+                                               height(480),
+                                               fov_x(1.0472),
+                                               camera_position(0.5f, 0.0f, 0.6f),
+                                               num_cubes(4),
+                                               stack_height(0),
+                                               num_obstacles(0),
+                                               cube_size(0.04),
+                                               noise_stddev(0.001),
+                                               dropout(0.0),
+                                               seed(1)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+Eigen::Affine3f
+downwardCameraPose(const Eigen::Vector3f &position)
+{
+  /* The optical frame has z forward and y down, flipping it about x makes
+     it look at the floor with x still pointing along world x */
+
+  Eigen::Affine3f camera_to_world = Eigen::Affine3f::Identity();
+  camera_to_world.translate(position);
+  camera_to_world.rotate(Eigen::AngleAxisf(M_PI, Eigen::Vector3f::UnitX()));
+
+  return camera_to_world;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+SyntheticScene
+generateScene(const SyntheticSceneConfig &config)
+{
+  /* Lays out the cubes in the part of the mat seen by the camera and renders them */
+
+  SyntheticScene scene;
+  scene.cloud.reset(new PointC);
+  scene.camera_to_world = downwardCameraPose(config.camera_position);
+
+  std::mt19937 rng(config.seed);
+  std::uniform_real_distribution<float> dist_yaw(0.0f, M_PI / 2.0);
+  std::uniform_int_distribution<int> dist_colour(0, kNumCubeColours - 1);
+
+  // keep objects well inside the camera footprint so they are fully visible
+  float half_x = 0.7f * config.camera_position.z() * std::tan(config.fov_x / 2.0);
+  float half_y = half_x * config.height / config.width;
+
+  int num_objects = config.num_cubes + config.num_obstacles + (config.stack_height > 0 ? 1 : 0);
+  for (int i = 0; i < num_objects; i++)
+  {
+    Eigen::Vector3f spot;
+    if (not findFreeSpot(rng, half_x, half_y, config.camera_position, scene.cubes, spot))
+      break;
+
+    SyntheticCube cube;
+    cube.size = config.cube_size;
+    cube.yaw = dist_yaw(rng);
+
+    // the stack comes first, then the single cubes and the obstacles last
+    int layers = (i == 0 && config.stack_height > 0) ? config.stack_height : 1;
+    bool obstacle = i >= (num_objects - config.num_obstacles);
+
+    for (int layer = 0; layer < layers; layer++)
+    {
+      const uint8_t *colour = obstacle ? kObstacleColour : kCubeColours[dist_colour(rng)];
+      cube.r = colour[0];
+      cube.g = colour[1];
+      cube.b = colour[2];
+      cube.centre = spot;
+      cube.centre.z() = cube.size * (layer + 0.5f);
+      scene.cubes.push_back(cube);
+    }
+  }
+
+  renderScene(scene.cubes, scene.camera_to_world, config, *scene.cloud);
+
+  return scene;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void
+renderScene(const std::vector<SyntheticCube> &cubes,
+            const Eigen::Affine3f &camera_to_world,
+            const SyntheticSceneConfig &config,
+            PointC &cloud)
+{
+  /* Casts one ray per pixel against the floor plane and every cube, the
+     nearest hit gives the depth and colour of the pixel */
+
+  std::mt19937 rng(config.seed + 1);
+  std::normal_distribution<float> dist_noise(0.0f, config.noise_stddev);
+  std::uniform_real_distribution<float> dist_dropout(0.0f, 1.0f);
+
+  float fx = (config.width / 2.0) / std::tan(config.fov_x / 2.0);
+  float cx = (config.width - 1) / 2.0f;
+  float cy = (config.height - 1) / 2.0f;
+
+  Eigen::Vector3f origin = camera_to_world.translation();
+  Eigen::Matrix3f rotation = camera_to_world.linear();
+
+  cloud.width = config.width;
+  cloud.height = config.height;
+  cloud.is_dense = (config.dropout <= 0.0);
+  cloud.points.resize(config.width * config.height);
+
+  for (int v = 0; v < config.height; v++)
+  {
+    for (int u = 0; u < config.width; u++)
+    {
+      PointT &pt = cloud.points[v * config.width + u];
+      pt.a = 255;
+
+      if (config.dropout > 0.0 && dist_dropout(rng) < config.dropout)
+      {
+        pt.x = pt.y = pt.z = std::numeric_limits<float>::quiet_NaN();
+        pt.r = pt.g = pt.b = 0;
+        continue;
+      }
+
+      Eigen::Vector3f dir_camera((u - cx) / fx, (v - cy) / fx, 1.0f);
+      Eigen::Vector3f dir = rotation * dir_camera;
+
+      // hit with the floor, looking away from it gives no return
+      float t = std::numeric_limits<float>::infinity();
+      bool hit_found = false;
+      uint8_t r = 0, g = 0, b = 0;
+      if (dir.z() < 0.0f)
+      {
+        t = -origin.z() / dir.z();
+        Eigen::Vector3f hit = origin + t * dir;
+        int tile = (int)std::floor(hit.x() / kMatTileSize) + (int)std::floor(hit.y() / kMatTileSize);
+        r = kMatColours[tile & 1][0];
+        g = kMatColours[tile & 1][1];
+        b = kMatColours[tile & 1][2];
+        hit_found = true;
+      }
+
+      for (size_t i = 0; i < cubes.size(); i++)
+      {
+        float t_cube;
+        if (intersectCube(cubes[i], origin, dir, t_cube) && t_cube < t)
+        {
+          t = t_cube;
+          r = cubes[i].r;
+          g = cubes[i].g;
+          b = cubes[i].b;
+          hit_found = true;
+        }
+      }
+
+      if (not hit_found)
+      {
+        pt.x = pt.y = pt.z = std::numeric_limits<float>::quiet_NaN();
+        pt.r = pt.g = pt.b = 0;
+        cloud.is_dense = false;
+        continue;
+      }
+
+      // dir_camera has unit z, so t is the depth of the hit
+      float depth = t + ((config.noise_stddev > 0.0) ? dist_noise(rng) : 0.0f);
+      pt.x = depth * dir_camera.x();
+      pt.y = depth * dir_camera.y();
+      pt.z = depth;
+      pt.r = r;
+      pt.g = g;
+      pt.b = b;
+    }
+  }
+}
@@ -0,0 +1,232 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/task_action_server.h>
+
+#include <algorithm>
+
+////////////////////////////////////////////////////////////////////////////////
+TaskActionServer::TaskActionServer(ros::NodeHandle &nh, Cw3Solution &solution)
+    : solution_(solution),
+      task1_server_(nh, "/task1_action", boost::bind(&TaskActionServer::executeTask1, this, _1), false),
+      task2_server_(nh, "/task2_action", boost::bind(&TaskActionServer::executeTask2, this, _1), false),
+      task3_server_(nh, "/task3_action", boost::bind(&TaskActionServer::executeTask3, this, _1), false),
+      running_task_(0),
+      seconds_per_cube_(30.0),
+      cubes_placed_(0),
+      cubes_total_(0)
+{
+  task1_server_.registerPreemptCallback(boost::bind(&TaskActionServer::preemptCallback, this, 1));
+  task2_server_.registerPreemptCallback(boost::bind(&TaskActionServer::preemptCallback, this, 2));
+  task3_server_.registerPreemptCallback(boost::bind(&TaskActionServer::preemptCallback, this, 3));
+
+  task1_server_.start();
+  task2_server_.start();
+  task3_server_.start();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskActionServer::preemptCallback(int task)
+{
+  /* A goal still waiting for another task is dropped by startTask, only the
+     task this goal started is cancelled */
+
+  if (running_task_ == task)
+  {
+    ROS_WARN("Cancelling task %d", task);
+    solution_.cancelTask();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <class Server> bool
+TaskActionServer::startTask(Server &server, int task, boost::unique_lock<boost::mutex> &task_lock)
+{
+  /* A cancelled task stops within one motion, so a goal sent right after a
+     cancel only waits for that motion to end. The lock is taken here, a
+     service or job starting in between can not make the goal fail */
+
+  while (not solution_.beginTask(task_lock))
+  {
+    if (server.isPreemptRequested() || not ros::ok())
+      return false;
+    ros::WallDuration(0.05).sleep();
+  }
+
+  running_task_ = task;
+  cubes_placed_ = 0;
+  cubes_total_ = 0;
+  last_cube_time_ = ros::WallTime::now();
+
+  if (server.isPreemptRequested())
+  {
+    running_task_ = 0;
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <class Server, class Result> void
+TaskActionServer::finishTask(Server &server, const Result &result, bool success)
+{
+  // Still under the task lock, the next task starts without a callback
+  solution_.g_progress_callback.clear();
+  running_task_ = 0;
+
+  if (solution_.g_cancel_requested)
+    server.setPreempted(result);
+  else if (success)
+    server.setSucceeded(result);
+  else
+    server.setAborted(result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <class Server, class Feedback> void
+TaskActionServer::publishFeedback(Server &server, const std::string &phase)
+{
+  /* The time left is the cubes still to stack times the average time per
+     cube, less the time already spent on the current cube */
+
+  int placed = solution_.g_cubes_placed;
+  int total = solution_.g_num_of_cubes_to_stack;
+  ros::WallTime now = ros::WallTime::now();
+
+  // Stacking starts once the number of cubes is known
+  if (total != cubes_total_)
+  {
+    cubes_total_ = total;
+    last_cube_time_ = now;
+  }
+
+  if (placed > cubes_placed_)
+  {
+    double seconds = (now - last_cube_time_).toSec() / (placed - cubes_placed_);
+    seconds_per_cube_ = 0.7 * seconds_per_cube_ + 0.3 * seconds;
+    cubes_placed_ = placed;
+    last_cube_time_ = now;
+  }
+
+  Feedback feedback;
+  feedback.phase = phase;
+  feedback.cubes_placed = placed;
+  feedback.cubes_total = total;
+  if (total > 0)
+    feedback.eta = std::max(0.0, (total - placed) * seconds_per_cube_ - (now - last_cube_time_).toSec());
+  else
+    feedback.eta = -1;
+
+  server.publishFeedback(feedback);
+}
+////////////////////////////////////////////////////////////////////////////////
+void TaskActionServer::executeTask1(const cw3_team_2::Task1GoalConstPtr &goal)
+{
+  cw3_world_spawner::Task1Service::Request request;
+  cw3_world_spawner::Task1Service::Response response;
+  cw3_team_2::Task1Result result;
+
+  // Held until the goal has its final state
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not startTask(task1_server_, 1, task_lock))
+  {
+    task1_server_.setPreempted(result);
+    return;
+  }
+
+  solution_.g_progress_callback =
+      boost::bind(&TaskActionServer::publishFeedback<Task1Server, cw3_team_2::Task1Feedback>,
+                  this, boost::ref(task1_server_), _1);
+
+  bool success = solution_.runTask1(request, response);
+
+  result.stack_point = response.stack_point;
+  result.stack_rotation = response.stack_rotation;
+  result.stack_colours = response.stack_colours;
+  finishTask(task1_server_, result, success);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskActionServer::executeTask2(const cw3_team_2::Task2GoalConstPtr &goal)
+{
+  cw3_world_spawner::Task2Service::Request request;
+  cw3_world_spawner::Task2Service::Response response;
+  cw3_team_2::Task2Result result;
+
+  request.stack_point = goal->stack_point;
+  request.stack_rotation = goal->stack_rotation;
+  request.stack_colours = goal->stack_colours;
+
+  // Held until the goal has its final state
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not startTask(task2_server_, 2, task_lock))
+  {
+    task2_server_.setPreempted(result);
+    return;
+  }
+
+  solution_.g_progress_callback =
+      boost::bind(&TaskActionServer::publishFeedback<Task2Server, cw3_team_2::Task2Feedback>,
+                  this, boost::ref(task2_server_), _1);
+
+  result.success = solution_.runTask2(request, response);
+  finishTask(task2_server_, result, result.success);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskActionServer::executeTask3(const cw3_team_2::Task3GoalConstPtr &goal)
+{
+  cw3_world_spawner::Task3Service::Request request;
+  cw3_world_spawner::Task3Service::Response response;
+  cw3_team_2::Task3Result result;
+
+  request.stack_point = goal->stack_point;
+
+  // Held until the goal has its final state
+  boost::unique_lock<boost::mutex> task_lock;
+  if (not startTask(task3_server_, 3, task_lock))
+  {
+    task3_server_.setPreempted(result);
+    return;
+  }
+
+  solution_.g_progress_callback =
+      boost::bind(&TaskActionServer::publishFeedback<Task3Server, cw3_team_2::Task3Feedback>,
+                  this, boost::ref(task3_server_), _1);
+
+  result.success = solution_.runTask3(request, response);
+  finishTask(task3_server_, result, result.success);
+}
+
@@ -0,0 +1,396 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/task_log.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+
+namespace
+{
+  /** \brief Header of a log file */
+  const char kMagic[4] = {'C', 'W', 'T', 'L'};
+  const uint32_t kVersion = 1;
+  const size_t kHeaderSize = 4 + 4;
+
+  /** \brief Type and payload size before every record */
+  const size_t kRecordHeaderSize = 4 + 4;
+
+  /** \brief Size of a new log, a few clouds of the R200 */
+  const size_t kInitialCapacity = 64 << 20;
+
+  /** \brief Camera pose of a cloud, the top three rows of its matrix */
+  const size_t kPoseSize = 12 * sizeof(float);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskLogWriter::TaskLogWriter() : fd_(-1), data_(NULL), capacity_(0), used_(0), pending_(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskLogWriter::~TaskLogWriter()
+{
+  close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogWriter::open(const std::string &path)
+{
+  close();
+
+  boost::mutex::scoped_lock lock(mutex_);
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+    return false;
+
+  void *mapping = MAP_FAILED;
+  if (ftruncate(fd_, kInitialCapacity) == 0)
+    mapping = mmap(NULL, kInitialCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping == MAP_FAILED)
+  {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  data_ = static_cast<uint8_t *>(mapping);
+  capacity_ = kInitialCapacity;
+  std::memcpy(data_, kMagic, sizeof(kMagic));
+  std::memcpy(data_ + sizeof(kMagic), &kVersion, sizeof(kVersion));
+  used_ = kHeaderSize;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskLogWriter::close()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (data_)
+  {
+    munmap(data_, capacity_);
+    data_ = NULL;
+  }
+  if (fd_ >= 0)
+  {
+    if (ftruncate(fd_, used_) != 0)
+      ROS_WARN("Cannot cut the task log to its records");
+    ::close(fd_);
+    fd_ = -1;
+  }
+  capacity_ = 0;
+  used_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint8_t *TaskLogWriter::reserve(size_t size)
+{
+  /* The file is zero past the last record, so the type of the new record
+     reads as LOG_END until commit sets it */
+
+  if (not data_)
+    return NULL;
+
+  size_t needed = used_ + kRecordHeaderSize + size;
+  if (needed > capacity_)
+  {
+    size_t capacity = std::max(capacity_ * 2, needed);
+    munmap(data_, capacity_);
+    data_ = NULL;
+
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd_, capacity) == 0)
+      mapping = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED)
+    {
+      // What was written stays in the file, the log just ends there
+      ::close(fd_);
+      fd_ = -1;
+      return NULL;
+    }
+
+    data_ = static_cast<uint8_t *>(mapping);
+    capacity_ = capacity;
+  }
+
+  uint8_t *record = data_ + used_;
+  uint32_t length = size;
+  std::memcpy(record + 4, &length, sizeof(length));
+  pending_ = used_;
+  used_ = needed;
+
+  return record + kRecordHeaderSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskLogWriter::commit(TaskLogType type)
+{
+  /* The type goes in after the payload, so a crash while the payload is
+     written leaves a log that ends before this record */
+
+  if (not data_)
+    return;
+
+  std::atomic_signal_fence(std::memory_order_release);
+  uint32_t kind = type;
+  std::memcpy(data_ + pending_, &kind, sizeof(kind));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskLogWriter::writeFrame(const sensor_msgs::PointCloud2 &cloud,
+                               const Eigen::Isometry3f &camera_to_world)
+{
+  /* The cloud is serialised straight into the mapping, it is the bulk of
+     the log and is copied only once */
+
+  uint32_t length = ros::serialization::serializationLength(cloud);
+  boost::mutex::scoped_lock lock(mutex_);
+  uint8_t *payload = reserve(kPoseSize + length);
+  if (not payload)
+    return;
+
+  float pose[12];
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 4; col++)
+      pose[row * 4 + col] = camera_to_world.matrix()(row, col);
+  std::memcpy(payload, pose, kPoseSize);
+
+  ros::serialization::OStream stream(payload + kPoseSize, length);
+  ros::serialization::serialize(stream, cloud);
+  commit(LOG_FRAME);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskLogWriter::writeNoFrame()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if (reserve(0))
+    commit(LOG_NO_FRAME);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void TaskLogWriter::writeRobot(RobotCall call, bool success, const std::vector<double> &values)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  uint8_t *payload = reserve(3 * sizeof(uint32_t) + values.size() * sizeof(double));
+  if (not payload)
+    return;
+
+  uint32_t header[3] = {static_cast<uint32_t>(call), success ? 1u : 0u,
+                        static_cast<uint32_t>(values.size())};
+  std::memcpy(payload, header, sizeof(header));
+  if (not values.empty())
+    std::memcpy(payload + sizeof(header), &values[0], values.size() * sizeof(double));
+  commit(LOG_ROBOT);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskLogReader::TaskLogReader() : data_(NULL), size_(0), offset_(0), records_(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskLogReader::~TaskLogReader()
+{
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogReader::open(const std::string &path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(kHeaderSize))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  size_t size = info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  const uint8_t *data = static_cast<const uint8_t *>(mapping);
+  uint32_t version;
+  std::memcpy(&version, data + sizeof(kMagic), sizeof(version));
+  if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || version != kVersion)
+  {
+    munmap(mapping, size);
+    return false;
+  }
+
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), size_);
+  data_ = data;
+  size_ = size;
+  offset_ = kHeaderSize;
+  records_ = 0;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TaskLogType TaskLogReader::peek() const
+{
+  /* A record cut short by a crash reads as the end of the log */
+
+  if (not data_ || offset_ + kRecordHeaderSize > size_)
+    return LOG_END;
+
+  uint32_t type, length;
+  std::memcpy(&type, data_ + offset_, sizeof(type));
+  std::memcpy(&length, data_ + offset_ + 4, sizeof(length));
+  if (type > LOG_ROBOT || offset_ + kRecordHeaderSize + length > size_)
+    return LOG_END;
+
+  return static_cast<TaskLogType>(type);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogReader::take(TaskLogType type, const uint8_t *&payload, size_t &size)
+{
+  if (peek() != type)
+    return false;
+
+  uint32_t length;
+  std::memcpy(&length, data_ + offset_ + 4, sizeof(length));
+  payload = data_ + offset_ + kRecordHeaderSize;
+  size = length;
+
+  offset_ += kRecordHeaderSize + length;
+  records_++;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int TaskLogReader::nextTask() const
+{
+  if (peek() != LOG_TASK)
+    return 0;
+
+  uint32_t length;
+  std::memcpy(&length, data_ + offset_ + 4, sizeof(length));
+  if (length < sizeof(int32_t))
+    return 0;
+
+  int32_t task;
+  std::memcpy(&task, data_ + offset_ + kRecordHeaderSize, sizeof(task));
+  return task;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogReader::readFrame(sensor_msgs::PointCloud2 &cloud, Eigen::Isometry3f &camera_to_world)
+{
+  const uint8_t *payload;
+  size_t size;
+  if (peek() != LOG_FRAME)
+    return false;
+
+  size_t offset = offset_, records = records_;
+  take(LOG_FRAME, payload, size);
+  if (size < kPoseSize)
+    return false;
+
+  float pose[12];
+  std::memcpy(pose, payload, kPoseSize);
+  camera_to_world.setIdentity();
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 4; col++)
+      camera_to_world.matrix()(row, col) = pose[row * 4 + col];
+
+  try
+  {
+    ros::serialization::IStream stream(const_cast<uint8_t *>(payload) + kPoseSize, size - kPoseSize);
+    ros::serialization::deserialize(stream, cloud);
+  }
+  catch (ros::serialization::StreamOverrunException &)
+  {
+    offset_ = offset;
+    records_ = records;
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogReader::readNoFrame()
+{
+  const uint8_t *payload;
+  size_t size;
+  return take(LOG_NO_FRAME, payload, size);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool TaskLogReader::readRobot(RobotCall call, bool &success, std::vector<double> &values)
+{
+  /* Only the call at the head of the log is read, any other call means the
+     replayed run has gone another way than the recorded one */
+
+  if (peek() != LOG_ROBOT)
+    return false;
+
+  uint32_t length;
+  uint32_t header[3];
+  std::memcpy(&length, data_ + offset_ + 4, sizeof(length));
+  if (length < sizeof(header))
+    return false;
+  std::memcpy(header, data_ + offset_ + kRecordHeaderSize, sizeof(header));
+  if (header[0] != static_cast<uint32_t>(call))
+    return false;
+
+  const uint8_t *payload;
+  size_t size;
+  take(LOG_ROBOT, payload, size);
+  if (size < sizeof(header) + header[2] * sizeof(double))
+    return false;
+
+  success = (header[1] != 0);
+  values.resize(header[2]);
+  if (not values.empty())
+    std::memcpy(&values[0], payload + sizeof(header), values.size() * sizeof(double));
+  return true;
+}
@@ -0,0 +1,134 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Runs the tasks of a log written with the record_log parameter again,
+ * against the logged clouds and robot results instead of the camera and
+ * MoveIt.
+ *
+ *   rosrun cw3_team_2 cw3_team_2_task_replay run.log
+ *
+ * The tasks take the same clouds at the same points and see the same plans
+ * succeed or fail, so a slow or failed run can be repeated and profiled on
+ * any machine. A change that makes the tasks ask for a different robot call
+ * or cloud than the recorded run stops the replay and names the record.
+ * Needs a ROS master for the node handle, but no Gazebo or move_group.
+ */
+
+#include <cstdio>
+
+#include <cw3_team_2/cw3_team_2.h>
+#include <cw3_team_2/recorded_robot.h>
+
+namespace
+{
+  ////////////////////////////////////////////////////////////////////////////////
+  template <typename Request, typename Response> bool
+  replayTask(TaskLogReader &log,
+             Cw3Solution &solution,
+             bool (Cw3Solution::*callback)(Request &, Response &),
+             bool &success)
+  {
+    Request request;
+    Response response;
+    if (not log.readTask(request))
+      return false;
+    success = (solution.*callback)(request, response);
+    return true;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int
+main (int argc, char** argv)
+{
+  ros::init(argc, argv, "cw3_team_2_task_replay");
+  ros::NodeHandle nh("~");
+
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s run.log\n", argv[0]);
+    return 1;
+  }
+
+  boost::shared_ptr<TaskLogReader> log(new TaskLogReader);
+  if (not log->open(argv[1]))
+  {
+    fprintf(stderr, "Cannot read the task log %s\n", argv[1]);
+    return 1;
+  }
+
+  // Nothing to warm up, serve or restore, and the replay is not recorded again
+  nh.setParam("warm_up", false);
+  nh.setParam("metrics_port", 0);
+  nh.setParam("world_snapshot", std::string(""));
+  nh.setParam("record_log", std::string(""));
+
+  // No spinner, the camera and joint state callbacks never run
+  boost::shared_ptr<ReplayRobot> robot(new ReplayRobot(log));
+  Cw3Solution solution(nh, robot);
+  solution.g_task_replay = log;
+
+  int tasks = 0;
+  bool diverged = false;
+  while (log->peek() != LOG_END && not diverged)
+  {
+    int task = log->nextTask();
+    size_t record = log->position();
+    ros::WallTime start = ros::WallTime::now();
+    bool success = false, read = false;
+
+    if (task == 1)
+      read = replayTask(*log, solution, &Cw3Solution::task1Callback, success);
+    else if (task == 2)
+      read = replayTask(*log, solution, &Cw3Solution::task2Callback, success);
+    else if (task == 3)
+      read = replayTask(*log, solution, &Cw3Solution::task3Callback, success);
+
+    if (not read)
+    {
+      fprintf(stderr, "Record %zu is not the start of a task\n", record);
+      return 1;
+    }
+
+    // The task must have used every record up to the next task
+    diverged = robot->diverged() || (log->peek() != LOG_END && log->nextTask() == 0);
+    printf("Task %d from record %zu: %s in %.3f s%s\n", task, record,
+           success ? "succeeded" : "failed", (ros::WallTime::now() - start).toSec(),
+           diverged ? ", diverged from the recorded run" : "");
+    tasks++;
+  }
+
+  printf("%d tasks replayed, %zu records\n", tasks, log->position());
+  return diverged ? 1 : 0;
+}
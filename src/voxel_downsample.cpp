@@ -0,0 +1,411 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/voxel_downsample.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <boost/bind.hpp>
+
+namespace
+{
+  /** \brief Bits of the key sorted by each radix pass */
+  const int kDigitBits = 11;
+  const uint32_t kDigits = 1u << kDigitBits;
+
+  /** \brief Fewest points worth a thread of their own */
+  const size_t kMinSlice = 16384;
+
+  template <typename PointType>
+  inline bool
+  finitePoint(const PointType &pt)
+  {
+    return std::isfinite(pt.x) && std::isfinite(pt.y) && std::isfinite(pt.z);
+  }
+
+  /** \brief Colour channels of a voxel are summed, then truncated like pcl::VoxelGrid */
+  inline void
+  addColour(uint64_t sums[4], const pcl::PointXYZRGBA &pt)
+  {
+    sums[0] += pt.r;
+    sums[1] += pt.g;
+    sums[2] += pt.b;
+    sums[3] += pt.a;
+  }
+
+  inline void
+  setColour(pcl::PointXYZRGBA &pt, const uint64_t sums[4], uint64_t count)
+  {
+    pt.r = sums[0] / count;
+    pt.g = sums[1] / count;
+    pt.b = sums[2] / count;
+    pt.a = sums[3] / count;
+  }
+
+  /** \brief The compact layout carries no colour */
+  inline void
+  addColour(uint64_t[4], const pcl::PointXYZ &)
+  {
+  }
+
+  inline void
+  setColour(pcl::PointXYZ &, const uint64_t[4], uint64_t)
+  {
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+VoxelDownsampler<PointType>::VoxelDownsampler() : leaf_size_(0.01f),
+                                                  threads_(0),
+                                                  input_(NULL),
+                                                  output_(NULL),
+                                                  size_(0),
+                                                  slices_(1),
+                                                  inv_leaf_(0.0f),
+                                                  dim_x_(0),
+                                                  dim_xy_(0),
+                                                  invalid_key_(0),
+                                                  passes_(0),
+                                                  too_fine_(false),
+                                                  worker_count_(0),
+                                                  barrier_slices_(0),
+                                                  generation_(0),
+                                                  running_(0),
+                                                  stopping_(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+VoxelDownsampler<PointType>::~VoxelDownsampler()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(pool_mutex_);
+    stopping_ = true;
+  }
+  start_cond_.notify_all();
+  workers_.join_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void VoxelDownsampler<PointType>::filter(const pcl::PointCloud<PointType> &input,
+                                         pcl::PointCloud<PointType> &output)
+{
+  /* Every thread takes a fixed slice of the points through each step, the
+     steps that combine the slices run on the calling thread between
+     barriers. The radix sort is stable and keys are compared whole, so
+     neither the thread count nor the timing changes the output */
+
+  output.header = input.header;
+  output.height = 1;
+  output.is_dense = true;
+
+  size_t n = input.size();
+  if (n == 0 || leaf_size_ <= 0.0f)
+  {
+    output.points.clear();
+    output.width = 0;
+    return;
+  }
+
+  int threads = (threads_ > 0) ? threads_ : std::max(1u, boost::thread::hardware_concurrency());
+  int slices = std::max<size_t>(1, std::min<size_t>(threads, n / kMinSlice));
+
+  for (int b = 0; b < 2; b++)
+  {
+    keys_[b].resize(n);
+    order_[b].resize(n);
+  }
+  histograms_.resize(slices * kDigits);
+  slice_min_.resize(slices);
+  slice_max_.resize(slices);
+  slice_voxels_.resize(slices);
+
+  // Read by the workers once they are woken, slice 0 fills in the rest
+  input_ = &input;
+  output_ = &output;
+  size_ = n;
+  slices_ = slices;
+  inv_leaf_ = 1.0f / leaf_size_;
+  too_fine_ = false;
+
+  if (barrier_slices_ != slices)
+  {
+    barrier_.reset(new boost::barrier(slices));
+    barrier_slices_ = slices;
+  }
+
+  // Workers are started by the first call that needs them and then kept
+  while (worker_count_ < slices - 1)
+  {
+    worker_count_++;
+    workers_.create_thread(boost::bind(&VoxelDownsampler::workerLoop, this, worker_count_, generation_));
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(pool_mutex_);
+    running_ = slices - 1;
+    generation_++;
+  }
+  start_cond_.notify_all();
+
+  filterSlice(0);
+
+  {
+    boost::unique_lock<boost::mutex> lock(pool_mutex_);
+    while (running_ > 0)
+      done_cond_.wait(lock);
+  }
+
+  // pcl::VoxelGrid also gives the points back unfiltered in this case
+  if (too_fine_)
+  {
+    output.points.clear();
+    for (size_t i = 0; i < n; i++)
+    {
+      if (finitePoint(input[i]))
+        output.points.push_back(input[i]);
+    }
+    output.width = output.points.size();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void VoxelDownsampler<PointType>::workerLoop(int s, unsigned long generation)
+{
+  /* Sleeps until the next call, runs slice s of it if it has that many */
+
+  while (true)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(pool_mutex_);
+      while (generation_ == generation && not stopping_)
+        start_cond_.wait(lock);
+      if (stopping_)
+        return;
+      generation = generation_;
+      if (s >= slices_)
+        continue;
+    }
+
+    filterSlice(s);
+
+    {
+      boost::lock_guard<boost::mutex> lock(pool_mutex_);
+      if (--running_ == 0)
+        done_cond_.notify_one();
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename PointType>
+void VoxelDownsampler<PointType>::filterSlice(int s)
+{
+  const pcl::PointCloud<PointType> &input = *input_;
+  const size_t n = size_;
+  const int slices = slices_;
+  boost::barrier &barrier = *barrier_;
+
+  size_t begin = n * s / slices;
+  size_t end = n * (s + 1) / slices;
+
+  // Voxel bounds of the slice, four coordinates quantised at once
+  Eigen::Array4f low = Eigen::Array4f::Constant(std::numeric_limits<float>::max());
+  Eigen::Array4f high = Eigen::Array4f::Constant(-std::numeric_limits<float>::max());
+  for (size_t i = begin; i < end; i++)
+  {
+    if (not finitePoint(input[i]))
+      continue;
+    Eigen::Array4f cell = (input[i].getArray4fMap() * inv_leaf_).floor();
+    low = low.min(cell);
+    high = high.max(cell);
+  }
+  slice_min_[s] = low;
+  slice_max_[s] = high;
+  barrier.wait();
+
+  // The bounds of the whole cloud are left in slice_min_[0] for every slice
+  if (s == 0)
+  {
+    Eigen::Array4f lower = slice_min_[0];
+    Eigen::Array4f upper = slice_max_[0];
+    for (int t = 1; t < slices; t++)
+    {
+      lower = lower.min(slice_min_[t]);
+      upper = upper.max(slice_max_[t]);
+    }
+    slice_min_[0] = lower;
+
+    dim_x_ = dim_xy_ = invalid_key_ = 0;
+    if ((upper >= lower).head<3>().all())
+    {
+      Eigen::Array3d dims = (upper - lower).head<3>().cast<double>() + 1.0;
+      too_fine_ = (dims.prod() >= 9.0e18);
+      if (not too_fine_)
+      {
+        dim_x_ = dims.x();
+        dim_xy_ = dim_x_ * static_cast<uint64_t>(dims.y());
+        invalid_key_ = dim_xy_ * static_cast<uint64_t>(dims.z());
+      }
+    }
+
+    // Keys of the valid points are below invalid_key_, which sorts them first
+    int bits = 0;
+    while (bits < 64 && (invalid_key_ >> bits) != 0)
+      bits++;
+    passes_ = (bits + kDigitBits - 1) / kDigitBits;
+  }
+  barrier.wait();
+
+  if (too_fine_)
+    return;
+
+  const Eigen::Array4f lower = slice_min_[0];
+  const uint64_t dim_x = dim_x_, dim_xy = dim_xy_, invalid_key = invalid_key_;
+  const int passes = passes_;
+
+  // One key per point, z then y then x as pcl::VoxelGrid orders its voxels
+  for (size_t i = begin; i < end; i++)
+  {
+    uint64_t key = invalid_key;
+    if (finitePoint(input[i]))
+    {
+      Eigen::Array4f cell = (input[i].getArray4fMap() * inv_leaf_).floor() - lower;
+      key = static_cast<uint64_t>(cell.z()) * dim_xy +
+            static_cast<uint64_t>(cell.y()) * dim_x +
+            static_cast<uint64_t>(cell.x());
+    }
+    keys_[0][i] = key;
+    order_[0][i] = i;
+  }
+
+  // Least significant digit first, each pass stable
+  for (int pass = 0; pass < passes; pass++)
+  {
+    const int shift = pass * kDigitBits;
+    const std::vector<uint64_t> &keys_in = keys_[pass & 1];
+    const std::vector<uint32_t> &order_in = order_[pass & 1];
+    std::vector<uint64_t> &keys_out = keys_[(pass + 1) & 1];
+    std::vector<uint32_t> &order_out = order_[(pass + 1) & 1];
+
+    uint32_t *counts = &histograms_[s * kDigits];
+    std::fill(counts, counts + kDigits, 0);
+    for (size_t i = begin; i < end; i++)
+      counts[(keys_in[i] >> shift) & (kDigits - 1)]++;
+    barrier.wait();
+
+    // Where each slice puts its points of each digit
+    if (s == 0)
+    {
+      uint32_t position = 0;
+      for (uint32_t digit = 0; digit < kDigits; digit++)
+      {
+        for (int t = 0; t < slices; t++)
+        {
+          uint32_t count = histograms_[t * kDigits + digit];
+          histograms_[t * kDigits + digit] = position;
+          position += count;
+        }
+      }
+    }
+    barrier.wait();
+
+    for (size_t i = begin; i < end; i++)
+    {
+      uint32_t position = counts[(keys_in[i] >> shift) & (kDigits - 1)]++;
+      keys_out[position] = keys_in[i];
+      order_out[position] = order_in[i];
+    }
+    barrier.wait();
+  }
+
+  // A voxel belongs to the slice its first point is in
+  const std::vector<uint64_t> &keys = keys_[passes & 1];
+  const std::vector<uint32_t> &order = order_[passes & 1];
+  size_t voxels = 0;
+  for (size_t i = begin; i < end && keys[i] != invalid_key; i++)
+  {
+    if (i == 0 || keys[i] != keys[i - 1])
+      voxels++;
+  }
+  slice_voxels_[s] = voxels;
+  barrier.wait();
+
+  if (s == 0)
+  {
+    size_t total = 0;
+    for (int t = 0; t < slices; t++)
+    {
+      size_t count = slice_voxels_[t];
+      slice_voxels_[t] = total;
+      total += count;
+    }
+    output_->points.resize(total);
+    output_->width = total;
+  }
+  barrier.wait();
+
+  size_t out = slice_voxels_[s];
+  size_t i = begin;
+  while (i < end && i > 0 && keys[i] == keys[i - 1])
+    i++;
+  while (i < end && keys[i] != invalid_key)
+  {
+    Eigen::Array4f sum = Eigen::Array4f::Zero();
+    uint64_t colour[4] = {0, 0, 0, 0};
+    size_t j = i;
+    for (; j < n && keys[j] == keys[i]; j++)
+    {
+      const PointType &pt = input[order[j]];
+      sum += pt.getArray4fMap();
+      addColour(colour, pt);
+    }
+
+    PointType &voxel = output_->points[out++];
+    voxel.getArray3fMap() = sum.head<3>() / static_cast<float>(j - i);
+    setColour(voxel, colour, j - i);
+    i = j;
+  }
+}
+
+// The point layouts of the pipeline, see perception_pipeline.h
+template class VoxelDownsampler<pcl::PointXYZRGBA>;
+template class VoxelDownsampler<pcl::PointXYZ>;
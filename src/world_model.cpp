@@ -0,0 +1,416 @@
+/* Software License Agreement (MIT License)
+ *
+ *  Copyright (c) 2019-, Dimitrios Kanoulas
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the copyright holder(s) nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <cw3_team_2/world_model.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  /** \brief Header of a snapshot file */
+  const char kMagic[4] = {'C', 'W', 'W', 'M'};
+  const uint32_t kVersion = 1;
+
+  /** \brief Bytes of the header, of a cube and of a stack */
+  const size_t kHeaderSize = 4 + 4 + 4 + 8 + 4 + 4;
+  const size_t kCubeSize = 4 * 8 + 4 * 4 + 8 + 4 + 4;
+  const size_t kStackSize = 3 * 8;
+
+  template <typename T>
+  void
+  put (std::vector<char> &buffer, T value)
+  {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+  }
+
+  template <typename T>
+  T
+  take (const char *&data)
+  {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+WorldModel::WorldModel(double match_distance, double stack_height)
+    : match_distance_(match_distance),
+      stack_height_(stack_height),
+      valid_(false)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WorldModel::invalidate()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  cubes_.clear();
+  valid_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WorldModel::rebuild(const std::vector<ModelCube> &seen)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  cubes_ = seen;
+  for (size_t i = 0; i < cubes_.size(); i++)
+  {
+    cubes_[i].on_stack = (cubes_[i].height > stack_height_) || atStack(cubes_[i].position);
+    cubes_[i].reserved_by = -1;
+  }
+
+  valid_ = true;
+  stamp_ = ros::WallTime::now();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::claim(int job, const std::vector<int> &colour_classes)
+{
+  /* Counts the free cubes of each colour, less those claimed by the jobs
+     already queued. The running job holds reservations, its cubes are not
+     free */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  if (valid_)
+  {
+    std::map<int, int> needed;
+    for (size_t i = 0; i < colour_classes.size(); i++)
+    {
+      if (colour_classes[i] == COLOUR_UNKNOWN)
+        return false;
+      needed[colour_classes[i]]++;
+    }
+
+    std::map<int, std::vector<int> >::const_iterator queued;
+    for (queued = claims_.begin(); queued != claims_.end(); ++queued)
+      for (size_t i = 0; i < queued->second.size(); i++)
+        needed[queued->second[i]]++;
+
+    for (size_t j = 0; j < cubes_.size(); j++)
+    {
+      if (not cubes_[j].on_stack && (cubes_[j].reserved_by < 0))
+        needed[cubes_[j].colour_class]--;
+    }
+
+    for (size_t i = 0; i < colour_classes.size(); i++)
+    {
+      if (needed[colour_classes[i]] > 0)
+        return false;
+    }
+  }
+
+  claims_[job] = colour_classes;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::reserve(int job,
+                         const std::vector<int> &colour_classes,
+                         std::vector<int> &cube_ids)
+{
+  /* Takes the first free cube of each colour, like the colour matching of
+     task 2, but never one held by another job. The jobs run in the order
+     they were queued, so the claims left are of later jobs and give way */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  cube_ids.clear();
+  for (size_t i = 0; i < colour_classes.size(); i++)
+  {
+    int found = -1;
+    for (size_t j = 0; j < cubes_.size(); j++)
+    {
+      const ModelCube &cube = cubes_[j];
+      if (cube.on_stack || cube.reserved_by >= 0)
+        continue;
+
+      if ((colour_classes[i] != COLOUR_UNKNOWN) && (cube.colour_class == colour_classes[i]))
+      {
+        found = j;
+        break;
+      }
+    }
+
+    if (found < 0)
+    {
+      releaseLocked(job);
+      cube_ids.clear();
+      return false;
+    }
+
+    cubes_[found].reserved_by = job;
+    cube_ids.push_back(found);
+  }
+
+  claims_.erase(job);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WorldModel::release(int job)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  releaseLocked(job);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WorldModel::releaseLocked(int job)
+{
+  claims_.erase(job);
+  for (size_t i = 0; i < cubes_.size(); i++)
+  {
+    if (cubes_[i].reserved_by == job)
+      cubes_[i].reserved_by = -1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WorldModel::moveToStack(int cube_id, const geometry_msgs::Point &stack_point)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  ModelCube &cube = cubes_[cube_id];
+  cube.position.x = stack_point.x;
+  cube.position.y = stack_point.y;
+  cube.on_stack = true;
+  cube.reserved_by = -1;
+
+  if (not atStack(stack_point))
+    stacks_.push_back(stack_point);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::consistentWith(const std::vector<geometry_msgs::Point> &detected,
+                                const ViewTest &in_view) const
+{
+  /* A moved, removed or added cube shows up as a model position without a
+     cluster or a cluster without a model position */
+
+  boost::mutex::scoped_lock lock(mutex_);
+
+  for (size_t i = 0; i < detected.size(); i++)
+  {
+    bool known = atStack(detected[i]);
+    for (size_t j = 0; j < cubes_.size() && not known; j++)
+      known = near(cubes_[j].position, detected[i]);
+
+    if (not known)
+      return false;
+  }
+
+  // Stacked cubes sit at their stack, so every cube position must show a cluster
+  std::vector<geometry_msgs::Point> expected = stacks_;
+  for (size_t j = 0; j < cubes_.size(); j++)
+    expected.push_back(cubes_[j].position);
+
+  for (size_t j = 0; j < expected.size(); j++)
+  {
+    if (not in_view(expected[j]))
+      continue;
+
+    bool seen = false;
+    for (size_t i = 0; i < detected.size() && not seen; i++)
+      seen = near(expected[j], detected[i]);
+
+    if (not seen)
+      return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::save(const std::string &path) const
+{
+  /* Magic, version, validity, scan time and counts, then fixed size records
+     of the cubes and the stacks, in host byte order */
+
+  boost::mutex::scoped_lock lock(mutex_);
+  std::vector<char> buffer;
+  buffer.reserve(kHeaderSize + cubes_.size() * kCubeSize + stacks_.size() * kStackSize);
+  buffer.insert(buffer.end(), kMagic, kMagic + sizeof(kMagic));
+  put<uint32_t>(buffer, kVersion);
+  put<uint32_t>(buffer, valid_ ? 1 : 0);
+  put<double>(buffer, stamp_.toSec());
+  put<uint32_t>(buffer, cubes_.size());
+  put<uint32_t>(buffer, stacks_.size());
+
+  for (size_t i = 0; i < cubes_.size(); i++)
+  {
+    const ModelCube &cube = cubes_[i];
+    put<double>(buffer, cube.position.x);
+    put<double>(buffer, cube.position.y);
+    put<double>(buffer, cube.position.z);
+    put<double>(buffer, cube.yaw);
+    put<float>(buffer, cube.colour.r);
+    put<float>(buffer, cube.colour.g);
+    put<float>(buffer, cube.colour.b);
+    put<float>(buffer, cube.colour.a);
+    put<double>(buffer, cube.height);
+    put<int32_t>(buffer, cube.colour_class);
+    put<uint32_t>(buffer, cube.on_stack ? 1 : 0);
+  }
+
+  for (size_t i = 0; i < stacks_.size(); i++)
+  {
+    put<double>(buffer, stacks_[i].x);
+    put<double>(buffer, stacks_[i].y);
+    put<double>(buffer, stacks_[i].z);
+  }
+
+  // Written aside and renamed over the old snapshot once it is on disk
+  std::string tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+
+  size_t written = 0;
+  while (written < buffer.size())
+  {
+    ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+
+  bool ok = (written == buffer.size()) && (fsync(fd) == 0);
+  ok = (close(fd) == 0) && ok;
+  if (not ok || std::rename(tmp_path.c_str(), path.c_str()) != 0)
+  {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::load(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(kHeaderSize))
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = info.st_size;
+  void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+
+  const char *data = static_cast<const char *>(mapping);
+  bool ok = (std::memcmp(data, kMagic, sizeof(kMagic)) == 0);
+  data += sizeof(kMagic);
+
+  uint32_t version = take<uint32_t>(data);
+  uint32_t valid = take<uint32_t>(data);
+  double stamp = take<double>(data);
+  uint32_t num_cubes = take<uint32_t>(data);
+  uint32_t num_stacks = take<uint32_t>(data);
+  ok = ok && (version == kVersion) &&
+       (size == kHeaderSize + num_cubes * kCubeSize + num_stacks * kStackSize);
+
+  if (ok)
+  {
+    std::vector<ModelCube> cubes(num_cubes);
+    for (size_t i = 0; i < cubes.size(); i++)
+    {
+      ModelCube &cube = cubes[i];
+      cube.position.x = take<double>(data);
+      cube.position.y = take<double>(data);
+      cube.position.z = take<double>(data);
+      cube.yaw = take<double>(data);
+      cube.colour.r = take<float>(data);
+      cube.colour.g = take<float>(data);
+      cube.colour.b = take<float>(data);
+      cube.colour.a = take<float>(data);
+      cube.height = take<double>(data);
+      cube.colour_class = take<int32_t>(data);
+      cube.on_stack = (take<uint32_t>(data) != 0);
+      cube.reserved_by = -1;
+    }
+
+    std::vector<geometry_msgs::Point> stacks(num_stacks);
+    for (size_t i = 0; i < stacks.size(); i++)
+    {
+      stacks[i].x = take<double>(data);
+      stacks[i].y = take<double>(data);
+      stacks[i].z = take<double>(data);
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    cubes_.swap(cubes);
+    stacks_.swap(stacks);
+    valid_ = (valid != 0);
+    stamp_ = ros::WallTime(stamp);
+  }
+
+  munmap(mapping, size);
+  return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::near(const geometry_msgs::Point &a, const geometry_msgs::Point &b) const
+{
+  return std::hypot(a.x - b.x, a.y - b.y) < match_distance_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool WorldModel::atStack(const geometry_msgs::Point &p) const
+{
+  for (size_t i = 0; i < stacks_.size(); i++)
+  {
+    if (near(stacks_[i], p))
+      return true;
+  }
+  return false;
+}